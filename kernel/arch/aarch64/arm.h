@@ -95,6 +95,33 @@ static inline void dccivac(void *p, int n)
         asm volatile("dc civac, %[x]" : : [x] "r"(p + n));
 }
 
+#define CACHE_LINE_SIZE 64  // Data cache line of the Cortex-A53
+
+/*
+ * DC CVAC Data cache clean by VA to PoC, a line at a time
+ * Makes what the CPU wrote to [p, p + n) visible to a DMA engine reading memory.
+ */
+static inline void dc_clean_range(void *p, uint64_t n)
+{
+    uint64_t end = (uint64_t)p + n;
+    for (uint64_t a = (uint64_t)p & ~(uint64_t)(CACHE_LINE_SIZE - 1); a < end; a += CACHE_LINE_SIZE)
+        asm volatile("dc cvac, %[x]" : : [x] "r"(a) : "memory");
+    asm volatile("dsb sy" : : : "memory");
+}
+
+/*
+ * DC CIVAC Data cache clean and invalidate by VA to PoC, a line at a time
+ * Before a DMA engine writes [p, p + n) no dirty line may be evicted over its data, and afterwards
+ * the CPU must not read stale lines. The range should cover whole lines, the rest of a line is written back too.
+ */
+static inline void dc_flush_range(void *p, uint64_t n)
+{
+    uint64_t end = (uint64_t)p + n;
+    for (uint64_t a = (uint64_t)p & ~(uint64_t)(CACHE_LINE_SIZE - 1); a < end; a += CACHE_LINE_SIZE)
+        asm volatile("dc civac, %[x]" : : [x] "r"(a) : "memory");
+    asm volatile("dsb sy" : : : "memory");
+}
+
 /*
  * CNTPCT, Counter-timer Physical Count register
  * https://developer.arm.com/documentation/ddi0595/2021-12/AArch32-Registers/CNTPCT--Counter-timer-Physical-Count-register?lang=en
@@ -316,4 +343,95 @@ static inline void lttbr1(uint64_t p)
     disb();
 }
 
+/*
+ * Invalidate all stage 1 EL0/EL1 TLB entries on every core in the Inner Shareable domain.
+ * Used after unmapping pages of a page table that may be live in TTBR0 of other cores (threads).
+ * https://developer.arm.com/documentation/ddi0596/2021-12/Base-Instructions/TLBI--TLB-Invalidate-operation--an-alias-of-SYS-?lang=en
+ */
+static inline void tlbi_vmalle1is(void)
+{
+    asm volatile("dsb ishst");
+    asm volatile("tlbi vmalle1is");
+    asm volatile("dsb ish");
+    isb();
+}
+
+/*
+ * Read the EL0 Read/Write Software Thread ID Register, the user space thread pointer
+ * https://developer.arm.com/documentation/ddi0595/2021-12/AArch64-Registers/TPIDR-EL0--EL0-Read-Write-Software-Thread-ID-Register?lang=en
+ */
+static inline uint64_t r_tpidr_el0(void)
+{
+    uint64_t x;
+    asm volatile("mrs %[x], tpidr_el0" : [x] "=r"(x));
+    return x;
+}
+
+/*
+ * TPIDR_EL1, holds the offset of this CPU's copy of the per-CPU area, see include/percpu.h
+ * https://developer.arm.com/documentation/ddi0595/2021-12/AArch64-Registers/TPIDR-EL1--EL1-Software-Thread-ID-Register?lang=en
+ */
+static inline uint64_t r_tpidr_el1(void)
+{
+    uint64_t x;
+    asm volatile("mrs %[x], tpidr_el1" : [x] "=r"(x));
+    return x;
+}
+
+static inline void l_tpidr_el1(uint64_t x)
+{
+    asm volatile("msr tpidr_el1, %[x]" : : [x] "r"(x));
+}
+
+/*
+ * SP_EL0, the user stack pointer while at EL0. The kernel runs on SP_EL1, so at EL1 it holds the current process,
+ * the user value is saved in the trap frame on entry and restored from it on return.
+ * Not volatile: the value only changes across a switch, after which we are still the same process.
+ */
+static inline uint64_t r_sp_el0(void)
+{
+    uint64_t x;
+    asm("mrs %[x], sp_el0" : [x] "=r"(x));
+    return x;
+}
+
+static inline void l_sp_el0(uint64_t x)
+{
+    asm volatile("msr sp_el0, %[x]" : : [x] "r"(x) : "memory");
+}
+
+/*
+ * CPACR_EL1, Architectural Feature Access Control Register, FPEN controls the trapping of FP/SIMD instructions
+ * https://developer.arm.com/documentation/ddi0595/2021-12/AArch64-Registers/CPACR-EL1--Architectural-Feature-Access-Control-Register?lang=en
+ */
+static inline uint64_t r_cpacr_el1(void)
+{
+    uint64_t x;
+    asm volatile("mrs %[x], cpacr_el1" : [x] "=r"(x));
+    return x;
+}
+
+static inline void l_cpacr_el1(uint64_t x)
+{
+    asm volatile("msr cpacr_el1, %[x]\n isb" : : [x] "r"(x) : "memory");
+}
+
+/*
+ * Wait For Event, the core enters a low power state until an event is signalled, by SEV on another core
+ * or by the clearing of its exclusive monitor when another core stores to a location it loaded with LDAXR.
+ * https://developer.arm.com/documentation/ddi0596/2021-12/Base-Instructions/WFE--Wait-For-Event-?lang=en
+ */
+static inline void wfe(void)
+{
+    asm volatile("wfe" : : : "memory");
+}
+
+/*
+ * Hint to the core that we are in a spin-wait loop, and keep the compiler from caching what the loop reads
+ */
+static inline void cpu_relax(void)
+{
+    asm volatile("yield" : : : "memory");
+}
+
 #endif /* _ARM_H */
\ No newline at end of file
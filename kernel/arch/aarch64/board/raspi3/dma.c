@@ -0,0 +1,84 @@
+/**
+ * @file dma.c
+ * @author ylp
+ * @brief BCM2835 DMA controller, transfers described by chains of control blocks and paced by peripheral DREQs
+ * @version 0.1
+ * @date 2022-06-25
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "dma.h"
+#include "../../arm.h"
+#include "printf.h"
+
+#define DMA_BASE            (MMIO_BASE + 0x00007000)
+#define DMA_CS(c)           ((volatile unsigned int *)(DMA_BASE + (c) * 0x100 + 0x00))
+#define DMA_CONBLK_AD(c)    ((volatile unsigned int *)(DMA_BASE + (c) * 0x100 + 0x04))
+#define DMA_DEBUG(c)        ((volatile unsigned int *)(DMA_BASE + (c) * 0x100 + 0x20))
+#define DMA_ENABLE          ((volatile unsigned int *)(DMA_BASE + 0xFF0))
+
+#define DMA_CS_ACTIVE       (1 << 0)
+#define DMA_CS_END          (1 << 1)
+#define DMA_CS_INT          (1 << 2)
+#define DMA_CS_ERROR        (1 << 8)
+#define DMA_CS_WAIT_WRITES  (1 << 28)   // Wait for outstanding writes before calling the chain done
+#define DMA_CS_ABORT        (1 << 30)
+#define DMA_CS_RESET        (1U << 31)
+#define DMA_DEBUG_ERRORS    0x7         // Read error, FIFO error, read last not set error, write 1 to clear
+
+#define DMA_WAIT_US         1000        // The chain is over when the peripheral is, only the last writes remain
+
+/*
+ * Enable and reset a DMA channel
+ */
+void dma_init(int chan)
+{
+    *DMA_ENABLE |= 1 << chan;
+    *DMA_CS(chan) = DMA_CS_RESET;
+    delayus(10);
+    *DMA_DEBUG(chan) = DMA_DEBUG_ERRORS;
+    *DMA_CS(chan) = DMA_CS_END | DMA_CS_INT;
+}
+
+/*
+ * Start a chain of control blocks on a channel
+ */
+void dma_start(int chan, struct dma_cb *cb)
+{
+    disb();
+    *DMA_CS(chan) = DMA_CS_END | DMA_CS_INT;
+    *DMA_CONBLK_AD(chan) = DMA_BUS_MEM(cb);
+    *DMA_CS(chan) = DMA_CS_WAIT_WRITES | DMA_CS_ACTIVE;
+}
+
+/*
+ * Wait for the channel to finish its chain, for DMA_WAIT_US at most
+ */
+int dma_wait(int chan)
+{
+    int count = DMA_WAIT_US;
+    while ((*DMA_CS(chan) & DMA_CS_ACTIVE) && !(*DMA_CS(chan) & DMA_CS_ERROR) && count--)
+        delayus(1);
+    uint32_t cs = *DMA_CS(chan);
+    if ((cs & (DMA_CS_ACTIVE | DMA_CS_ERROR)) || (*DMA_DEBUG(chan) & DMA_DEBUG_ERRORS)) {
+        cprintf("dma_wait: channel %d cs 0x%x debug 0x%x.\n", chan, cs, *DMA_DEBUG(chan));
+        dma_abort(chan);
+        return -1;
+    }
+    *DMA_CS(chan) = DMA_CS_END | DMA_CS_INT;
+    disb();
+    return 0;
+}
+
+/*
+ * Stop the channel and drop its chain
+ */
+void dma_abort(int chan)
+{
+    *DMA_CS(chan) = DMA_CS_RESET;
+    delayus(10);
+    *DMA_DEBUG(chan) = DMA_DEBUG_ERRORS;
+    *DMA_CS(chan) = DMA_CS_END | DMA_CS_INT;
+}
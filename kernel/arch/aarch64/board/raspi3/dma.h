@@ -0,0 +1,84 @@
+/**
+ * @file dma.h
+ * @author ylp
+ * @brief BCM2835 DMA controller, transfers described by chains of control blocks and paced by peripheral DREQs
+ * @version 0.1
+ * @date 2022-06-25
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef DMA_H
+#define DMA_H
+
+#include "peripherals_base.h"
+
+/*
+ * Transfer information of a control block
+ */
+#define DMA_TI_INTEN            (1 << 0)    // Interrupt when this control block is done
+#define DMA_TI_WAIT_RESP        (1 << 3)    // Wait for the write response of every write
+#define DMA_TI_DEST_INC         (1 << 4)
+#define DMA_TI_DEST_WIDTH       (1 << 5)    // 128-bit writes instead of 32-bit ones
+#define DMA_TI_DEST_DREQ        (1 << 6)    // The peripheral paces the writes
+#define DMA_TI_SRC_INC          (1 << 8)
+#define DMA_TI_SRC_WIDTH        (1 << 9)
+#define DMA_TI_SRC_DREQ         (1 << 10)   // The peripheral paces the reads
+#define DMA_TI_PERMAP(n)        ((n) << 16) // Peripheral whose DREQ is used
+#define DMA_TI_NO_WIDE_BURSTS   (1 << 26)
+
+#define DMA_DREQ_EMMC           11
+
+// The VideoCore sees the RAM at bus address 0xC0000000 (uncached by its L2) and the peripherals at 0x7E000000
+#define DMA_BUS_MEM(va)         ((uint32_t)(VA2PA(va) | 0xC0000000))
+#define DMA_BUS_IO(va)          ((uint32_t)((uint64_t)(va) - MMIO_BASE + 0x7E000000))
+
+#ifndef __ASSEMBLER__
+#include "../../../../include/stdint.h"
+
+/*
+ * Control block, the engine walks the chain through nextconbk, which must be 32-byte aligned
+ */
+struct dma_cb {
+    uint32_t ti;
+    uint32_t source_ad;
+    uint32_t dest_ad;
+    uint32_t txfr_len;
+    uint32_t stride;
+    uint32_t nextconbk;     // Bus address of the next control block, 0 ends the chain
+    uint32_t reserved[2];
+} __attribute__((aligned(32)));
+
+/**
+ * @brief  Enable and reset a DMA channel
+ * @param  chan: Channel 0-14
+ * @retval None
+ */
+void dma_init(int chan);
+
+/**
+ * @brief  Start a chain of control blocks on a channel, the chain must be cleaned to memory
+ * @param  chan: The channel
+ * @param  *cb: The first control block
+ * @retval None
+ */
+void dma_start(int chan, struct dma_cb *cb);
+
+/**
+ * @brief  Wait for the channel to finish its chain, for a short while only
+ * @param  chan: The channel
+ * @retval 0 on success, -1 on an error or if it is still busy, the channel is reset then
+ */
+int dma_wait(int chan);
+
+/**
+ * @brief  Stop the channel and drop its chain
+ * @param  chan: The channel
+ * @retval None
+ */
+void dma_abort(int chan);
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* DMA_H */
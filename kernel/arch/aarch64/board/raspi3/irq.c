@@ -12,18 +12,98 @@
 #include "irq.h"
 #include "../../timer.h"
 #include "../../arm.h"
+#include "include/percpu.h"
+#include "lib/string.h"
 
 extern void enable_recv_interrupt(void);
 
+static const char *irq_names[NR_IRQS] = {
+    [IRQ_NR_TIMER] = "timer",
+    [IRQ_NR_UART] = "uart",
+    [IRQ_NR_EMMC] = "emmc",
+};
+
+static const bool irq_is_gpu[NR_IRQS] = {
+    [IRQ_NR_UART] = true,
+    [IRQ_NR_EMMC] = true,
+};
+
+// Core each interrupt is delivered to, only changed under irq_lock
+static int irq_affinity[NR_IRQS];
+static struct spinlock irq_lock;
+
+// Interrupts handled by this core, only updated by their core with interrupts disabled
+static DEFINE_PER_CPU(uint64_t[NR_IRQS], irq_counts);
+
 /*
  * Board level interrupt controller initialization
  */
 void irq_init()
 {
+    init_spin_lock(&irq_lock, "irq");
     // AUX has an interrupt source for mini-UART
     put32(ENABLE_IRQS_1, AUX_INT);
-    // Route all GPU interrupts to core 0
+    // Route all GPU interrupts to core 0, CPU 0 advances ticks
     put32(GPU_INTERRUPTS_ROUTING, GPUFIQ2CORE(0) | GPUIRQ2CORE(0));
+    for (int i = 0; i < NR_IRQS; i++) {
+        irq_affinity[i] = 0;
+    }
     // Enable UART controller receive interrupt
     enable_recv_interrupt();
-}
\ No newline at end of file
+}
+
+/*
+ * Count an interrupt on this core
+ */
+void irq_account(int irq)
+{
+    (*this_cpu_ptr(&irq_counts))[irq]++;
+}
+
+/*
+ * Core an interrupt is delivered to
+ */
+int irq_get_affinity(int irq)
+{
+    return __atomic_load_n(&irq_affinity[irq], __ATOMIC_RELAXED);
+}
+
+/*
+ * Deliver an interrupt to another core
+ * The GPU interrupts are moved together by the routing register of the local peripherals. An interrupt
+ * already on its way to the previous core is still handled there.
+ */
+int irq_set_affinity(int irq, int cpu)
+{
+    if (irq < 0 || irq >= NR_IRQS || cpu < 0 || cpu >= NCPU)
+        return -1;
+    acquire_spin_lock(&irq_lock);
+    if (irq_is_gpu[irq]) {
+        put32(GPU_INTERRUPTS_ROUTING, GPUFIQ2CORE(cpu) | GPUIRQ2CORE(cpu));
+        for (int i = 0; i < NR_IRQS; i++) {
+            if (irq_is_gpu[i])
+                __atomic_store_n(&irq_affinity[i], cpu, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&irq_affinity[irq], cpu, __ATOMIC_RELAXED);
+    }
+    release_spin_lock(&irq_lock);
+    return 0;
+}
+
+/*
+ * Fill in the statistics of up to n interrupts, the counters are read while the cores update them
+ */
+int32_t irqinfo(struct irqinfo *info, int n)
+{
+    int i;
+    for (i = 0; i < NR_IRQS && i < n; i++) {
+        safestrcpy(info[i].name, irq_names[i], sizeof(info[i].name));
+        info[i].affinity = irq_get_affinity(i);
+        info[i].gpu = irq_is_gpu[i];
+        for (int c = 0; c < NCPU; c++) {
+            info[i].count[c] = __atomic_load_n(&(*per_cpu_ptr(&irq_counts, c))[i], __ATOMIC_RELAXED);
+        }
+    }
+    return i;
+}
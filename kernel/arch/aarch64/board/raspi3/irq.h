@@ -31,6 +31,7 @@
  * ARM peripherals interrupts table.
  */
 #define AUX_INT                 (1 << 29)
+#define EMMC_INT                (1 << 30)   /* IRQ 62, Arasan SD host, in the second bank */
 
 /* 
  * IRQ Source Definitions
@@ -39,4 +40,69 @@
 #define IRQ_TIMER               (1 << 11) /* local timer (unused) */
 #define IRQ_GPU                 (1 << 8)
 
+#ifndef __ASSEMBLER__
+#include "../../../../include/stdint.h"
+#include "../../../../include/param.h"
+
+/*
+ * Interrupts known to the kernel, for the per-CPU counts and the affinity
+ * The BCM2836 routes all the GPU (peripheral) interrupts to one core together, so every
+ * IRQ_GPU_* interrupt has the same affinity and setting the affinity of one moves them all.
+ * The core timers fire on every core, the affinity of IRQ_NR_TIMER picks the core that advances ticks.
+ */
+enum {
+    IRQ_NR_TIMER,       // Core timer, CNTPNSIRQ
+    IRQ_NR_UART,        // Mini UART (AUX), a GPU interrupt
+    IRQ_NR_EMMC,        // EMMC controller, a GPU interrupt
+    NR_IRQS
+};
+
+/*
+ * Per-IRQ statistics reported to user space by irqinfo
+ */
+struct irqinfo {
+    char name[16];
+    int32_t affinity;       // Core the interrupt is delivered to
+    int32_t gpu;            // Non-zero for GPU interrupts, which share their affinity
+    uint64_t count[NCPU];   // Interrupts handled by each core
+};
+
+/**
+ * @brief  Board level interrupt controller initialization, routes the GPU interrupts to core 0
+ * @retval None
+ */
+void irq_init(void);
+
+/**
+ * @brief  Count an interrupt on this core, Called by the interrupt handler
+ * @param  irq: IRQ_NR_*
+ * @retval None
+ */
+void irq_account(int irq);
+
+/**
+ * @brief  Core an interrupt is delivered to
+ * @param  irq: IRQ_NR_*
+ * @retval The core
+ */
+int irq_get_affinity(int irq);
+
+/**
+ * @brief  Deliver an interrupt to another core, along with all the other GPU interrupts if it is one
+ * @param  irq: IRQ_NR_*
+ * @param  cpu: The core
+ * @retval 0 on success, -1 if irq or cpu is invalid
+ */
+int irq_set_affinity(int irq, int cpu);
+
+/**
+ * @brief  Fill in the statistics of up to n interrupts
+ * @param  *info: Array of n entries
+ * @param  n: Size of the array
+ * @retval Number of entries filled in
+ */
+int32_t irqinfo(struct irqinfo *info, int n);
+
+#endif /* __ASSEMBLER__ */
+
 #endif /* IRQ_H */
\ No newline at end of file
@@ -22,8 +22,8 @@
 
 #define CONTROL_REGISTER        (LOCAL_PERIPHERALS_BASE + 0)
 #define CORE_TIMER_PRESCALER    (LOCAL_PERIPHERALS_BASE + 0x8)
-#define GPUFIQ2CORE(i)          (((i) & 0x11) << 2)
-#define GPUIRQ2CORE(i)          ((i) & 0x11)
+#define GPUFIQ2CORE(i)          (((i) & 0b11) << 2)    // GPU FIQ routing, bits [3:2] of GPU_INTERRUPTS_ROUTING
+#define GPUIRQ2CORE(i)          ((i) & 0b11)           // GPU IRQ routing, bits [1:0] of GPU_INTERRUPTS_ROUTING
 
 #define GPU_INTERRUPTS_ROUTING                       (LOCAL_PERIPHERALS_BASE + 0xC)
 #define PERFORMANCE_MONITOR_INTERRUPT_ROUTINT_SET    (LOCAL_PERIPHERALS_BASE + 0x10)
@@ -16,8 +16,10 @@
 #include "gpio.h"
 #include "../../arm.h"
 #include "sync/spinlock.h"
+#include "interrupt/softirq.h"
 
 #define UART_TXBUF_SIZE 32
+#define UART_RXBUF_SIZE 64
 
 char uart_tx_buf[UART_TXBUF_SIZE];
 uint64_t uart_tx_w;     // Next write location, uart_tx_buf[uart_tx_w % UART_TXBUF_SIZE]  
@@ -26,6 +28,14 @@ extern volatile int panicked;
 extern void consoleintr(int c);
 static struct spinlock uart_tx_lock;
 
+// Received characters, written by the interrupt handler and read by the UART tasklet only
+static char uart_rx_buf[UART_RXBUF_SIZE];
+static uint64_t uart_rx_w;      // Next write location, uart_rx_buf[uart_rx_w % UART_RXBUF_SIZE]
+static uint64_t uart_rx_r;      // Next read location, uart_rx_buf[uart_rx_r % UART_RXBUF_SIZE]
+
+static void uart_tasklet_fn(uint64_t data);
+static struct tasklet_struct uart_tasklet = { .func = uart_tasklet_fn };
+
 /*
  * Check whether the UART controller send buffer is empty
  */
@@ -171,18 +181,35 @@ static int uart_getchar(void)
 /*
  * handle a uart interrupt, raised because input has arrived, or the 
  * uart is ready for more output, or both. called from trap.c.
- * Print UART controller read buffer data to console and 
- * write all of user write buffer data to controller write buffer reg 
+ * Only drains the receive FIFO, which acknowledges the interrupt, the console
+ * processing and the transmission are left to the UART tasklet.
  */
 void uartintr(void)
 {
-    // read and process incoming characters.
     while(1) {
         int c = uart_getchar();
         if (c == -1) {
             break;
         }
-        consoleintr(c);
+        // Drop the character if the tasklet is that far behind
+        if (uart_rx_w - __atomic_load_n(&uart_rx_r, __ATOMIC_ACQUIRE) < UART_RXBUF_SIZE) {
+            uart_rx_buf[uart_rx_w % UART_RXBUF_SIZE] = c;
+            __atomic_store_n(&uart_rx_w, uart_rx_w + 1, __ATOMIC_RELEASE);
+        }
+    }
+    tasklet_schedule(&uart_tasklet);
+}
+
+/*
+ * UART tasklet, print the received characters to the console and 
+ * write all of user write buffer data to controller write buffer reg 
+ */
+static void uart_tasklet_fn(uint64_t data)
+{
+    uint64_t w = __atomic_load_n(&uart_rx_w, __ATOMIC_ACQUIRE);
+    while (uart_rx_r != w) {
+        consoleintr(uart_rx_buf[uart_rx_r % UART_RXBUF_SIZE]);
+        __atomic_store_n(&uart_rx_r, uart_rx_r + 1, __ATOMIC_RELEASE);
     }
 
     // send buffered characters.
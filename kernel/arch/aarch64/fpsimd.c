@@ -0,0 +1,112 @@
+/**
+ * @file fpsimd.c
+ * @author ylp
+ * @brief Lazy FP/SIMD register switching, refer to the Linux kernel source code arch/arm64/kernel/fpsimd.c (5.10.0)
+ * @version 0.1
+ * @date 2022-06-08
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "include/fpsimd.h"
+#include "arm.h"
+#include "proc/proc.h"
+#include "lib/string.h"
+
+/*
+ * The V registers of a CPU belong to the process c->fpsimd_last, as long as that process has fpsimd_cpu
+ * still set to the CPU; it stops being true once the process loads its registers on another CPU.
+ * A process gets access without trapping only while its registers are loaded in the CPU it runs on,
+ * so the registers of a process that never uses FP/SIMD are never saved nor loaded.
+ */
+
+/*
+ * Whether the process on this CPU may use FP/SIMD without trapping, i.e. its registers are loaded
+ */
+static inline bool fpsimd_user_enabled(void)
+{
+    return (r_cpacr_el1() & CPACR_FPEN_MASK) == CPACR_FPEN_NO_TRAP;
+}
+
+static inline void fpsimd_set_user_access(bool enable)
+{
+    uint64_t cpacr = r_cpacr_el1() & ~CPACR_FPEN_MASK;
+    l_cpacr_el1(cpacr | (enable ? CPACR_FPEN_NO_TRAP : CPACR_FPEN_TRAP_EL0));
+}
+
+/*
+ * Make FP/SIMD instructions trap at EL0 on this CPU
+ */
+void fpsimd_init(void)
+{
+    fpsimd_set_user_access(false);
+    mycpu()->fpsimd_last = NULL;
+}
+
+/*
+ * First FP/SIMD instruction of the current process since it got the CPU, the instruction is executed
+ * again once we return to user space
+ */
+void fpsimd_trap(struct proc *p)
+{
+    push_off();
+    struct cpu *c = mycpu();
+    if (c->fpsimd_last != p || p->fpsimd_cpu != c->cpuid) {
+        fpsimd_load_state(&p->fpsimd);
+        c->fpsimd_last = p;
+        p->fpsimd_cpu = c->cpuid;
+    }
+    p->fpsimd_used = true;
+    fpsimd_set_user_access(true);
+    pop_off();
+}
+
+/*
+ * Let p use FP/SIMD right away if this CPU still holds its registers, otherwise its first use traps
+ */
+void fpsimd_switch_in(struct cpu *c, struct proc *p)
+{
+    fpsimd_set_user_access(p->fpsimd_used && c->fpsimd_last == p && p->fpsimd_cpu == c->cpuid);
+}
+
+/*
+ * Save the registers of p if they are loaded, they stay loaded too in case p comes back to this CPU
+ */
+void fpsimd_switch_out(struct cpu *c, struct proc *p)
+{
+    if (fpsimd_user_enabled()) {
+        fpsimd_save_state(&p->fpsimd);
+        fpsimd_set_user_access(false);
+    }
+}
+
+/*
+ * Copy the FP/SIMD state of the current process src to the new process dst
+ */
+void fpsimd_copy(struct proc *dst, struct proc *src)
+{
+    push_off();
+    // The registers of the current process are only up to date in memory if it is not using them
+    if (fpsimd_user_enabled())
+        fpsimd_save_state(&src->fpsimd);
+    pop_off();
+    dst->fpsimd = src->fpsimd;
+    dst->fpsimd_used = src->fpsimd_used;
+    dst->fpsimd_cpu = -1;
+}
+
+/*
+ * Reset the FP/SIMD state of p, for a new process or after exec
+ */
+void fpsimd_reset(struct proc *p)
+{
+    push_off();
+    memset(&p->fpsimd, 0, sizeof(p->fpsimd));
+    p->fpsimd_used = false;
+    p->fpsimd_cpu = -1;
+    // The registers loaded for the old image must not be handed to the new one
+    if (p == myproc())
+        fpsimd_set_user_access(false);
+    pop_off();
+}
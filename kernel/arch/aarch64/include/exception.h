@@ -32,6 +32,7 @@
  */
 #define EC_Unknown                  0x0         // Unknown reason.
 #define EC_WF_INSTRUCTION           0x1         // Trapped WF* instruction execution.
+#define EC_FP_ASIMD                 0x7         // Access to SIMD or floating-point functionality trapped by CPACR_EL1.FPEN.
 #define EC_ILLEGAL_EXECUTION_STATE  0xE         // Illegal Execution state.
 #define EC_SVC64                    0x15        // SVC instruction execution in AArch64 state.
 
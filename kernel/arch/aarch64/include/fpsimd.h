@@ -0,0 +1,100 @@
+/**
+ * @file fpsimd.h
+ * @author ylp
+ * @brief Lazy FP/SIMD register switching, refer to the Linux kernel source code arch/arm64/kernel/fpsimd.c (5.10.0)
+ * @version 0.1
+ * @date 2022-06-08
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef FPSIMD_H
+#define FPSIMD_H
+
+#include "../../../include/stdint.h"
+#include <stdbool.h>
+
+/*
+ * CPACR_EL1.FPEN [21:20], whether FP/SIMD instructions trap (EC 0x07)
+ * The kernel is built with -mgeneral-regs-only and never touches the V registers itself,
+ * so EL1 always has access, which fpsimd.S needs to save and load them.
+ */
+#define CPACR_FPEN_MASK     (3UL << 20)
+#define CPACR_FPEN_TRAP_EL0 (1UL << 20)     // EL0 accesses trap, EL1 accesses do not
+#define CPACR_FPEN_NO_TRAP  (3UL << 20)     // No accesses trap
+
+/*
+ * FP/SIMD registers of a process, saved only for processes that have used them
+ * The layout is known to fpsimd.S.
+ */
+struct fpsimd_state {
+    __uint128_t vregs[32];      // Q0-Q31
+    uint32_t fpsr;              // Floating-point Status Register
+    uint32_t fpcr;              // Floating-point Control Register
+} __attribute__((aligned(16)));
+
+struct proc;
+struct cpu;
+
+/**
+ * @brief  Save the FP/SIMD registers of this CPU (fpsimd.S)
+ * @param  *state: Where to save them
+ * @retval None
+ */
+void fpsimd_save_state(struct fpsimd_state *state);
+
+/**
+ * @brief  Load the FP/SIMD registers of this CPU (fpsimd.S)
+ * @param  *state: Registers to load
+ * @retval None
+ */
+void fpsimd_load_state(struct fpsimd_state *state);
+
+/**
+ * @brief  Make FP/SIMD instructions trap at EL0 on this CPU, Called by every CPU at boot
+ * @retval None
+ */
+void fpsimd_init(void);
+
+/**
+ * @brief  Handle the first FP/SIMD instruction of the current process since it got the CPU,
+ * load its registers unless this CPU still holds them and let it use them without trapping
+ * @param  *p: The current process
+ * @retval None
+ */
+void fpsimd_trap(struct proc *p);
+
+/**
+ * @brief  Called by the scheduler before switching to p, lets p use FP/SIMD without trapping
+ * if its registers are still loaded in this CPU
+ * @param  *c: This CPU
+ * @param  *p: The process about to run
+ * @retval None
+ */
+void fpsimd_switch_in(struct cpu *c, struct proc *p);
+
+/**
+ * @brief  Called by the scheduler once p gave the CPU back, saves its registers if it used them
+ * @param  *c: This CPU
+ * @param  *p: The process that ran
+ * @retval None
+ */
+void fpsimd_switch_out(struct cpu *c, struct proc *p);
+
+/**
+ * @brief  Give a new process or thread a copy of the FP/SIMD state of the current process
+ * @param  *dst: The new process, not running yet
+ * @param  *src: The current process
+ * @retval None
+ */
+void fpsimd_copy(struct proc *dst, struct proc *src);
+
+/**
+ * @brief  Reset the FP/SIMD state of a process to zero and mark it unused, for a new process or after exec
+ * @param  *p: The current process, or a process that is not running
+ * @retval None
+ */
+void fpsimd_reset(struct proc *p);
+
+#endif /* FPSIMD_H */
@@ -23,6 +23,10 @@ struct trapframe {
 };
 
 #define FRAME_SIZE sizeof(struct trapframe)
+
+// M[3:0] of the saved pstate (SPSR_EL1) is the exception level and stack the trap came from
+#define PSTATE_MODE_MASK    0xF
+#define PSTATE_MODE_EL0t    0x0
 #else
 #define FRAME_SIZE (34 * 8)
 #endif
@@ -16,6 +16,7 @@
 #include "board/raspi3/irq.h"
 #include "board/raspi3/local_peripherals.h"
 #include "../../sync/spinlock.h"
+#include "interrupt/softirq.h"
 
 #define CNTP_CTL_EL0_ENABLE     1
 #define CNTP_CTL_EL0_IMASK      (1 << 1)
@@ -26,12 +27,22 @@ struct spinlock tickslock;
 uint64_t ticks;
 
 /*
- * Timer interrupt handler
+ * Timer interrupt handler, hard interrupt half
+ * Only counts the tick, the wakeup of the sleepers walks every process and is left to the timer softirq.
  */
 void clock_intr()
+{
+    __atomic_add_fetch(&ticks, 1, __ATOMIC_RELAXED);
+    raise_softirq(TIMER_SOFTIRQ);
+}
+
+/*
+ * Timer softirq, wake up the processes sleeping on ticks
+ * A sleeper checks ticks and goes to sleep under tickslock, so it either sees the new value or gets woken up here.
+ */
+static void timer_softirq(void)
 {
     acquire_spin_lock(&tickslock);
-    ticks++;
     wakeup(&ticks);
     release_spin_lock(&tickslock);
 }
@@ -55,6 +66,7 @@ void timer_init()
 {
     init_spin_lock(&tickslock, "tickslock");
     ticks = 0;
+    open_softirq(TIMER_SOFTIRQ, timer_softirq);
 
     uint64_t timer_frq = r_cntfrq_el0();
     cprintf("[cpu %d] timer frequency: %lu\n", cpuid(), timer_frq);
@@ -19,6 +19,8 @@
 #include "printf.h"
 #include "proc/proc.h"
 #include "board/raspi3/uart.h"
+#include "interrupt/softirq.h"
+#include "drivers/mmc/sd.h"
 
 extern int64_t syscall(struct trapframe *frame);
 extern void uartintr(void);
@@ -82,6 +84,7 @@ void el0_sync_trap(struct trapframe *frame, uint64_t esr)
     uint64_t iss = (esr & ISS_MASK);
     if (exception_class_id == EC_SVC64 && iss == 0) {
         struct proc *p = myproc();
+        account_enter_kernel();
         if (p->killed) {
             exit(-1);
         }
@@ -92,6 +95,12 @@ void el0_sync_trap(struct trapframe *frame, uint64_t esr)
         if (p->killed) {
             exit(-1);
         }
+        account_return_user();
+    } else if (exception_class_id == EC_FP_ASIMD) {
+        // First FP/SIMD use since the process got the CPU, load its registers and retry the instruction
+        account_enter_kernel();
+        fpsimd_trap(myproc());
+        account_return_user();
     } else {
         panic("el0_sync_trap: exception class id: 0x%x, iss: %d", exception_class_id, iss);
     }
@@ -110,20 +119,49 @@ uint32_t read_irq_src()
  */
 void handle_arch_irq(struct trapframe *frame_ptr)
 {
+    bool from_user = (frame_ptr->pstate & PSTATE_MODE_MASK) == PSTATE_MODE_EL0t;
+    if (from_user) {
+        account_enter_kernel();
+    }
     uint32_t irq_src = read_irq_src();
     // If the current core has a time interrupt
     if (irq_src & IRQ_CNTPNSIRQ) {
-        if (cpuid() == 0) {
+        irq_account(IRQ_NR_TIMER);
+        // Every core has its own timer, the one the timer interrupt is steered to keeps the time
+        if (cpuid() == irq_get_affinity(IRQ_NR_TIMER)) {
             clock_intr();
         }
         timer_reset();
-        yield();
+        // The time slice is over, preempt the process once the interrupt is handled
+        mycpu()->need_resched = true;
     } else {
         uint32_t irq_pending_1 = get32(IRQ_PENDING_1);
-        //uint32_t irq_pending_2 = get32(IRQ_PENDING_2);  // unused
+        uint32_t irq_pending_2 = get32(IRQ_PENDING_2);
         if (irq_pending_1 & AUX_INT) {
+            irq_account(IRQ_NR_UART);
             uartintr();
         }
+        // Enabled by sd_init() once the MBR is read
+        if (irq_pending_2 & EMMC_INT) {
+            irq_account(IRQ_NR_EMMC);
+            sd_intr();
+        }
+    }
+
+    // The hard handlers above only acknowledged the devices, do the rest with interrupts enabled
+    irq_exit();
+    // Softirq processing that we interrupted can not be preempted, the outer interrupt yields once it is done
+    if (mycpu()->need_resched && !in_softirq()) {
+        yield();
+    }
+
+    // A thread spinning in user space never makes a system call, check for kill() on the way back to EL0
+    struct proc *p = myproc();
+    if (p != NULL && p->killed && from_user) {
+        exit(-1);
+    }
+    if (from_user) {
+        account_return_user();
     }
 }
 
@@ -0,0 +1,244 @@
+/**
+ * @file blk.c
+ * @author ylp
+ * @brief Block I/O request queue, submitters sleep while the driver transfers their buffers in the order the I/O scheduler picks
+ * @version 0.1
+ * @date 2022-06-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "blk.h"
+#include "proc/proc.h"
+#include "arch/aarch64/arm.h"
+#include "lib/string.h"
+#include "printf.h"
+
+static const struct elevator *elevators[] = {
+    &elevator_noop,
+    &elevator_deadline,
+};
+
+/*
+ * Initialize a request queue
+ */
+void blk_init_queue(struct request_queue *q, const char *name, blk_start_fn start)
+{
+    init_spin_lock(&q->lock, name);
+    q->elv = &elevator_deadline;
+    q->elv->init(q);
+    q->active = NULL;
+    q->depth = 0;
+    q->start = start;
+    q->read = q->write = (struct blk_latency){0, 0, 0, 0, 0};
+    q->max_depth = 0;
+    q->depth_total = 0;
+    q->name = name;
+}
+
+/*
+ * Switch the I/O scheduler of a queue, the requests the old one holds are handed to the new one in its order
+ */
+int blk_set_elevator(struct request_queue *q, const char *name)
+{
+    const struct elevator *e = NULL;
+    for (int i = 0; i < sizeof(elevators) / sizeof(elevators[0]); i++) {
+        if (strncmp(elevators[i]->name, name, 16) == 0)
+            e = elevators[i];
+    }
+    if (e == NULL)
+        return -1;
+    struct list_head moving;
+    struct blk_request *r;
+    INIT_LIST_HEAD(&moving);
+    acquire_spin_lock(&q->lock);
+    // The merged chains stay as they are, only their heads move
+    while ((r = q->elv->dispatch(q)) != NULL) {
+        list_add_tail(&r->queue, &moving);
+    }
+    q->elv = e;
+    e->init(q);
+    while (!list_is_empty(&moving)) {
+        r = list_first_entry(&moving, struct blk_request, queue);
+        list_del(&r->queue);
+        e->add(q, r);
+    }
+    release_spin_lock(&q->lock);
+    return 0;
+}
+
+/*
+ * Hand the request the scheduler picks to the driver, The queue lock must be held
+ */
+static void blk_start_next(struct request_queue *q)
+{
+    struct blk_request *r = q->elv->dispatch(q);
+    q->active = r;
+    if (r != NULL)
+        q->start(q, r);
+}
+
+/*
+ * Whether b can be transferred by the same command as the run r ends with
+ */
+static bool blk_mergeable(struct blk_request *r, struct buf *b)
+{
+    struct buf *last = r->bufs[r->nbuf - 1];
+    return r->nbuf < BLK_MAX_BLOCKS && b->dev == last->dev && b->blockno == last->blockno + 1
+        && ((b->flags & BUF_DIRTY) != 0) == r->write;
+}
+
+/*
+ * Whether the blocks of b follow those of a, so that one command can move both.
+ * Their block numbers are sectors of the disk by now, requests of different partitions may be merged too
+ */
+static bool blk_rq_follows(struct blk_request *a, struct blk_request *b)
+{
+    return a->write == b->write && a->blockno + a->nr_blocks == b->blockno
+        && a->nr_blocks + b->nr_blocks <= BLK_MAX_BLOCKS;
+}
+
+/*
+ * Merge r behind rq if its blocks follow those of rq
+ */
+bool blk_back_merge(struct blk_request *rq, struct blk_request *r)
+{
+    if (!blk_rq_follows(rq, r))
+        return false;
+    struct blk_request *last = rq;
+    while (last->merged != NULL) {
+        last = last->merged;
+    }
+    last->merged = r;
+    rq->nr_blocks += r->nr_blocks;
+    return true;
+}
+
+/*
+ * Merge rq behind r if the blocks of rq follow those of r, the caller puts r in the place of rq.
+ * r was never added, so it takes over the deadline of rq
+ */
+bool blk_front_merge(struct blk_request *rq, struct blk_request *r)
+{
+    if (!blk_rq_follows(r, rq))
+        return false;
+    r->merged = rq;
+    r->nr_blocks += rq->nr_blocks;
+    r->deadline = rq->deadline;
+    return true;
+}
+
+/*
+ * Transfer n locked buffers, a run of consecutive blocks in one direction is one request.
+ * Up to BLK_MAX_SEGS requests are queued at once, the submitter sleeps on each until the driver is done with it
+ */
+int blk_submit_list(struct request_queue *q, struct buf **bufs, int n, uint32_t start)
+{
+    struct blk_request reqs[BLK_MAX_SEGS];
+    int error = 0;
+    int i = 0;
+    while (i < n) {
+        int nreq = 0;
+        while (i < n && nreq < BLK_MAX_SEGS) {
+            struct blk_request *r = &reqs[nreq++];
+            r->bufs = &bufs[i];
+            r->nbuf = 1;
+            r->write = (bufs[i]->flags & BUF_DIRTY) != 0;
+            for (i++; i < n && blk_mergeable(r, bufs[i]); i++) {
+                r->nbuf++;
+            }
+        }
+
+        acquire_spin_lock(&q->lock);
+        uint64_t now = timestamp();
+        for (int j = 0; j < nreq; j++) {
+            struct blk_request *r = &reqs[j];
+            r->merged = NULL;
+            r->blockno = r->bufs[0]->blockno + start;
+            r->nr_blocks = r->nbuf;
+            r->xfer = 0;
+            r->done = false;
+            r->error = 0;
+            r->submit = now;
+            r->deadline = 0;    // Set by the scheduler in add(), or taken over in a front merge
+            if (!q->elv->merge(q, r))
+                q->elv->add(q, r);
+            q->depth++;
+            q->depth_total += q->depth;
+        }
+        if (q->depth > q->max_depth)
+            q->max_depth = q->depth;
+        if (q->active == NULL)
+            blk_start_next(q);
+        for (int j = 0; j < nreq; j++) {
+            while (!reqs[j].done) {
+                sleep(&reqs[j], &q->lock);
+            }
+            if (reqs[j].error && !error)
+                error = reqs[j].error;
+        }
+        release_spin_lock(&q->lock);
+    }
+    return error;
+}
+
+/*
+ * Queue the transfer of the locked buffer b and sleep until the driver is done
+ */
+int blk_submit(struct request_queue *q, struct buf *b, uint32_t start)
+{
+    return blk_submit_list(q, &b, 1, start);
+}
+
+/*
+ * Complete the active request and those merged behind it, wake up their submitters and start the next one
+ */
+void blk_end_request(struct request_queue *q, int error)
+{
+    struct blk_request *r = q->active;
+    if (r == NULL)
+        panic("blk_end_request: %s has no active request.\n", q->name);
+    uint64_t now = timestamp();
+    (r->write ? &q->write : &q->read)->commands++;
+    while (r != NULL) {
+        // Its submitter may return and reuse it once it is done
+        struct blk_request *next = r->merged;
+        uint64_t latency = now - r->submit;
+        struct blk_latency *lat = r->write ? &q->write : &q->read;
+        lat->count++;
+        lat->blocks += r->nbuf;
+        lat->total += latency;
+        if (latency > lat->max)
+            lat->max = latency;
+        q->depth--;
+        r->error = error;
+        r->done = true;
+        wakeup(r);
+        r = next;
+    }
+    blk_start_next(q);
+}
+
+/*
+ * Fill in the statistics of a queue, latencies in microseconds
+ */
+void blk_stat(struct request_queue *q, struct blkstat *st)
+{
+    uint64_t freq = r_cntfrq_el0();
+    acquire_spin_lock(&q->lock);
+    safestrcpy(st->sched, q->elv->name, sizeof(st->sched));
+    st->reads = q->read.count;
+    st->writes = q->write.count;
+    st->read_cmds = q->read.commands;
+    st->write_cmds = q->write.commands;
+    st->read_blocks = q->read.blocks;
+    st->write_blocks = q->write.blocks;
+    st->read_us = q->read.total * 1000000 / freq;
+    st->write_us = q->write.total * 1000000 / freq;
+    st->max_read_us = q->read.max * 1000000 / freq;
+    st->max_write_us = q->write.max * 1000000 / freq;
+    st->max_depth = q->max_depth;
+    st->depth_total = q->depth_total;
+    release_spin_lock(&q->lock);
+}
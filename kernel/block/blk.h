@@ -0,0 +1,187 @@
+/**
+ * @file blk.h
+ * @author ylp
+ * @brief Block I/O request queue, submitters sleep while the driver transfers their buffers in the order the I/O scheduler picks
+ * @version 0.1
+ * @date 2022-06-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef BLK_H
+#define BLK_H
+
+#include "include/stdint.h"
+#include "include/list.h"
+#include "sync/spinlock.h"
+#include "buffer/buf.h"
+#include "elevator.h"
+
+#define BLK_MAX_BLOCKS  64  // The most blocks one request, that is one command, transfers
+#define BLK_MAX_SEGS    8   // Requests one blk_submit_list() call queues before it waits for them
+
+/*
+ * Transfer of the buffers of consecutive blocks in one command, the buffers themselves may be anywhere in memory
+ * BUF_DIRTY set on them means write, otherwise read. Requests of other submitters that continue its blocks
+ * may be merged behind it, the driver then moves all of them with the one command.
+ */
+struct blk_request {
+    struct list_head queue;     // Entry in the FIFO of the scheduler, protected by the queue lock
+    struct list_head sort;      // Entry in the block ordered list of the scheduler, if it keeps one
+    struct buf **bufs;          // Locked buffers, bufs[i] holds block bufs[0]->blockno + i
+    uint32_t nbuf;
+    struct blk_request *merged; // Next request merged behind this one, its blocks follow
+    uint32_t blockno;           // First sector on the disk of this request and those merged behind it
+    uint32_t nr_blocks;         // Blocks of this request and those merged behind it
+    uint32_t xfer;              // Blocks the driver is done with, it may use this as it likes
+    bool write;
+    bool done;                  // Set by blk_end_request()
+    int error;                  // What the driver reported, 0 on success
+    uint64_t submit;            // timestamp() when it was queued
+    uint64_t deadline;          // timestamp() by which the scheduler wants it started
+};
+
+/*
+ * Driver hook, starts request r. Called with the queue lock held,
+ * the driver calls blk_end_request() once the transfer is done, usually from its interrupt handler.
+ */
+typedef void (*blk_start_fn)(struct request_queue *q, struct blk_request *r);
+
+/*
+ * Submit to complete latency statistics of a queue, in counter ticks
+ */
+struct blk_latency {
+    uint64_t count;             // Requests submitted
+    uint64_t commands;          // Commands they took, fewer when requests were merged
+    uint64_t blocks;
+    uint64_t total;
+    uint64_t max;
+};
+
+/*
+ * Requests of one device
+ */
+struct request_queue {
+    struct spinlock lock;
+    const struct elevator *elv; // Keeps the requests not started yet
+    union {
+        struct noop_data noop;
+        struct deadline_data deadline;
+    } elv_data;
+    struct blk_request *active; // The request the device is transferring
+    uint32_t depth;             // Requests queued or active
+    blk_start_fn start;
+    struct blk_latency read;
+    struct blk_latency write;
+    uint32_t max_depth;         // Largest depth seen
+    uint64_t depth_total;       // Sum of the depth every request found, over read.count + write.count
+    const char *name;
+};
+
+/*
+ * Block I/O statistics reported to user space by blkstat, latencies in microseconds
+ */
+struct blkstat {
+    char sched[16];         // Name of the I/O scheduler
+    uint64_t reads;         // Requests submitted
+    uint64_t writes;
+    uint64_t read_cmds;     // Commands they took, the rest were merged
+    uint64_t write_cmds;
+    uint64_t read_blocks;   // Blocks the requests transferred
+    uint64_t write_blocks;
+    uint64_t read_us;       // Total submit to complete latency of the reads
+    uint64_t write_us;
+    uint64_t max_read_us;
+    uint64_t max_write_us;
+    uint64_t max_depth;     // Most requests queued or active at once
+    uint64_t depth_total;   // Requests queued or active that each request found, summed
+};
+
+/**
+ * @brief  Block i of a request, counting on through the requests merged behind it
+ * @param  *r: The request
+ * @param  i: Below r->nr_blocks
+ * @retval The buffer
+ */
+static inline struct buf *blk_rq_buf(struct blk_request *r, uint32_t i)
+{
+    while (i >= r->nbuf) {
+        i -= r->nbuf;
+        r = r->merged;
+    }
+    return r->bufs[i];
+}
+
+/**
+ * @brief  Initialize a request queue, with the deadline scheduler
+ * @param  *q: The queue
+ * @param  *name: Name of the queue and its lock
+ * @param  start: Driver hook that starts a transfer
+ * @retval None
+ */
+void blk_init_queue(struct request_queue *q, const char *name, blk_start_fn start);
+
+/**
+ * @brief  Switch the I/O scheduler of a queue, the requests it holds move over
+ * @param  *q: The queue
+ * @param  *name: "noop" or "deadline"
+ * @retval 0 on success, -1 if there is no such scheduler
+ */
+int blk_set_elevator(struct request_queue *q, const char *name);
+
+/**
+ * @brief  Queue the transfer of the locked buffer b and sleep until it is done, Process context only
+ * @param  *q: The queue of the device
+ * @param  *b: The buffer
+ * @param  start: Sector of the disk its block number counts from, the start of its partition
+ * @retval 0 on success, the error the driver reported otherwise
+ */
+int blk_submit(struct request_queue *q, struct buf *b, uint32_t start);
+
+/**
+ * @brief  Transfer n locked buffers and sleep until all of them are done, Process context only.
+ * Runs of buffers of consecutive blocks in the same direction go out as one request each
+ * @param  *q: The queue of the device
+ * @param  **bufs: The buffers, sorted by block number for the runs to be found
+ * @param  n: How many
+ * @param  start: Sector of the disk their block numbers count from, the start of their partition
+ * @retval 0 on success, the first error the driver reported otherwise
+ */
+int blk_submit_list(struct request_queue *q, struct buf **bufs, int n, uint32_t start);
+
+/**
+ * @brief  Merge r behind rq if its blocks follow those of rq, for the schedulers
+ * @param  *rq: A queued request
+ * @param  *r: The new request
+ * @retval Whether r was merged
+ */
+bool blk_back_merge(struct blk_request *rq, struct blk_request *r);
+
+/**
+ * @brief  Merge rq behind r if the blocks of rq follow those of r, for the schedulers.
+ * The caller puts r in the place of rq
+ * @param  *rq: A queued request
+ * @param  *r: The new request
+ * @retval Whether rq was merged
+ */
+bool blk_front_merge(struct blk_request *rq, struct blk_request *r);
+
+/**
+ * @brief  Complete the active request and those merged behind it, wake up their submitters and start the next one.
+ * Called by the driver with the queue lock held
+ * @param  *q: The queue
+ * @param  error: 0 on success
+ * @retval None
+ */
+void blk_end_request(struct request_queue *q, int error);
+
+/**
+ * @brief  Fill in the statistics of a queue
+ * @param  *q: The queue
+ * @param  *st: Where to put them
+ * @retval None
+ */
+void blk_stat(struct request_queue *q, struct blkstat *st);
+
+#endif /* BLK_H */
@@ -0,0 +1,296 @@
+/**
+ * @file blkbench.c
+ * @author ylp
+ * @brief Block device benchmark, worker threads keep requests of a chosen size and pattern in flight and time each one.
+ * With verify each request writes a pattern and reads it back, which checks the data path of a driver under load
+ * @version 0.1
+ * @date 2022-06-28
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "blkbench.h"
+#include "blk.h"
+#include "include/param.h"
+#include "proc/proc.h"
+#include "proc/kthread.h"
+#include "memory/kalloc.h"
+#include "arch/aarch64/arm.h"
+#include "lib/string.h"
+#include "printf.h"
+
+#define BLKBENCH_MAX_MS 60000
+
+extern uint64_t ticks;
+extern struct spinlock tickslock;
+
+struct blkbench;
+
+/*
+ * One request in flight, the worker thread waits for it before it submits the next
+ */
+struct blkbench_worker {
+    struct blkbench *bench;
+    uint32_t id;                // Index in bench->worker
+    struct proc *thread;
+    struct buf *bufs;           // args.blocks buffers of its own, outside the buffer cache
+    uint64_t seed;              // Of the xorshift generator
+    uint64_t last;              // timestamp() when its last counted request completed
+    struct blkbench_result res; // Its part of the results, elapsed_us is left alone
+};
+
+/*
+ * A run, lives as long as blkbench() does
+ */
+struct blkbench {
+    struct blkbench_args args;
+    struct block_device *bd;
+    uint32_t slots;             // Request sized pieces of the span
+    uint32_t cursor;            // Next piece of the sequential pattern
+    uint64_t start;             // timestamp() when the workers were let go
+    uint64_t end;               // Requests submitted from now on are not counted
+    uint64_t freq;
+    struct blkbench_worker worker[BLKBENCH_MAX_DEPTH];
+};
+
+static uint64_t xorshift(uint64_t *s)
+{
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+/*
+ * Count a request of lat counter ticks in res
+ */
+static void blkbench_account(struct blkbench_result *res, uint64_t lat, uint64_t freq)
+{
+    uint64_t us = lat * 1000000 / freq;
+    res->lat_total_us += us;
+    if (us < res->lat_min_us)
+        res->lat_min_us = us;
+    if (us > res->lat_max_us)
+        res->lat_max_us = us;
+    int bucket = us ? 64 - __builtin_clzl(us) : 0;
+    res->hist[bucket < BLKBENCH_HIST ? bucket : BLKBENCH_HIST - 1]++;
+}
+
+/*
+ * Submit one request of the n blocks in bp, it counts if it was submitted before the end of the run
+ */
+static void blkbench_submit(struct blkbench_worker *w, struct buf **bp, uint32_t n, bool write)
+{
+    struct blkbench *b = w->bench;
+    for (uint32_t i = 0; i < n; i++) {
+        bp[i]->flags = write ? BUF_DIRTY : 0;
+    }
+    uint64_t t = timestamp();
+    blkdev_submit(bp, n);
+    if (t >= b->end)
+        return;     // Keeps the device as busy as during the run until the other workers are stopped too
+    w->last = timestamp();
+    blkbench_account(&w->res, w->last - t, b->freq);
+    if (write)
+        w->res.writes++;
+    else
+        w->res.reads++;
+    w->res.blocks += n;
+}
+
+/*
+ * Fill the block in bp with what a write stamped stamp puts there if fill is set,
+ * otherwise check that it holds that. Returns false if it does not
+ */
+static bool blkbench_pattern(struct buf *bp, uint64_t stamp, bool fill)
+{
+    uint64_t *word = (uint64_t *)bp->data;
+    uint64_t v = stamp ^ ((uint64_t)bp->blockno << 32);
+    for (int k = 0; k < BSIZE / 8; k++) {
+        if (fill)
+            word[k] = v + k;
+        else if (word[k] != v + k)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Worker thread, submits one request after the other until it is stopped, those submitted before the end count.
+ * With verify every request is a write of a fresh pattern and a read that checks it
+ */
+static int blkbench_thread(void *arg)
+{
+    struct blkbench_worker *w = arg;
+    struct blkbench *b = w->bench;
+    uint32_t n = b->args.blocks;
+    struct buf *bp[BLK_MAX_BLOCKS];
+    for (uint32_t i = 0; i < n; i++) {
+        bp[i] = &w->bufs[i];
+    }
+
+    while (!kthread_should_stop()) {
+        uint32_t slot;
+        if (b->args.pattern == BLKBENCH_SEQ)
+            slot = __atomic_fetch_add(&b->cursor, 1, __ATOMIC_RELAXED) % b->slots;
+        else
+            slot = xorshift(&w->seed) % b->slots;
+        if (b->args.verify) {
+            // Every worker keeps to slots of its own, so what it reads back can only be what it wrote
+            slot = slot - slot % b->args.depth + w->id;
+            if (slot >= b->slots)
+                slot = w->id;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            bp[i]->dev = b->bd->dev;
+            bp[i]->blockno = slot * n + i;
+        }
+        if (!b->args.verify) {
+            blkbench_submit(w, bp, n, xorshift(&w->seed) % 100 >= b->args.read_pct);
+            continue;
+        }
+
+        uint64_t stamp = xorshift(&w->seed);
+        for (uint32_t i = 0; i < n; i++) {
+            blkbench_pattern(bp[i], stamp, true);
+        }
+        blkbench_submit(w, bp, n, true);
+        for (uint32_t i = 0; i < n; i++) {
+            memset(bp[i]->data, 0, BSIZE);
+        }
+        blkbench_submit(w, bp, n, false);
+        for (uint32_t i = 0; i < n; i++) {
+            if (!blkbench_pattern(bp[i], stamp, false) && w->res.mismatches++ == 0)
+                cprintf("blkbench: block %d of %s read back wrong.\n", bp[i]->blockno, b->bd->name);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Whether bd shares sectors with the device holding the root file system
+ */
+static bool blkbench_overlaps_root(struct block_device *bd)
+{
+    struct block_device *root = blkdev_get(rootdev);
+    if (root == NULL || root->disk != bd->disk)
+        return false;
+    uint64_t end = bd->nr_sectors ? (uint64_t)bd->start + bd->nr_sectors : ~0UL;
+    uint64_t root_end = root->nr_sectors ? (uint64_t)root->start + root->nr_sectors : ~0UL;
+    return bd->start < root_end && root->start < end;
+}
+
+/*
+ * Check args and fill in what the run needs to know besides them
+ */
+static int blkbench_setup(struct blkbench *b, const struct blkbench_args *args)
+{
+    b->args = *args;
+    b->args.dev[BLKDEV_NAME - 1] = '\0';
+    if ((b->bd = blkdev_lookup(b->args.dev)) == NULL)
+        return -1;
+    if (args->pattern != BLKBENCH_SEQ && args->pattern != BLKBENCH_RAND)
+        return -1;
+    if (args->blocks == 0 || args->blocks > BLK_MAX_BLOCKS)
+        return -1;
+    if (args->depth == 0 || args->depth > BLKBENCH_MAX_DEPTH)
+        return -1;
+    if (args->read_pct > 100 || args->ms == 0 || args->ms > BLKBENCH_MAX_MS)
+        return -1;
+    if ((args->read_pct < 100 || args->verify) && blkbench_overlaps_root(b->bd)) {
+        cprintf("blkbench: %s holds the root file system, no writes to it.\n", b->bd->name);
+        return -1;
+    }
+    uint32_t span = args->span ? args->span : b->bd->nr_sectors;
+    if (span == 0 || (b->bd->nr_sectors && span > b->bd->nr_sectors))
+        return -1;
+    if ((b->slots = span / args->blocks) == 0 || (args->verify && b->slots < args->depth))
+        return -1;
+    if (args->xfer > BLKBENCH_XFER_DMA || (args->xfer != BLKBENCH_XFER_DEFAULT && b->bd->ops->set_dma == NULL))
+        return -1;
+    b->cursor = 0;
+    b->freq = r_cntfrq_el0();
+    return 0;
+}
+
+/*
+ * Run the benchmark args describes and merge the results of the workers into res
+ */
+int blkbench(const struct blkbench_args *args, struct blkbench_result *res)
+{
+    struct blkbench *b = kalloc(sizeof(*b));
+    if (b == NULL)
+        return -1;
+    memset(b, 0, sizeof(*b));
+    int error = blkbench_setup(b, args);
+    int old_dma = -1;
+    if (!error && b->args.xfer != BLKBENCH_XFER_DEFAULT) {
+        old_dma = b->bd->ops->set_dma(b->bd->disk, b->args.xfer == BLKBENCH_XFER_DMA);
+        if (old_dma < 0)
+            error = -1;
+    }
+    uint32_t started = 0;
+    for (; !error && started < b->args.depth; started++) {
+        struct blkbench_worker *w = &b->worker[started];
+        w->bench = b;
+        w->id = started;
+        w->seed = timestamp() * 2654435761UL + started + 1;
+        w->res.lat_min_us = ~0UL;
+        if ((w->bufs = kalloc(sizeof(struct buf) * b->args.blocks)) == NULL)
+            break;
+        memset(w->bufs, 0, sizeof(struct buf) * b->args.blocks);
+        if ((w->thread = kthread_create(blkbench_thread, w, "blkbench")) == NULL) {
+            kfree(w->bufs);
+            break;
+        }
+    }
+    if (!error && started < b->args.depth)
+        error = -1;
+
+    if (!error) {
+        b->start = timestamp();
+        b->end = b->start + b->freq / 1000 * b->args.ms;
+        __sync_synchronize();
+        for (uint32_t i = 0; i < started; i++) {
+            wake_up_process(b->worker[i].thread);
+        }
+        acquire_spin_lock(&tickslock);
+        while (timestamp() < b->end) {
+            sleep(&ticks, &tickslock);
+        }
+        release_spin_lock(&tickslock);
+    }
+
+    memset(res, 0, sizeof(*res));
+    res->lat_min_us = ~0UL;
+    uint64_t last = b->start;
+    for (uint32_t i = 0; i < started; i++) {
+        struct blkbench_worker *w = &b->worker[i];
+        kthread_stop(w->thread);
+        kfree(w->bufs);
+        res->reads += w->res.reads;
+        res->writes += w->res.writes;
+        res->blocks += w->res.blocks;
+        res->mismatches += w->res.mismatches;
+        res->lat_total_us += w->res.lat_total_us;
+        if (w->res.lat_min_us < res->lat_min_us)
+            res->lat_min_us = w->res.lat_min_us;
+        if (w->res.lat_max_us > res->lat_max_us)
+            res->lat_max_us = w->res.lat_max_us;
+        for (int j = 0; j < BLKBENCH_HIST; j++) {
+            res->hist[j] += w->res.hist[j];
+        }
+        if (w->last > last)
+            last = w->last;
+    }
+    if (res->reads + res->writes == 0)
+        res->lat_min_us = 0;
+    if (!error)
+        res->elapsed_us = (last - b->start) * 1000000 / b->freq;
+    if (old_dma >= 0)
+        b->bd->ops->set_dma(b->bd->disk, old_dma);
+    kfree(b);
+    return error;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file blkbench.h
+ * @author ylp
+ * @brief Block device benchmark, worker threads keep requests of a chosen size and pattern in flight and time each one
+ * @version 0.1
+ * @date 2022-06-28
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef BLKBENCH_H
+#define BLKBENCH_H
+
+#include "include/stdint.h"
+#include "blkdev.h"
+
+#define BLKBENCH_MAX_DEPTH  16  // The most worker threads, that is requests in flight
+#define BLKBENCH_HIST       20  // Latency buckets, bucket i counts those of 2^(i-1) to 2^i us, the last all longer
+
+#define BLKBENCH_SEQ        0   // Requests follow each other through the span
+#define BLKBENCH_RAND       1   // Requests start at random multiples of their size in the span
+
+#define BLKBENCH_XFER_DEFAULT   0   // Leave the data transfer of the driver as it is
+#define BLKBENCH_XFER_CPU       1   // The CPU moves the data, e.g. through the FIFO of the SD card
+#define BLKBENCH_XFER_DMA       2   // A DMA channel moves the data
+
+/*
+ * What to run, filled in by the caller
+ */
+struct blkbench_args {
+    char dev[BLKDEV_NAME];      // Name of the block device, e.g. "ram0" or "sd2"
+    uint32_t pattern;           // BLKBENCH_SEQ or BLKBENCH_RAND
+    uint32_t blocks;            // Blocks per request, up to BLK_MAX_BLOCKS
+    uint32_t depth;             // Requests in flight, one worker thread each
+    uint32_t read_pct;          // Percent of the requests that read, the rest write
+    uint32_t span;              // Blocks from the start of the device the requests stay in, 0 for all of it
+    uint32_t ms;                // How long to run
+    uint32_t xfer;              // BLKBENCH_XFER_*, the driver must support set_dma for anything but the default
+    uint32_t verify;            // Write a pattern and read it back with every request instead, read_pct is ignored
+};
+
+/*
+ * What came out, latencies are submit to complete as the worker saw it
+ */
+struct blkbench_result {
+    uint64_t reads;             // Requests completed
+    uint64_t writes;
+    uint64_t blocks;            // Blocks they transferred
+    uint64_t elapsed_us;        // From the start of the first worker to the end of the last
+    uint64_t lat_total_us;
+    uint64_t lat_min_us;
+    uint64_t lat_max_us;
+    uint64_t hist[BLKBENCH_HIST];
+    uint64_t mismatches;        // Blocks that did not read back what was written, with verify
+};
+
+/**
+ * @brief  Run the benchmark args describes on a block device, Process context only.
+ * Writes destroy what the device held, they are refused on devices that share sectors with the root file system
+ * @param  *args: What to run
+ * @param  *res: Where to put the results
+ * @retval 0 on success, -1 if the arguments are bad, the driver can not switch the transfer or the threads or their buffers could not be had
+ */
+int blkbench(const struct blkbench_args *args, struct blkbench_result *res);
+
+#endif /* BLKBENCH_H */
@@ -0,0 +1,157 @@
+/**
+ * @file blkdev.c
+ * @author ylp
+ * @brief Block devices, the disks the drivers register and the partitions found on them, by the number the buffer cache knows them
+ * @version 0.1
+ * @date 2022-06-26
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "blkdev.h"
+#include "include/param.h"
+#include "sync/spinlock.h"
+#include "lib/string.h"
+#include "printf.h"
+
+uint32_t rootdev = BLKDEV_NODEV;
+
+/*
+ * Devices are registered while the kernel boots and never go away,
+ * device dev is blkdevs.dev[dev - 1] so that BLKDEV_NODEV stays free
+ */
+static struct {
+    struct spinlock lock;           // Serializes registration, lookups need no lock
+    struct block_device dev[NBLKDEV];
+    uint32_t count;
+} blkdevs;
+
+/*
+ * Initialize the registry, before any driver registers a disk
+ */
+void blkdev_init(void)
+{
+    init_spin_lock(&blkdevs.lock, "blkdev");
+    blkdevs.count = 0;
+}
+
+/*
+ * Take the next free slot and number, the caller fills in the rest
+ */
+static struct block_device *blkdev_alloc(const char *name)
+{
+    acquire_spin_lock(&blkdevs.lock);
+    if (blkdevs.count == NBLKDEV)
+        panic("blkdev: no room for %s.\n", name);
+    struct block_device *bd = &blkdevs.dev[blkdevs.count];
+    memset(bd, 0, sizeof(*bd));
+    safestrcpy(bd->name, name, BLKDEV_NAME);
+    bd->dev = blkdevs.count + 1;
+    return bd;
+}
+
+/*
+ * Make the device filled in by the caller visible to lookups
+ */
+static void blkdev_publish(struct block_device *bd)
+{
+    if (strncmp(bd->name, ROOTDEV_NAME, BLKDEV_NAME) == 0)
+        rootdev = bd->dev;
+    __sync_synchronize();
+    blkdevs.count++;
+    release_spin_lock(&blkdevs.lock);
+    cprintf("blkdev: %s is device %d, %d sectors from %d\n", bd->name, bd->dev, bd->nr_sectors, bd->start);
+}
+
+/*
+ * Register a disk, the buffer cache only handles sectors of BSIZE
+ */
+struct block_device *blkdev_add_disk(const char *name, uint32_t sector_size, uint32_t nr_sectors,
+                                     const struct block_device_ops *ops, void *private)
+{
+    if (sector_size != BSIZE)
+        panic("blkdev: %s has sectors of %d bytes, only %d are supported.\n", name, sector_size, BSIZE);
+    struct block_device *bd = blkdev_alloc(name);
+    bd->sector_size = sector_size;
+    bd->start = 0;
+    bd->nr_sectors = nr_sectors;
+    bd->disk = bd;
+    bd->ops = ops;
+    bd->private = private;
+    blkdev_publish(bd);
+    return bd;
+}
+
+/*
+ * Register partition partno of disk, named after the disk, e.g. partition 2 of sd is sd2
+ */
+struct block_device *blkdev_add_partition(struct block_device *disk, int partno, uint32_t start, uint32_t nr_sectors)
+{
+    if (disk->nr_sectors && (start >= disk->nr_sectors || nr_sectors > disk->nr_sectors - start))
+        panic("blkdev: partition %d does not fit on %s.\n", partno, disk->name);
+    char name[BLKDEV_NAME];
+    int len = strlen(disk->name);
+    if (len > BLKDEV_NAME - 3)
+        len = BLKDEV_NAME - 3;
+    memmove(name, disk->name, len);
+    if (partno >= 10)
+        name[len++] = '0' + partno / 10;
+    name[len++] = '0' + partno % 10;
+    name[len] = '\0';
+
+    struct block_device *bd = blkdev_alloc(name);
+    bd->sector_size = disk->sector_size;
+    bd->start = start;
+    bd->nr_sectors = nr_sectors;
+    bd->disk = disk;
+    bd->ops = disk->ops;
+    bd->private = disk->private;
+    blkdev_publish(bd);
+    return bd;
+}
+
+/*
+ * Find the block device with number dev
+ */
+struct block_device *blkdev_get(uint32_t dev)
+{
+    uint32_t count = blkdevs.count;
+    __sync_synchronize();
+    if (dev == BLKDEV_NODEV || dev > count)
+        return NULL;
+    return &blkdevs.dev[dev - 1];
+}
+
+/*
+ * Find the block device called name
+ */
+struct block_device *blkdev_lookup(const char *name)
+{
+    uint32_t count = blkdevs.count;
+    __sync_synchronize();
+    for (uint32_t i = 0; i < count; i++) {
+        if (strncmp(blkdevs.dev[i].name, name, BLKDEV_NAME) == 0)
+            return &blkdevs.dev[i];
+    }
+    return NULL;
+}
+
+/*
+ * Sync n locked bufs of one device, the partition offset is added here and nowhere else
+ */
+void blkdev_submit(struct buf **bufs, int n)
+{
+    if (n <= 0)
+        return;
+    struct block_device *bd = blkdev_get(bufs[0]->dev);
+    if (bd == NULL)
+        panic("blkdev_submit: no block device %d.\n", bufs[0]->dev);
+    for (int i = 0; i < n; i++) {
+        if (bufs[i]->dev != bd->dev)
+            panic("blkdev_submit: bufs of devices %d and %d.\n", bd->dev, bufs[i]->dev);
+        if (bd->nr_sectors && bufs[i]->blockno >= bd->nr_sectors)
+            panic("blkdev_submit: block %d beyond the end of %s.\n", bufs[i]->blockno, bd->name);
+    }
+    bd->ops->submit(bd->disk, bufs, n, bd->start);
+}
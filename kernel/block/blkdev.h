@@ -0,0 +1,108 @@
+/**
+ * @file blkdev.h
+ * @author ylp
+ * @brief Block devices, the disks the drivers register and the partitions found on them, by the number the buffer cache knows them
+ * @version 0.1
+ * @date 2022-06-26
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include "include/stdint.h"
+#include "buffer/buf.h"
+
+#define NBLKDEV         16  // Maximum number of block devices, disks and partitions together
+#define BLKDEV_NAME     16
+#define BLKDEV_NODEV    0   // No block device has this number
+
+struct block_device;
+struct blkstat;
+
+/*
+ * What a driver does for its disks
+ */
+struct block_device_ops {
+    // Sync n locked bufs of disk like sd_rw(), bufs[i] holds sector bufs[i]->blockno + start of the disk.
+    // Returns once all of them are done, it may sleep.
+    void (*submit)(struct block_device *disk, struct buf **bufs, int n, uint32_t start);
+    // Optional, move the data of the requests started from now on by DMA if on is set, by the CPU otherwise.
+    // Returns whether DMA was used before, -1 if it can not be.
+    int (*set_dma)(struct block_device *disk, bool on);
+    // Optional, fill in the request counts and latencies of disk.
+    void (*stat)(struct block_device *disk, struct blkstat *st);
+    // Optional, switch the I/O scheduler of disk. Returns 0 on success, -1 if there is no such scheduler.
+    int (*set_scheduler)(struct block_device *disk, const char *name);
+};
+
+struct block_device {
+    char name[BLKDEV_NAME];
+    uint32_t dev;                       // Number of the device, buf->dev of its blocks
+    uint32_t sector_size;               // Bytes per sector
+    uint32_t start;                     // First sector on the disk, 0 for the disk itself
+    uint32_t nr_sectors;                // 0 if the driver does not know
+    struct block_device *disk;          // The whole disk, itself if this is not a partition
+    const struct block_device_ops *ops;
+    void *private;                      // Whatever the driver keeps about the disk
+};
+
+/**
+ * @brief Initialize the registry of block devices, before any driver registers a disk
+ * @retval None
+ */
+void blkdev_init(void);
+
+/**
+ * @brief Register a disk
+ * @param name: Name of the disk, its partitions are named after it
+ * @param sector_size: Bytes per sector, must be BSIZE
+ * @param nr_sectors: Size of the disk, 0 if unknown
+ * @param ops: What the driver does for it
+ * @param private: Kept in the device for the driver
+ * @retval The device
+ */
+struct block_device *blkdev_add_disk(const char *name, uint32_t sector_size, uint32_t nr_sectors,
+                                     const struct block_device_ops *ops, void *private);
+
+/**
+ * @brief Register partition partno of disk, its block 0 is sector start of the disk
+ * @param disk: The disk it is on
+ * @param partno: Number of the partition, 1 to 4 for the MBR
+ * @param start: First sector of the partition
+ * @param nr_sectors: Size of the partition
+ * @retval The device
+ */
+struct block_device *blkdev_add_partition(struct block_device *disk, int partno, uint32_t start, uint32_t nr_sectors);
+
+/**
+ * @brief Find the block device with number dev
+ * @param dev: Its number
+ * @retval The device, NULL if there is none
+ */
+struct block_device *blkdev_get(uint32_t dev);
+
+/**
+ * @brief Find the block device called name
+ * @param name: Its name, e.g. "sd2"
+ * @retval The device, NULL if there is none
+ */
+struct block_device *blkdev_lookup(const char *name);
+
+/**
+ * @brief Sync n locked bufs of one block device with it, like sd_rw() does for the SD card.
+ * Their block numbers count from the start of the device, this is where partitions are mapped onto their disk.
+ * @param bufs: The bufs, all of the same dev, sorted by block number
+ * @param n: How many
+ * @retval None
+ */
+void blkdev_submit(struct buf **bufs, int n);
+
+/**
+ * @brief Device number of the file system root, that of the device called ROOTDEV_NAME
+ */
+extern uint32_t rootdev;
+
+#endif /* BLKDEV_H */
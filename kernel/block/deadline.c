@@ -0,0 +1,127 @@
+/**
+ * @file deadline.c
+ * @author ylp
+ * @brief deadline I/O scheduler, merges requests, starts them in block order and bounds how long one waits
+ * @version 0.1
+ * @date 2022-06-27
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "blk.h"
+#include "arch/aarch64/arm.h"
+
+#define DEADLINE_READ_MS    50      // How long a read may wait before it is started out of block order
+#define DEADLINE_WRITE_MS   500
+#define DEADLINE_BATCH      16      // Requests started one after another up the block order
+#define DEADLINE_STARVED    2       // Read batches started while writes wait before a write batch must go
+
+static void deadline_init(struct request_queue *q)
+{
+    struct deadline_data *dd = &q->elv_data.deadline;
+    for (int d = 0; d < 2; d++) {
+        INIT_LIST_HEAD(&dd->fifo[d]);
+        INIT_LIST_HEAD(&dd->sorted[d]);
+        dd->next[d] = NULL;
+    }
+    dd->batching = 0;
+    dd->last_write = false;
+    dd->starved = 0;
+}
+
+/*
+ * Put r into the block order of its direction
+ */
+static void deadline_sort_add(struct deadline_data *dd, struct blk_request *r)
+{
+    struct list_head *sorted = &dd->sorted[r->write];
+    struct blk_request *pos;
+    list_for_each_entry_reverse(pos, sorted, sort) {
+        if (pos->blockno < r->blockno)
+            break;
+    }
+    // Behind pos, or first if every request starts at a higher block
+    list_add(&r->sort, &pos->sort);
+}
+
+/*
+ * The neighbours in block order are the only candidates, r either continues the one below or precedes the one above
+ */
+static bool deadline_merge(struct request_queue *q, struct blk_request *r)
+{
+    struct deadline_data *dd = &q->elv_data.deadline;
+    struct list_head *sorted = &dd->sorted[r->write];
+    struct blk_request *pos;
+    list_for_each_entry(pos, sorted, sort) {
+        if (pos->blockno > r->blockno)
+            break;
+        if (blk_back_merge(pos, r))
+            return true;
+    }
+    if (&pos->sort != sorted && blk_front_merge(pos, r)) {
+        // r takes the place of pos, in both orders
+        list_replace(&pos->sort, &r->sort);
+        list_replace(&pos->queue, &r->queue);
+        if (dd->next[r->write] == pos)
+            dd->next[r->write] = r;
+        return true;
+    }
+    return false;
+}
+
+static void deadline_add(struct request_queue *q, struct blk_request *r)
+{
+    struct deadline_data *dd = &q->elv_data.deadline;
+    uint64_t ms = r->write ? DEADLINE_WRITE_MS : DEADLINE_READ_MS;
+    r->deadline = timestamp() + r_cntfrq_el0() / 1000 * ms;
+    list_add_tail(&r->queue, &dd->fifo[r->write]);
+    deadline_sort_add(dd, r);
+}
+
+/*
+ * Continue the current batch up the block order, otherwise start a new one: reads unless writes starved,
+ * from the oldest request if it is past its deadline or the block order has run out, else where the last batch stopped
+ */
+static struct blk_request *deadline_dispatch(struct request_queue *q)
+{
+    struct deadline_data *dd = &q->elv_data.deadline;
+    struct blk_request *r = NULL;
+    bool write = dd->last_write;
+
+    if (dd->batching < DEADLINE_BATCH && dd->next[write] != NULL) {
+        r = dd->next[write];
+    } else {
+        bool reads = !list_is_empty(&dd->fifo[0]), writes = !list_is_empty(&dd->fifo[1]);
+        if (reads && (!writes || dd->starved < DEADLINE_STARVED)) {
+            write = false;
+            if (writes)
+                dd->starved++;
+        } else if (writes) {
+            write = true;
+            dd->starved = 0;
+        } else {
+            return NULL;
+        }
+        struct blk_request *oldest = list_first_entry(&dd->fifo[write], struct blk_request, queue);
+        r = dd->next[write];
+        if (r == NULL || timestamp() >= oldest->deadline)
+            r = oldest;
+        dd->batching = 0;
+    }
+
+    dd->next[write] = list_is_last(&r->sort, &dd->sorted[write]) ? NULL : list_next_entry(r, sort);
+    list_del(&r->sort);
+    list_del(&r->queue);
+    dd->last_write = write;
+    dd->batching++;
+    return r;
+}
+
+const struct elevator elevator_deadline = {
+    .name = "deadline",
+    .init = deadline_init,
+    .merge = deadline_merge,
+    .add = deadline_add,
+    .dispatch = deadline_dispatch,
+};
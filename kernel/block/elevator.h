@@ -0,0 +1,58 @@
+/**
+ * @file elevator.h
+ * @author ylp
+ * @brief I/O schedulers, they keep the requests a queue has not started yet and choose which one goes next
+ * @version 0.1
+ * @date 2022-06-27
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef ELEVATOR_H
+#define ELEVATOR_H
+
+#include "include/stdint.h"
+#include "include/list.h"
+
+struct request_queue;
+struct blk_request;
+
+/*
+ * Operations of an I/O scheduler, all called with the queue lock held
+ */
+struct elevator {
+    const char *name;
+    void (*init)(struct request_queue *q);
+    // Put r behind or in front of a queued request whose blocks it continues, false if there is none
+    bool (*merge)(struct request_queue *q, struct blk_request *r);
+    void (*add)(struct request_queue *q, struct blk_request *r);
+    // Take the request to start next off the scheduler, NULL if it has none
+    struct blk_request *(*dispatch)(struct request_queue *q);
+};
+
+/*
+ * noop, one FIFO, a request only merges with the last one queued
+ */
+struct noop_data {
+    struct list_head fifo;
+};
+
+/*
+ * deadline, the requests of each direction are kept in block order and in submission order.
+ * Dispatching goes up the block order in batches and restarts from the oldest request once it has waited too long.
+ * Reads are preferred, writes are passed over at most a few times in a row.
+ */
+struct deadline_data {
+    struct list_head fifo[2];           // Oldest first, indexed by blk_request.write
+    struct list_head sorted[2];         // Lowest block first
+    struct blk_request *next[2];        // Next in block order after the last one dispatched
+    uint32_t batching;                  // Requests dispatched in the current batch
+    bool last_write;                    // Direction of the current batch
+    uint32_t starved;                   // Read batches started while writes waited
+};
+
+extern const struct elevator elevator_noop;
+extern const struct elevator elevator_deadline;
+
+#endif /* ELEVATOR_H */
@@ -0,0 +1,51 @@
+/**
+ * @file noop.c
+ * @author ylp
+ * @brief noop I/O scheduler, requests start in the order they were submitted
+ * @version 0.1
+ * @date 2022-06-27
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "blk.h"
+
+static void noop_init(struct request_queue *q)
+{
+    INIT_LIST_HEAD(&q->elv_data.noop.fifo);
+}
+
+/*
+ * Only the last request queued is looked at, it is the one a sequential submitter continues
+ */
+static bool noop_merge(struct request_queue *q, struct blk_request *r)
+{
+    struct list_head *fifo = &q->elv_data.noop.fifo;
+    if (list_is_empty(fifo))
+        return false;
+    return blk_back_merge(list_last_entry(fifo, struct blk_request, queue), r);
+}
+
+static void noop_add(struct request_queue *q, struct blk_request *r)
+{
+    list_add_tail(&r->queue, &q->elv_data.noop.fifo);
+}
+
+static struct blk_request *noop_dispatch(struct request_queue *q)
+{
+    struct list_head *fifo = &q->elv_data.noop.fifo;
+    if (list_is_empty(fifo))
+        return NULL;
+    struct blk_request *r = list_first_entry(fifo, struct blk_request, queue);
+    list_del(&r->queue);
+    return r;
+}
+
+const struct elevator elevator_noop = {
+    .name = "noop",
+    .init = noop_init,
+    .merge = noop_merge,
+    .add = noop_add,
+    .dispatch = noop_dispatch,
+};
@@ -12,87 +12,499 @@
 #include "buf.h"
 #include "sync/spinlock.h"
 #include "sync/sleeplock.h"
-#include "drivers/mmc/sd.h"
+#include "block/blkdev.h"
 #include "printf.h"
+#include "include/percpu.h"
+#include "include/util.h"
+#include "memory/kalloc.h"
+#include "lib/string.h"
+#include "proc/proc.h"
+#include "proc/kthread.h"
+
+extern uint64_t ticks;
+extern struct spinlock tickslock;
 
 struct bcache bcache;
 
+// Counted per CPU, so that hits on different CPUs do not bounce a shared line
+static DEFINE_PER_CPU(uint64_t, bcache_hits);
+static DEFINE_PER_CPU(uint64_t, bcache_misses);
+static DEFINE_PER_CPU(uint64_t, bcache_ra_blocks);
+static DEFINE_PER_CPU(uint64_t, bcache_ra_hits);
+
+#define A1_SHARE    4       // A1 may hold 1/A1_SHARE of the buffers before its oldest go first
+#define FLUSH_BATCH 16      // Dirty buffers the flusher picks at a time
+
+static uint64_t bcache_shrink(uint64_t nr_pages);
+static struct shrinker bcache_shrinker = { .scan = bcache_shrink };
+
+/*
+ * Page a buffer was carved from
+ */
+static inline struct buf_page *page_of(struct buf *b)
+{
+    return (struct buf_page *)PGROUNDDOWN((uint64_t)b);
+}
+
+/*
+ * Bucket index of a block, Fibonacci hashing of the device and block number
+ */
+static inline uint64_t bcache_hash(uint32_t dev, uint32_t blockno)
+{
+    return ((((uint64_t)dev << 32) | blockno) * 0x9E3779B97F4A7C15UL) >> bcache.hash_shift;
+}
+
+/*
+ * Hash bucket of a block
+ */
+static inline struct bcache_bucket *bucket_of(uint32_t dev, uint32_t blockno)
+{
+    return &bcache.bucket[bcache_hash(dev, blockno)];
+}
+
+/*
+ * Take b off its queue, The bcache lock must be held
+ */
+static void queue_del(struct buf *b)
+{
+    list_del(&b->lru);
+    if (b->queue == BUF_Q_A1)
+        bcache.nr_a1--;
+    else if (b->queue == BUF_Q_AM)
+        bcache.nr_am--;
+    b->queue = BUF_Q_NONE;
+}
+
+/*
+ * Put b at the new end of queue q, The bcache lock must be held
+ */
+static void queue_add(struct buf *b, enum buf_queue q)
+{
+    b->queue = q;
+    if (q == BUF_Q_A1) {
+        list_add(&b->lru, &bcache.a1);
+        bcache.nr_a1++;
+    } else if (q == BUF_Q_AM) {
+        list_add(&b->lru, &bcache.am);
+        bcache.nr_am++;
+    } else {
+        list_add(&b->lru, &bcache.free);
+    }
+}
+
+/*
+ * Remember that a block was evicted from A1, forgetting the oldest ghost if there is no free one
+ * The bcache lock must be held
+ */
+static void ghost_add(uint32_t dev, uint32_t blockno)
+{
+    struct buf_ghost *g;
+    if (!list_is_empty(&bcache.free_ghosts)) {
+        g = list_first_entry(&bcache.free_ghosts, struct buf_ghost, list);
+        bcache.nr_ghosts++;
+    } else {
+        g = list_last_entry(&bcache.ghosts, struct buf_ghost, list);
+        for (struct buf_ghost **pp = &bcache.ghash[bcache_hash(g->dev, g->blockno)]; *pp != NULL; pp = &(*pp)->hnext) {
+            if (*pp == g) {
+                *pp = g->hnext;
+                break;
+            }
+        }
+    }
+    list_del(&g->list);
+    g->dev = dev;
+    g->blockno = blockno;
+    struct buf_ghost **head = &bcache.ghash[bcache_hash(dev, blockno)];
+    g->hnext = *head;
+    *head = g;
+    list_add(&g->list, &bcache.ghosts);
+}
+
+/*
+ * Forget the ghost of a block, returns whether there was one
+ * The bcache lock must be held
+ */
+static bool ghost_take(uint32_t dev, uint32_t blockno)
+{
+    for (struct buf_ghost **pp = &bcache.ghash[bcache_hash(dev, blockno)]; *pp != NULL; pp = &(*pp)->hnext) {
+        struct buf_ghost *g = *pp;
+        if (g->dev == dev && g->blockno == blockno) {
+            *pp = g->hnext;
+            list_move(&g->list, &bcache.free_ghosts);
+            bcache.nr_ghosts--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 
+ * Carve a page into free buffers
+ * Returns 0 on success, -1 if the cache is at its limit or out of memory
+ */
+static int grow_bcache(void)
+{
+    acquire_spin_lock(&bcache.lock);
+    if (bcache.nbuf + BUF_PER_PAGE > bcache.nbuf_max) {
+        release_spin_lock(&bcache.lock);
+        return -1;
+    }
+    // Counted before kalloc, so that two growers can not go past the limit
+    bcache.nbuf += BUF_PER_PAGE;
+    release_spin_lock(&bcache.lock);
+
+    struct buf_page *page = kalloc(PGSIZE);
+    if (page == NULL) {
+        acquire_spin_lock(&bcache.lock);
+        bcache.nbuf -= BUF_PER_PAGE;
+        release_spin_lock(&bcache.lock);
+        return -1;
+    }
+    memset(page, 0, PGSIZE);
+    page->nbuf = BUF_PER_PAGE;
+    for (int i = 0; i < page->nbuf; ++i) {
+        page->buf[i].dev = BUF_NODEV;
+        init_sleep_lock(&page->buf[i].lock, "buffer");
+    }
+
+    acquire_spin_lock(&bcache.lock);
+    list_add_tail(&page->list, &bcache.pages);
+    for (int i = 0; i < page->nbuf; ++i) {
+        queue_add(&page->buf[i], BUF_Q_FREE);
+    }
+    if (bcache.waiters)
+        wakeup(&bcache.waiters);
+    release_spin_lock(&bcache.lock);
+    return 0;
+}
+
 /*
  * Initialize the system buffer (bcache)
- * First get bcache.lock, then join the NBUF slots into a linked list. 
- * After initialization, all access to the Buffer Cache will go through bcache.
- * head instead of the static array bcache.buf 
+ * The cache may grow to 1/BCACHE_MEM_DIV of the free memory, NBUF buffers are allocated now
  */
 void binit()
 {   
     init_spin_lock(&bcache.lock, "bcache");
+    INIT_LIST_HEAD(&bcache.pages);
+    INIT_LIST_HEAD(&bcache.free);
+    INIT_LIST_HEAD(&bcache.a1);
+    INIT_LIST_HEAD(&bcache.am);
+    INIT_LIST_HEAD(&bcache.ghosts);
+    INIT_LIST_HEAD(&bcache.free_ghosts);
+    INIT_LIST_HEAD(&bcache.dirty);
+    init_sleep_lock(&bcache.scratch.lock, "buffer");
+
+    uint64_t pages = kalloc_available_pages() / BCACHE_MEM_DIV;
+    pages = MAX(pages, (NBUF + BUF_PER_PAGE - 1) / BUF_PER_PAGE);
+    pages = MIN(pages, NBUF_MAX / BUF_PER_PAGE);
+    bcache.nbuf_max = pages * BUF_PER_PAGE;
 
-    // Create linked list of buffers
-    bcache.head.prev = &bcache.head;
-    bcache.head.next = &bcache.head;
-    for (struct buf *b = bcache.buf; b < bcache.buf + NBUF; ++b) {
-        // head interpolation
-        b->next = bcache.head.next;
-        b->prev = &bcache.head;
-        init_sleep_lock(&b->lock, "buffer");
-        bcache.head.next->prev = b;
-        bcache.head.next = b;
+    // About two buffers per bucket once the cache is full, and half as many ghosts as buffers
+    uint32_t bits = 1;
+    while ((1UL << bits) < bcache.nbuf_max / 2)
+        bits++;
+    bcache.hash_shift = 64 - bits;
+    uint64_t nghost = bcache.nbuf_max / 2;
+    bcache.bucket = kalloc(sizeof(struct bcache_bucket) << bits);
+    bcache.ghash = kalloc(sizeof(struct buf_ghost *) << bits);
+    struct buf_ghost *ghosts = kalloc(sizeof(struct buf_ghost) * nghost);
+    if (bcache.bucket == NULL || bcache.ghash == NULL || ghosts == NULL)
+        panic("binit: no memory for the buffer cache.\n");
+    for (uint64_t i = 0; i < (1UL << bits); ++i) {
+        init_spin_lock(&bcache.bucket[i].lock, "bcache_bucket");
+        bcache.bucket[i].head = NULL;
+        bcache.ghash[i] = NULL;
     }
-    cprintf("binit: success.\n");
+    for (uint64_t i = 0; i < nghost; ++i) {
+        list_add(&ghosts[i].list, &bcache.free_ghosts);
+    }
+
+    while (bcache.nbuf < NBUF) {
+        if (grow_bcache() < 0)
+            panic("binit: no memory for the buffer cache.\n");
+    }
+    register_shrinker(&bcache_shrinker);
+    cprintf("binit: success, %d buffers, up to %d.\n", bcache.nbuf, bcache.nbuf_max);
 }
 
 /*
- * Look through buffer cache for block on device dev
- * Scans all Cache blocks in the Buffer Cache based on the entered device number and block number. 
- * If the cache hits, bget updates the reference count refCNt, releasing bcache.lock 
- * Bget returns the locked cache block
+ * Find the block in its bucket, The bucket lock must be held
  */
-static struct buf *bget(uint32_t dev, uint32_t blockno)
+static struct buf *bucket_find(struct bcache_bucket *bucket, uint32_t dev, uint32_t blockno)
 {
-    // When multiple threads access the Buffer Cache, they always wait outside
-    acquire_spin_lock(&bcache.lock);
-
-    // Is the block already cached? Head.next points to the most recently used cache block
-    for (struct buf *b = bcache.head.next; b != &bcache.head; b = b->next) {
+    for (struct buf *b = bucket->head; b != NULL; b = b->hnext) {
         if (b->dev == dev && b->blockno == blockno) {
-            // If hit, return directly
-            b->refcnt += 1;
-            release_spin_lock(&bcache.lock);
-            // Returns the locked cache block
-            acquire_sleep_lock(&b->lock);
             return b;
         }
     }
+    return NULL;
+}
 
-    // If there is no hit, Recycle the least recently used (LRU) unused buffer. 
-    // Head.prev points to the least recently used cache block
-    for (struct buf *b = bcache.head.prev; b != &bcache.head; b = b->prev) {
-        if (b->refcnt == 0 && !(b->flags & BUF_DIRTY)) {
-            // refcnt indicates the number of threads currently queuing to read the cache block 
-            b->dev = dev;
-            b->blockno = blockno;
-            b->flags = 0;
-            b->refcnt = 1;
+/*
+ * Drop a reference to b, The lock of its bucket must be held
+ * The last one wakes up whoever waits in bget for an unused buffer.
+ */
+static void buf_put(struct buf *b)
+{
+    if (--b->refcnt == 0) {
+        // Pairs with the barrier in buf_alloc: either we see the waiter or it sees refcnt 0
+        __sync_synchronize();
+        if (__atomic_load_n(&bcache.waiters, __ATOMIC_RELAXED)) {
+            acquire_spin_lock(&bcache.lock);
+            wakeup(&bcache.waiters);
             release_spin_lock(&bcache.lock);
-            // Returns the locked cache block
-            acquire_sleep_lock(&b->lock);
-            return b;
         }
     }
+}
+
+/*
+ * Take b, seen unused and caching block blockno of dev, out of its bucket and off its queue, with a reference
+ * Returns false if someone used it meanwhile
+ */
+static bool claim_buf(struct buf *b, uint32_t dev, uint32_t blockno)
+{
+    struct bcache_bucket *bucket = bucket_of(dev, blockno);
+    acquire_spin_lock(&bucket->lock);
+    // Nobody can hold its sleep lock without a reference, so flags does not change under us either
+    if (b->dev != dev || b->blockno != blockno || b->refcnt != 0 || (b->flags & BUF_DIRTY)) {
+        release_spin_lock(&bucket->lock);
+        return false;
+    }
+    for (struct buf **pp = &bucket->head; *pp != NULL; pp = &(*pp)->hnext) {
+        if (*pp == b) {
+            *pp = b->hnext;
+            break;
+        }
+    }
+    b->hnext = NULL;
+    b->dev = BUF_NODEV;
+    b->refcnt = 1;
+    acquire_spin_lock(&bcache.lock);
+    if (b->queue == BUF_Q_A1)
+        ghost_add(dev, blockno);
+    queue_del(b);
+    release_spin_lock(&bcache.lock);
+    release_spin_lock(&bucket->lock);
+    return true;
+}
 
-    // TODO: If you can't find one that isn't dirty, write back with a dirty one
-    panic("bget: no available buffer.\n");
+/*
+ * The unused clean buffer 2Q would evict, NULL if every buffer is in use or dirty
+ * The oldest of A1 while A1 holds more than its share, otherwise the least recently used of Am.
+ * The bcache lock must be held, refcnt and flags are only hints here and checked again by claim_buf.
+ */
+static struct buf *pick_victim(void)
+{
+    struct list_head *queue[2] = {&bcache.am, &bcache.a1};
+    if (bcache.nr_a1 > bcache.nbuf / A1_SHARE || bcache.nr_am == 0) {
+        queue[0] = &bcache.a1;
+        queue[1] = &bcache.am;
+    }
+    for (int i = 0; i < 2; ++i) {
+        struct buf *b;
+        list_for_each_entry_reverse(b, queue[i], lru) {
+            if (__atomic_load_n(&b->refcnt, __ATOMIC_RELAXED) == 0 && !(b->flags & BUF_DIRTY))
+                return b;
+        }
+    }
     return NULL;
 }
 
 /*
- * Increase the reference count for this BUF
+ * Get an unused buffer caching nothing, with a reference
+ * Takes a free one, else grows the cache, else evicts one. Sleeps while every buffer is in use or dirty.
  */
-void bpin(struct buf *b)
+static struct buf *buf_alloc(void)
 {
+    struct buf *b;
+    bool waiting = false;
     acquire_spin_lock(&bcache.lock);
-    b->refcnt += 1;
+    while (1) {
+        if (!list_is_empty(&bcache.free)) {
+            b = list_first_entry(&bcache.free, struct buf, lru);
+            queue_del(b);
+            b->refcnt = 1;
+            break;
+        }
+        if (bcache.nbuf + BUF_PER_PAGE <= bcache.nbuf_max) {
+            release_spin_lock(&bcache.lock);
+            int grown = grow_bcache();
+            acquire_spin_lock(&bcache.lock);
+            if (grown == 0)
+                continue;
+        }
+        if ((b = pick_victim()) != NULL) {
+            uint32_t dev = b->dev, blockno = b->blockno;
+            // Keeps the shrinker from freeing the page under claim_buf
+            page_of(b)->pins++;
+            release_spin_lock(&bcache.lock);
+            bool claimed = claim_buf(b, dev, blockno);
+            acquire_spin_lock(&bcache.lock);
+            page_of(b)->pins--;
+            if (claimed)
+                break;
+            continue;
+        }
+        if (!waiting) {
+            // Look once more after announcing ourselves, a buffer released meanwhile does not wake us up
+            waiting = true;
+            bcache.waiters++;
+            __sync_synchronize();
+            continue;
+        }
+        if (bcache.nr_dirty > 0)
+            bcache.flush_kick = true;
+        sleep(&bcache.waiters, &bcache.lock);
+    }
+    if (waiting)
+        bcache.waiters--;
     release_spin_lock(&bcache.lock);
+    return b;
+}
+
+/*
+ * Give an unused buffer caching nothing back to the free list, The bcache lock must be held
+ */
+static void buf_free(struct buf *b)
+{
+    b->refcnt = 0;
+    queue_add(b, BUF_Q_FREE);
+    if (bcache.waiters)
+        wakeup(&bcache.waiters);
+}
+
+/*
+ * Give up to nr_pages pages whose buffers are all unused back, never going below NBUF buffers
+ * Called by kalloc when it runs out of memory, possibly with the proc lock of the caller held,
+ * so buffers put back do not wake anyone: the next buffer released or page grown does.
+ */
+static uint64_t bcache_shrink(uint64_t nr_pages)
+{
+    uint64_t freed = 0;
+    while (freed < nr_pages) {
+        acquire_spin_lock(&bcache.lock);
+        struct buf_page *page = NULL, *p;
+        list_for_each_entry_reverse(p, &bcache.pages, list) {
+            if (bcache.nbuf - p->nbuf < NBUF)
+                break;
+            if (p->pins)
+                continue;
+            int i;
+            for (i = 0; i < p->nbuf; ++i) {
+                if (p->buf[i].queue == BUF_Q_NONE || __atomic_load_n(&p->buf[i].refcnt, __ATOMIC_RELAXED) != 0
+                    || (p->buf[i].flags & BUF_DIRTY))
+                    break;
+            }
+            if (i == p->nbuf) {
+                page = p;
+                break;
+            }
+        }
+        if (page == NULL) {
+            release_spin_lock(&bcache.lock);
+            break;
+        }
+        // Off the list, so that nobody else shrinks it
+        list_del(&page->list);
+        bcache.nbuf -= page->nbuf;
+
+        int claimed;
+        for (claimed = 0; claimed < page->nbuf; ++claimed) {
+            struct buf *b = &page->buf[claimed];
+            if (b->queue == BUF_Q_FREE) {
+                queue_del(b);
+                b->refcnt = 1;
+                continue;
+            }
+            uint32_t dev = b->dev, blockno = b->blockno;
+            if (b->queue == BUF_Q_NONE)
+                break;
+            release_spin_lock(&bcache.lock);
+            bool ok = claim_buf(b, dev, blockno);
+            acquire_spin_lock(&bcache.lock);
+            if (!ok)
+                break;
+        }
+        if (claimed < page->nbuf || page->pins) {
+            // Someone started using one of them or is about to look at one, keep the page
+            for (int i = 0; i < claimed; ++i) {
+                page->buf[i].refcnt = 0;
+                queue_add(&page->buf[i], BUF_Q_FREE);
+            }
+            list_add(&page->list, &bcache.pages);
+            bcache.nbuf += page->nbuf;
+            release_spin_lock(&bcache.lock);
+            break;
+        }
+        release_spin_lock(&bcache.lock);
+        kfree(page);
+        freed++;
+    }
+    return freed;
+}
+
+/*
+ * Look through buffer cache for block on device dev
+ * Only the bucket of the block is searched. If the cache hits, bget updates the reference count refcnt,
+ * otherwise it takes an unused buffer, which may sleep until one is released.
+ * Bget returns the locked cache block
+ */
+static struct buf *bget(uint32_t dev, uint32_t blockno)
+{
+    struct bcache_bucket *bucket = bucket_of(dev, blockno);
+    acquire_spin_lock(&bucket->lock);
+    struct buf *b = bucket_find(bucket, dev, blockno);
+    if (b != NULL) {
+        // If hit, return directly. Am is an LRU, A1 a FIFO that a hit does not reorder
+        b->refcnt++;
+        if (b->queue == BUF_Q_AM) {
+            acquire_spin_lock(&bcache.lock);
+            list_move(&b->lru, &bcache.am);
+            release_spin_lock(&bcache.lock);
+        }
+        release_spin_lock(&bucket->lock);
+        // Returns the locked cache block
+        acquire_sleep_lock(&b->lock);
+        return b;
+    }
+    release_spin_lock(&bucket->lock);
+
+    struct buf *victim = buf_alloc();
+    acquire_spin_lock(&bucket->lock);
+    // Someone else may have read the block in while the bucket was unlocked
+    if ((b = bucket_find(bucket, dev, blockno)) != NULL) {
+        b->refcnt++;
+        release_spin_lock(&bucket->lock);
+        acquire_spin_lock(&bcache.lock);
+        buf_free(victim);
+        release_spin_lock(&bcache.lock);
+    } else {
+        b = victim;
+        b->dev = dev;
+        b->blockno = blockno;
+        b->flags = 0;
+        b->hnext = bucket->head;
+        bucket->head = b;
+        // A block evicted from A1 not long ago is used again, so it goes on Am
+        acquire_spin_lock(&bcache.lock);
+        queue_add(b, ghost_take(dev, blockno) ? BUF_Q_AM : BUF_Q_A1);
+        release_spin_lock(&bcache.lock);
+        release_spin_lock(&bucket->lock);
+    }
+    // Returns the locked cache block
+    acquire_sleep_lock(&b->lock);
+    return b;
+}
+
+/*
+ * Increase the reference count for this BUF
+ */
+void bpin(struct buf *b)
+{
+    struct bcache_bucket *bucket = bucket_of(b->dev, b->blockno);
+    acquire_spin_lock(&bucket->lock);
+    b->refcnt++;
+    release_spin_lock(&bucket->lock);
 }
 
 /*
@@ -100,22 +512,229 @@ void bpin(struct buf *b)
  */
 void bunpin(struct buf *b)
 {
-    acquire_spin_lock(&bcache.lock);
-    b->refcnt -= 1;
-    release_spin_lock(&bcache.lock);
+    struct bcache_bucket *bucket = bucket_of(b->dev, b->blockno);
+    acquire_spin_lock(&bucket->lock);
+    buf_put(b);
+    release_spin_lock(&bucket->lock);
+}
+
+/*
+ * Sort bufs by block number, there are at most a few dozen of them
+ */
+static void buf_sort(struct buf **bufs, int n)
+{
+    for (int i = 1; i < n; ++i) {
+        struct buf *b = bufs[i];
+        int j = i;
+        for (; j > 0 && bufs[j - 1]->blockno > b->blockno; --j) {
+            bufs[j] = bufs[j - 1];
+        }
+        bufs[j] = b;
+    }
+}
+
+/*
+ * Write the contents of n locked bufs to disk, in block order so that consecutive blocks go out in one command.
+ * Those dirtied by bdwrite before are taken off the dirty list.
+ */
+void bwrite_list(struct buf **bufs, int n)
+{
+    bool delayed = false;
+    buf_sort(bufs, n);
+    for (int i = 0; i < n; ++i) {
+        if (!is_current_cpu_holing_sleep_lock(&bufs[i]->lock)) {
+            panic("bwrite: buf not locked.\n");
+        }
+        if (bufs[i]->flags & BUF_DIRTY) {
+            // Dirtied by bdwrite before, nobody else can dirty it again while we hold it
+            if (!delayed)
+                acquire_spin_lock(&bcache.lock);
+            delayed = true;
+            list_del(&bufs[i]->dirty);
+            bcache.nr_dirty--;
+            bcache.writebacks++;
+        }
+        bufs[i]->flags |= BUF_DIRTY;
+    }
+    if (delayed)
+        release_spin_lock(&bcache.lock);
+    // Write disk blocks
+    blkdev_submit(bufs, n);
+    if (delayed) {
+        acquire_spin_lock(&bcache.lock);
+        // They may be the clean buffers somebody waits for
+        if (bcache.waiters)
+            wakeup(&bcache.waiters);
+        release_spin_lock(&bcache.lock);
+    }
 }
 
 /*
  * Write b's contents to disk.  Must be locked
  */
 void bwrite(struct buf *b)
+{
+    bwrite_list(&b, 1);
+}
+
+/*
+ * Mark b dirty and leave writing it to the flusher thread.  Must be locked
+ * A dirty buffer is not evicted, its age and the dirty ratio decide when it is written back.
+ */
+void bdwrite(struct buf *b)
+{
+    if (!is_current_cpu_holing_sleep_lock(&b->lock)) {
+        panic("bdwrite: buf not locked.\n");
+    }
+    if (b->flags & BUF_DIRTY)
+        return;
+    b->flags |= BUF_DIRTY;
+    acquire_spin_lock(&bcache.lock);
+    b->dirtied = __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+    list_add_tail(&b->dirty, &bcache.dirty);
+    if (++bcache.nr_dirty > bcache.nbuf * BDIRTY_RATIO / 100)
+        bcache.flush_kick = true;
+    release_spin_lock(&bcache.lock);
+}
+
+/*
+ * Write the contents of b to block blockno of its device, leaving b and the cached copy of blockno alone.  Must be locked
+ */
+void bwrite_to(struct buf *b, uint32_t blockno)
 {
     if (!is_current_cpu_holing_sleep_lock(&b->lock)) {
-        panic("bwrite: buf not locked.\n");
+        panic("bwrite_to: buf not locked.\n");
+    }
+    struct buf *s = &bcache.scratch;
+    acquire_sleep_lock(&s->lock);
+    s->dev = b->dev;
+    s->blockno = blockno;
+    memmove(s->data, b->data, BSIZE);
+    s->flags = BUF_DIRTY;
+    blkdev_submit(&s, 1);
+    release_sleep_lock(&s->lock);
+}
+
+/*
+ * Lock b for the flusher if it still caches blockno of dev, which were read from b while it was on the dirty list
+ * A busy one is skipped, never waited for: its holder may be the log, holding a batch of dirty buffers
+ * while it waits in bread() for the flusher to clean one.
+ */
+static bool bflush_lock(struct buf *b, uint32_t dev, uint32_t blockno)
+{
+    struct bcache_bucket *bucket = bucket_of(dev, blockno);
+    acquire_spin_lock(&bucket->lock);
+    if (b->dev != dev || b->blockno != blockno) {
+        release_spin_lock(&bucket->lock);
+        return false;
+    }
+    b->refcnt++;
+    release_spin_lock(&bucket->lock);
+    if (!try_acquire_sleep_lock(&b->lock)) {
+        bunpin(b);
+        return false;
+    }
+    // Written back or taken by the log transaction in the meantime
+    if ((b->flags & (BUF_DIRTY | BUF_LOGGED)) != BUF_DIRTY) {
+        brelease(b);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Write dirty buffers back oldest first: all of them if all is set, otherwise those dirty for BDIRTY_EXPIRE ticks
+ * and as many more as it takes to get below BDIRTY_RATIO. Buffers of the running log transaction are skipped,
+ * they may only reach their home locations once it has committed.
+ */
+static void bflush(bool all)
+{
+    struct buf *batch[FLUSH_BATCH];
+    uint32_t dev[FLUSH_BATCH], blockno[FLUSH_BATCH];
+    int busy = 0;   // Oldest dirty buffers found locked by others, passed over from then on
+    while (1) {
+        int n = 0, skip = busy;
+        uint64_t now = __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+        acquire_spin_lock(&bcache.lock);
+        struct buf *b;
+        // Dirty buffers stay hashed to the same block, so dev and blockno are stable here
+        list_for_each_entry(b, &bcache.dirty, dirty) {
+            if (n == FLUSH_BATCH)
+                break;
+            if (!all && now - b->dirtied < BDIRTY_EXPIRE && bcache.nr_dirty - n <= bcache.nbuf * BDIRTY_RATIO / 100)
+                break;
+            if (b->flags & BUF_LOGGED)
+                continue;
+            if (skip > 0) {
+                skip--;
+                continue;
+            }
+            batch[n] = b;
+            dev[n] = b->dev;
+            blockno[n] = b->blockno;
+            // Cleaned by someone else it could be shrunk before bflush_lock looks at it
+            page_of(b)->pins++;
+            n++;
+        }
+        release_spin_lock(&bcache.lock);
+        if (n == 0)
+            break;
+        int m = 0;
+        struct buf_page *pinned[FLUSH_BATCH];
+        for (int i = 0; i < n; ++i) {
+            pinned[i] = page_of(batch[i]);
+            if (bflush_lock(batch[i], dev[i], blockno[i]))
+                batch[m++] = batch[i];
+            else
+                busy++;
+        }
+        // Those locked hold a reference now, which the shrinker respects
+        acquire_spin_lock(&bcache.lock);
+        for (int i = 0; i < n; ++i) {
+            pinned[i]->pins--;
+        }
+        release_spin_lock(&bcache.lock);
+        // Neighbouring blocks dirtied at different times still go out together
+        bwrite_list(batch, m);
+        for (int i = 0; i < m; ++i) {
+            brelease(batch[i]);
+        }
+    }
+}
+
+/*
+ * Write every dirty buffer back, except those of the running log transaction
+ */
+void bsync(void)
+{
+    bflush(true);
+}
+
+/*
+ * Flusher thread, runs every BFLUSH_INTERVAL ticks or when kicked
+ */
+static int bflush_thread(void *arg)
+{
+    while (!kthread_should_stop()) {
+        acquire_spin_lock(&tickslock);
+        uint64_t ticks0 = ticks;
+        while (ticks - ticks0 < BFLUSH_INTERVAL && !__atomic_load_n(&bcache.flush_kick, __ATOMIC_RELAXED)) {
+            sleep(&ticks, &tickslock);
+        }
+        release_spin_lock(&tickslock);
+        __atomic_store_n(&bcache.flush_kick, false, __ATOMIC_RELAXED);
+        bflush(false);
     }
-    b -> flags |= BUF_DIRTY;
-    // Write disk block
-    sd_rw(b);
+    return 0;
+}
+
+/*
+ * Start the thread that writes dirty buffers back
+ */
+void bflush_init(void)
+{
+    if (kthread_run(bflush_thread, NULL, "bflush") == NULL)
+        panic("bflush_init: can not start the flusher thread.\n");
 }
 
 /*
@@ -123,20 +742,54 @@ void bwrite(struct buf *b)
  */
 struct buf *bread(uint32_t dev, uint32_t blockno)
 {
-    const uint32_t LBA = 0x20800;   //TODO: Remember to change this area to dynamic parsing, although hard coding is not impossible
-    struct buf *b = bget(dev, blockno + LBA);
+    struct buf *b = bget(dev, blockno);
     if (!(b->flags & BUF_VALID)) {
         // A value valid of 0 indicates that this is a slot that has just been reclaimed
         // Therefore, the disk block must be read from the disk to the slot
-        sd_rw(b);
+        blkdev_submit(&b, 1);
+        this_cpu_inc(bcache_misses);
+    } else {
+        this_cpu_inc(bcache_hits);
+        if (b->flags & BUF_READAHEAD) {
+            b->flags &= ~BUF_READAHEAD;
+            this_cpu_inc(bcache_ra_hits);
+        }
     }
     // The cache block returned is locked
     return b;
 }
 
+/*
+ * Read the indicated blocks into the cache unless they are there already, for read-ahead
+ * Up to BUF_BATCH blocks missing from the cache are read at a time, consecutive ones by one command.
+ */
+void breadahead(uint32_t dev, uint32_t *blocks, int n)
+{
+    struct buf *batch[BUF_BATCH];
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        struct buf *b = bget(dev, blocks[i]);
+        if (b->flags & BUF_VALID) {
+            brelease(b);
+        } else {
+            batch[m++] = b;
+        }
+        if (m == BUF_BATCH || (i == n - 1 && m > 0)) {
+            buf_sort(batch, m);
+            blkdev_submit(batch, m);
+            for (int j = 0; j < m; ++j) {
+                // Counted as a read-ahead hit when bread asks for it
+                batch[j]->flags |= BUF_READAHEAD;
+                this_cpu_inc(bcache_ra_blocks);
+                brelease(batch[j]);
+            }
+            m = 0;
+        }
+    }
+}
+
 /*
  * Release a locked buffer
- * Move to the head of the most-recently-used list
  * A kernel thread must release a buffer by calling brelease when it is done with it. 
  * When the caller is done with a buffer, it must call brelse to release it.
  */
@@ -148,16 +801,29 @@ void brelease(struct buf *buf)
     // Get the lock on cache block b at bget and release it here
     release_sleep_lock(&buf->lock);
 
+    // The block can not change while we hold a reference, so neither can its bucket
+    struct bcache_bucket *bucket = bucket_of(buf->dev, buf->blockno);
+    acquire_spin_lock(&bucket->lock);
+    buf_put(buf);
+    release_spin_lock(&bucket->lock);
+}
+
+/*
+ * Fill in the buffer cache statistics
+ */
+int32_t bcacheinfo(struct bcacheinfo *info)
+{
     acquire_spin_lock(&bcache.lock);
-    buf->refcnt -= 1;
-    if (buf->refcnt == 0) {
-        // no one is waiting for it.
-        buf->next->prev = buf->prev;
-        buf->prev->next = buf->next;
-        buf->next = bcache.head.next;
-        buf->prev = &bcache.head;
-        bcache.head.next->prev = buf;
-        bcache.head.next = buf;
-    }
+    info->nbuf = bcache.nbuf;
+    info->nbuf_max = bcache.nbuf_max;
+    info->a1 = bcache.nr_a1;
+    info->am = bcache.nr_am;
+    info->dirty = bcache.nr_dirty;
+    info->writebacks = bcache.writebacks;
     release_spin_lock(&bcache.lock);
+    info->hits = per_cpu_sum(bcache_hits);
+    info->misses = per_cpu_sum(bcache_misses);
+    info->ra_blocks = per_cpu_sum(bcache_ra_blocks);
+    info->ra_hits = per_cpu_sum(bcache_ra_hits);
+    return 0;
 }
\ No newline at end of file
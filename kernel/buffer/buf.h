@@ -1,7 +1,7 @@
 /**
  * @file buf.h
  * @author ylp
- * @brief The Buffer Cache uses the LRU algorithm to reclaim these slots.
+ * @brief The Buffer Cache grows with free memory and uses the 2Q algorithm to reclaim these slots.
  * @version 0.1
  * @date 2022-02-11
  * 
@@ -14,30 +14,121 @@
 
 #include "fs/fs.h"
 #include "include/stdint.h"
+#include "include/list.h"
 #include "sync/sleeplock.h"
+#include "arch/aarch64/mmu.h"
+#include "arch/aarch64/arm.h"
 
 #define BUF_VALID   0x1     // 0b01  indicates that the buffer contains a copy of the block or not
 #define BUF_DIRTY   0x2     // 0b10
+#define BUF_LOGGED  0x4     // Modified by the running log transaction, may not be written to its home location yet
+#define BUF_READAHEAD 0x8   // Read in by read-ahead and not asked for yet
+
+#define BUF_NODEV   ((uint32_t)-1)  // dev of a buffer that caches no block and is in no hash bucket
+#define BUF_BATCH   8       // The most buffers one multi-block transfer holds locked, well below NBUF
+
+/*
+ * Queue of the 2Q replacement a buffer is on
+ */
+enum buf_queue {
+    BUF_Q_NONE,             // On no queue, being handed over by the one who holds it
+    BUF_Q_FREE,             // Caches no block
+    BUF_Q_A1,               // Read in once, FIFO
+    BUF_Q_AM,               // Asked for again after it left A1, LRU
+};
 
 struct buf {
     int flags;              // Holds the valid and dirty flag bits
     uint32_t dev;           // Device ID
     uint32_t blockno;       // block number, but more exactly, is the sector number
-    uint8_t data[BSIZE];    // Stored data
-    uint32_t refcnt;        // How many kernel threads are currently queuing to read this cache block
+    uint8_t data[BSIZE] __attribute__((aligned(CACHE_LINE_SIZE)));  // Stored data, on lines of its own for DMA
+    uint32_t refcnt;        // How many kernel threads are currently queuing to read this cache block, protected by the bucket lock
     struct sleeplock lock;  // The sleep lock of each cache block protects reads and writes to that block
-    struct buf *prev;       // LRU cache list
-    struct buf *next;       // LRU cache list
+    struct buf *hnext;      // Next buffer in the same hash bucket, protected by the bucket lock
+    enum buf_queue queue;   // Protected by bcache.lock
+    struct list_head lru;   // Entry in the queue, protected by bcache.lock
+    struct list_head dirty; // Entry in bcache.dirty while BUF_DIRTY is set by bdwrite, protected by bcache.lock
+    uint64_t dirtied;       // ticks when it became dirty
+};
+
+/*
+ * Page of buffers, the cache grows and shrinks a page at a time
+ */
+struct buf_page {
+    struct list_head list;  // Entry in bcache.pages
+    int nbuf;
+    int pins;               // Bare pointers to its buffers held with the bcache lock dropped, the shrinker keeps it
+    struct buf buf[];
 };
 
+#define BUF_PER_PAGE    ((PGSIZE - sizeof(struct buf_page)) / sizeof(struct buf))
+
+/*
+ * Hash bucket of the buffer cache, the buffers caching the blocks that hash to it
+ */
+struct bcache_bucket {
+    struct spinlock lock;   // Protects the chain and the refcnt of the buffers on it
+    struct buf *head;
+};
+
+/*
+ * Block recently evicted from A1, remembered so that asking for it again puts it on Am
+ */
+struct buf_ghost {
+    uint32_t dev;
+    uint32_t blockno;
+    struct buf_ghost *hnext;
+    struct list_head list;  // Entry in bcache.ghosts, or the free ghosts
+};
+
+/*
+ * The buffer cache takes pages with kalloc as it misses, up to a limit set at boot from the free memory,
+ * and gives them back when kalloc runs out. It is replaced with 2Q: a block read in goes on A1, a FIFO,
+ * and only moves to Am, an LRU, if it is asked for again after it left A1. Blocks read once by
+ * a scan go through A1 without pushing the blocks used again and again (inodes, directories) out of Am.
+ * Lookups only take the lock of the bucket of the block, so hits on different blocks do not contend.
+ * Writes may be delayed with bdwrite, the flusher thread writes dirty buffers back by age and by dirty ratio.
+ * Lock order: bucket lock, then lock. Two bucket locks are never held together.
+ */
 struct bcache {
-    struct spinlock lock;   // The Buffer Cache's spin locks protect information about which blocks have been cached 
-    struct buf buf[NBUF];       
-    // Linked list of all buffers, through prev/next.
-    // Sorted by how recently the buffer was used.
-    // head.next is most recent, head.prev is least.
-    // i.e. LRU replace algorithm
-    struct buf head;
+    struct bcache_bucket *bucket;
+    uint32_t hash_shift;        // There are 1 << (64 - hash_shift) buckets
+    struct buf_ghost **ghash;   // Buckets of the ghosts, same hash as the buffers
+
+    struct spinlock lock;       // Protects everything below and the queues of the buffers
+    struct list_head pages;
+    uint64_t nbuf;              // Buffers in the pages, plus those of pages being allocated
+    uint64_t nbuf_max;
+    struct list_head free;
+    struct list_head a1;        // a1.next is the newest, a1.prev the oldest
+    struct list_head am;        // am.next is most recent, am.prev is least
+    uint64_t nr_a1;
+    uint64_t nr_am;
+    struct list_head ghosts;    // Evicted from A1, ghosts.next is the newest
+    struct list_head free_ghosts;
+    uint64_t nr_ghosts;
+    uint64_t waiters;           // Sleeping in bget for a buffer to be released or cleaned
+    struct list_head dirty;     // Buffers dirtied by bdwrite, dirty.next is the oldest
+    uint64_t nr_dirty;
+    uint64_t writebacks;        // Delayed writes that reached the disk
+    bool flush_kick;            // Asks the flusher to run before its interval is up
+    struct buf scratch;         // Used by bwrite_to, protected by its sleep lock
+};
+
+/*
+ * Buffer cache statistics reported to user space by bcacheinfo
+ */
+struct bcacheinfo {
+    uint64_t nbuf;          // Number of buffers
+    uint64_t nbuf_max;      // The most it may grow to
+    uint64_t a1;            // Buffers on A1, read in once
+    uint64_t am;            // Buffers on Am, used again
+    uint64_t hits;          // Lookups that found the block cached
+    uint64_t misses;        // Lookups that had to read the block in
+    uint64_t dirty;         // Buffers waiting to be written back
+    uint64_t writebacks;    // Delayed writes that reached the disk
+    uint64_t ra_blocks;     // Blocks read in by read-ahead
+    uint64_t ra_hits;       // Of those, blocks bread asked for later
 };
 
 /**
@@ -54,6 +145,15 @@ void binit();
  */
 struct buf *bread(uint32_t dev, uint32_t blockno);
 
+/**
+ * @brief  Read blocks into the cache unless they are there already, without keeping them
+ * @param  dev: The device to read
+ * @param  *blocks: block numbers, consecutive ones are read by one command
+ * @param  n: How many
+ * @retval None
+ */
+void breadahead(uint32_t dev, uint32_t *blocks, int n);
+
 /**
  * @brief  Write the corresponding BUF to the device, at which point the BUF must be locked
  * @param  buf *: Pointer to the buffer to operate on
@@ -62,7 +162,42 @@ struct buf *bread(uint32_t dev, uint32_t blockno);
 void bwrite(struct buf *);
 
 /**
- * @brief  Release a locked buffer and move it to the LRU list
+ * @brief  Write n locked BUFs to the device, consecutive blocks by one command
+ * @param  **bufs: The buffers, sorted by block number on return
+ * @param  n: How many, at most BUF_BATCH unless the caller can hold that many
+ * @retval None
+ */
+void bwrite_list(struct buf **bufs, int n);
+
+/**
+ * @brief  Mark the locked BUF dirty and leave writing it to the flusher thread
+ * @param  buf *: Pointer to the buffer to operate on
+ * @retval None
+ */
+void bdwrite(struct buf *);
+
+/**
+ * @brief  Write the contents of the locked BUF to another block of its device, leaving the cached copies alone
+ * @param  buf *: Pointer to the buffer to operate on
+ * @param  blockno: block number to write to
+ * @retval None
+ */
+void bwrite_to(struct buf *, uint32_t blockno);
+
+/**
+ * @brief  Write every dirty buffer back, except those of the running log transaction
+ * @retval None
+ */
+void bsync(void);
+
+/**
+ * @brief  Start the thread that writes dirty buffers back
+ * @retval None
+ */
+void bflush_init(void);
+
+/**
+ * @brief  Release a locked buffer
  * @param  buf *: Pointer to the buffer to operate on
  * @retval None
  */
@@ -82,4 +217,11 @@ void bpin(struct buf *);
  */
 void bunpin(struct buf *);
 
+/**
+ * @brief  Fill in the buffer cache statistics
+ * @param  *info: Where to put them
+ * @retval 0
+ */
+int32_t bcacheinfo(struct bcacheinfo *info);
+
 #endif /* BUF_H */
\ No newline at end of file
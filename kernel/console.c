@@ -114,7 +114,7 @@ void consoleintr(int c)
     switch (c) {
         // Print process list.
         case C('P'):  
-            // procdump
+            proc_dump();
             break;
 
         // Kill line.
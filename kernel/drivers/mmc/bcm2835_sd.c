@@ -17,11 +17,22 @@
 #include "proc/proc.h"
 #include "sync/sleeplock.h"
 #include "lib/string.h"
+#include "block/blk.h"
+#include "block/blkdev.h"
+#include "arch/aarch64/board/raspi3/irq.h"
+#include "arch/aarch64/board/raspi3/dma.h"
+#include "memory/kalloc.h"
+#include "interrupt/softirq.h"
 
 /*
  * Private functions declaration
  */
-static void _sd_start(struct buf* b);
+static int _sd_start(uint32_t blockno, uint32_t n, bool write);
+static void _sd_read_fifo(struct buf* b);
+static void _sd_write_fifo(struct buf* b);
+static void _sd_start_request(struct request_queue* q, struct blk_request* r);
+static void _sd_set_dma(bool on);
+static void _sd_tasklet_fn(uint64_t data);
 static void _sd_delayus(uint32_t cnt);
 static int _sd_init();
 static void _sd_parse_cid();
@@ -267,14 +278,14 @@ static EmmcCommand sd_command_table[] = {
     {"SET_BLOCKLEN", 0x10000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"READ_SINGLE", 0x11000000 | CMD_RSPNS_48 | CMD_IS_DATA | TM_DAT_DIR_CH,
      RESP_R1, RCA_NO, 0},
-    {"READ_MULTI", 0x12000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_CH,
+    {"READ_MULTI", 0x12000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_CH | TM_AUTO_CMD12,
      RESP_R1, RCA_NO, 0},
     {"SEND_TUNING", 0x13000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"SPEED_CLASS", 0x14000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
     {"SET_BLOCKCNT", 0x17000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"WRITE_SINGLE", 0x18000000 | CMD_RSPNS_48 | CMD_IS_DATA | TM_DAT_DIR_HC,
      RESP_R1, RCA_NO, 0},
-    {"WRITE_MULTI", 0x19000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_HC,
+    {"WRITE_MULTI", 0x19000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_HC | TM_AUTO_CMD12,
      RESP_R1, RCA_NO, 0},
     {"PROGRAM_CSD", 0x1B000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"SET_WRITE_PR", 0x1C000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
@@ -504,6 +515,18 @@ typedef struct SdDescriptor {
 
 static SdDescriptor sd_card;
 
+// Transfers of the file system, completed by sd_intr() once interrupt mode is on
+static struct request_queue sd_queue;
+static bool sd_irq_mode = false;
+static struct tasklet_struct sd_tasklet;    // Moves the data and completes requests for sd_intr()
+static uint32_t sd_irq_pending;             // Interrupt bits sd_intr() acknowledged and the tasklet has not seen yet
+static struct block_device* sd_disk;    // The whole card, its partitions are sd1 to sd4
+
+// The data phase is moved by a DMA channel instead of the CPU, which only sees data done then
+#define SD_DMA_CHAN 5               // Left to the ARM by the firmware, its channel mask is 0x7f35
+static struct dma_cb* sd_cbs;       // A page of control blocks, one per block of the active request
+static bool sd_dma = false;
+
 static int sd_host_ver = 0;
 static int sd_debug = 0;
 static int sd_base_clock;
@@ -517,6 +540,9 @@ _parse_uint32_t(uint8_t* bytes)
            | (((uint32_t)bytes[1]) << 8) | (((uint32_t)bytes[0]) << 0);
 }
 
+/*
+ * Print partition entry id of the MBR and register the partition as a block device, if the entry is used
+ */
 static void
 _parse_partition_entry(uint8_t* entry, int id)
 {
@@ -552,8 +578,23 @@ _parse_partition_entry(uint8_t* entry, int id)
 
     uint32_t sectorno = _parse_uint32_t(&entry[12]);
     cprintf("- Number of sectors: %d\n", sectorno);
+
+    if (partition_type != 0 && sectorno != 0)
+        blkdev_add_partition(sd_disk, id, lba, sectorno);
 }
 
+static void _sd_submit(struct block_device* disk, struct buf** bufs, int n, uint32_t start);
+static int _sd_set_dma_mode(struct block_device* disk, bool on);
+static void _sd_stat(struct block_device* disk, struct blkstat* st);
+static int _sd_set_scheduler(struct block_device* disk, const char* name);
+
+static const struct block_device_ops sd_ops = {
+    .submit = _sd_submit,
+    .set_dma = _sd_set_dma_mode,
+    .stat = _sd_stat,
+    .set_scheduler = _sd_set_scheduler,
+};
+
 /*
  * Initialize SD card and parse MBR.
  * 1. The first partition should be FAT and is used for booting.
@@ -568,6 +609,7 @@ sd_init()
      * Initialize the lock and request queue if any.
      * Remember to call sd_init() at somewhere.
      */
+    blk_init_queue(&sd_queue, "sd", _sd_start_request);
     _sd_init();
     asserts(sd_card.init, "\tFailed to initialize SD card.\n");
 
@@ -580,14 +622,30 @@ sd_init()
     sd_rw(&mbr);
     asserts((uint32_t)mbr.flags & BUF_VALID, "\tMBR is not valid.\n");
 
+    uint8_t *ending = mbr.data + 0x1FE;
+    cprintf("sd_init: Boot signature: %x %x\n", ending[0], ending[1]);
+    asserts(ending[0] == 0x55 && ending[1] == 0xAA, "\tMBR is not valid.\n");
+
+    sd_disk = blkdev_add_disk("sd", BSIZE, sd_card.capacity / BSIZE, &sd_ops, &sd_card);
     uint8_t *partitions = mbr.data + 0x1BE;
     for (int i = 0; i < 4; ++i) {
         _parse_partition_entry(partitions + (i << 4), i + 1);
     }
 
-    uint8_t *ending = mbr.data + 0x1FE;
-    cprintf("sd_init: Boot signature: %x %x\n", ending[0], ending[1]);
-    asserts(ending[0] == 0x55 && ending[1] == 0xAA, "\tMBR is not valid.\n");
+    /*
+     * Everything above polled the controller, the scheduler is not running yet.
+     * From now on the data phase of a transfer raises the EMMC interrupt and its submitter sleeps.
+     */
+    *EMMC_INTERRUPT = *EMMC_INTERRUPT;
+    tasklet_init(&sd_tasklet, _sd_tasklet_fn, 0);
+    if ((sd_cbs = kalloc(PGSIZE)) != NULL) {
+        dma_init(SD_DMA_CHAN);
+        _sd_set_dma(true);
+    } else {
+        _sd_set_dma(false);
+    }
+    sd_irq_mode = true;
+    put32(ENABLE_IRQS_2, EMMC_INT);
 
     cprintf("sd_init: success.\n");
 }
@@ -600,21 +658,26 @@ _sd_delayus(uint32_t c)
 }
 
 /*
- * Start the request for b. Caller must hold sdlock.
+ * Send the read or write command of n blocks starting at blockno, the data phase is left to the caller.
+ * More than one block is READ_MULTI or WRITE_MULTI, the controller stops the card with an auto CMD12.
+ * Caller must hold the queue lock or be the only one using the card.
  */
-static void
-_sd_start(struct buf* b)
+static int
+_sd_start(uint32_t blockno, uint32_t n, bool write)
 {
     // Address is different depending on the card type.
     // HC passes address as block number.
     // SC passes address straight through.
-    int blockno = sd_card.type == SD_TYPE_2_HC ? b->blockno : b->blockno << 9;
-    int write = b->flags & BUF_DIRTY;
-    int cmd = write ? IX_WRITE_SINGLE : IX_READ_SINGLE;
+    int addr = sd_card.type == SD_TYPE_2_HC ? blockno : blockno << 9;
+    int cmd;
+    if (n > 1)
+        cmd = write ? IX_WRITE_MULTI : IX_READ_MULTI;
+    else
+        cmd = write ? IX_WRITE_SINGLE : IX_READ_SINGLE;
 
     // cprintf(
-    //     "_sd_start: CPU %d, flag 0x%x, blockno %d, write=%d.\n", cpuid(),
-    //     b->flags, blockno, write);
+    //     "_sd_start: CPU %d, blockno %d, n %d, write=%d.\n", cpuid(),
+    //     blockno, n, write);
 
     // Ensure that any data operation has completed before doing the transfer.
     disb();
@@ -623,156 +686,299 @@ _sd_start(struct buf* b)
         "\tEMMC ERROR: Interrupt flag should be empty: 0x%x\n",
         *EMMC_INTERRUPT);
 
-    *EMMC_BLKSIZECNT = BSIZE;
+    *EMMC_BLKSIZECNT = (n << 16) | BSIZE;
 
-    int resp = _sd_send_command_a(cmd, blockno);
-    asserts(!resp, "\tEMMC ERROR: Send command error.\n");
+    int resp = _sd_send_command_a(cmd, addr);
+    if (resp)
+        cprintf("\tEMMC ERROR: Send command error %d.\n", resp);
+    return resp;
+}
+
+/*
+ * Copy a block the card has ready out of the FIFO.
+ */
+static void
+_sd_read_fifo(struct buf* b)
+{
+    uint32_t* intbuf = (uint32_t*)b->data;
+    asserts(
+        !((uint64_t)b->data & 0x3), "\tOnly support word-aligned buffers.\n");
+    for (int done = 0; done < BSIZE / 4; ++done) {
+        intbuf[done] = *EMMC_DATA;
+    }
+}
 
+/*
+ * Copy a block into the FIFO once the card is ready for it.
+ */
+static void
+_sd_write_fifo(struct buf* b)
+{
     uint32_t* intbuf = (uint32_t*)b->data;
     asserts(
         !((uint64_t)b->data & 0x3), "\tOnly support word-aligned buffers.\n");
+    for (int done = 0; done < BSIZE / 4; ++done) {
+        *EMMC_DATA = intbuf[done];
+    }
+}
 
-    if (write) {
-        resp = _sd_wait_for_interrupt(INT_WRITE_RDY);
-        asserts(!resp, "\tEMMC ERROR: Timeout waiting for ready to write.\n");
-        asserts(
-            !*EMMC_INTERRUPT,
-            "\tEMMC ERROR: Interrupt flag should be empty: 0x%x\n",
-            *EMMC_INTERRUPT);
-        for (int done = 0; done < BSIZE / 4; ++done) {
-            *EMMC_DATA = intbuf[done];
+/*
+ * Choose how the data phase is moved in interrupt mode, The queue must be idle.
+ * With DMA the FIFO ready interrupts are neither raised nor reported, the DMA channel follows the DREQ of the EMMC.
+ */
+static void
+_sd_set_dma(bool on)
+{
+    uint32_t rdy = INT_READ_RDY | INT_WRITE_RDY;
+    sd_dma = on && sd_cbs != NULL;
+    *EMMC_IRPT_MASK = sd_dma ? 0xffffffff & ~rdy : 0xffffffff;
+    *EMMC_IRPT_EN = (sd_dma ? 0 : rdy) | INT_DATA_DONE | INT_ERROR_MASK | INT_CMD_TIMEOUT;
+}
+
+/*
+ * Block device hook, choose DMA or the FIFO for the requests started from now on.
+ * The queue is empty whenever no request is active, so waiting for that is enough for the switch.
+ */
+static int
+_sd_set_dma_mode(struct block_device* disk, bool on)
+{
+    if (on && sd_cbs == NULL)
+        return -1;
+    while (1) {
+        acquire_spin_lock(&sd_queue.lock);
+        if (sd_queue.active == NULL) {
+            bool was = sd_dma;
+            _sd_set_dma(on);
+            release_spin_lock(&sd_queue.lock);
+            return was;
         }
-    } else {
-        resp = _sd_wait_for_interrupt(INT_READ_RDY);
-        asserts(!resp, "\tEMMC ERROR: Timeout waiting for ready to read.\n");
-        asserts(
-            !*EMMC_INTERRUPT,
-            "\tEMMC ERROR: Interrupt flag should be empty: 0x%x\n",
-            *EMMC_INTERRUPT);
-        for (int done = 0; done < BSIZE / 4; ++done) {
-            intbuf[done] = *EMMC_DATA;
+        release_spin_lock(&sd_queue.lock);
+        yield();
+    }
+}
+
+/*
+ * Build the control block chain of r, one block of the FIFO into or out of each buffer, and start it.
+ * The engine only moves a word when the EMMC asks for it, so the chain is started before the command.
+ */
+static void
+_sd_dma_start(struct blk_request* r)
+{
+    uint32_t fifo = DMA_BUS_IO(EMMC_DATA);
+    uint32_t ti = DMA_TI_PERMAP(DMA_DREQ_EMMC) | DMA_TI_WAIT_RESP;
+    ti |= r->write ? DMA_TI_SRC_INC | DMA_TI_DEST_DREQ : DMA_TI_DEST_INC | DMA_TI_SRC_DREQ;
+    for (uint32_t k = 0; k < r->nr_blocks; k++) {
+        struct dma_cb* cb = &sd_cbs[k];
+        uint8_t* data = blk_rq_buf(r, k)->data;
+        cb->ti = ti;
+        if (r->write) {
+            // The engine reads memory, what the CPU wrote must be there
+            dc_clean_range(data, BSIZE);
+            cb->source_ad = DMA_BUS_MEM(data);
+            cb->dest_ad = fifo;
+        } else {
+            // No dirty line may be written back over what the engine puts there
+            dc_flush_range(data, BSIZE);
+            cb->source_ad = fifo;
+            cb->dest_ad = DMA_BUS_MEM(data);
         }
+        cb->txfr_len = BSIZE;
+        cb->stride = 0;
+        cb->nextconbk = k + 1 < r->nr_blocks ? DMA_BUS_MEM(&sd_cbs[k + 1]) : 0;
     }
+    dc_clean_range(sd_cbs, r->nr_blocks * sizeof(struct dma_cb));
+    dma_start(SD_DMA_CHAN, sd_cbs);
+}
 
-    resp = _sd_wait_for_interrupt(INT_DATA_DONE);
-    asserts(!resp, "\tEMMC ERROR: Timeout waiting for data done.\n");
+/*
+ * Wait for the DMA channel to drain after data done and drop the stale cache lines of what it read.
+ * Called from the SD tasklet without the queue lock, r is still the active request.
+ */
+static int
+_sd_dma_finish(struct blk_request* r)
+{
+    if (dma_wait(SD_DMA_CHAN))
+        return SD_ERROR;
+    if (!r->write) {
+        for (uint32_t k = 0; k < r->nr_blocks; k++) {
+            dc_flush_range(blk_rq_buf(r, k)->data, BSIZE);
+        }
+    }
+    r->xfer = r->nr_blocks;
+    return SD_OK;
 }
 
 /*
- * The interrupt handler.
+ * Request queue hook, send the command of r and let sd_intr() or the DMA channel move its blocks.
+ * Called with the queue lock held.
  */
-void
-sd_intr()
+static void
+_sd_start_request(struct request_queue* q, struct blk_request* r)
 {
-    int i = *EMMC_INTERRUPT;
-    if (!(i & INT_DATA_DONE)) {
-        cprintf("\tsd_intr: Unexpected SD interrupt: %d\n", i);
-        return;
+    if (sd_dma)
+        _sd_dma_start(r);
+    int resp = _sd_start(r->blockno, r->nr_blocks, r->write);
+    if (resp) {
+        // No data phase follows a failed command, nothing else will complete the request
+        if (sd_dma)
+            dma_abort(SD_DMA_CHAN);
+        *EMMC_INTERRUPT = *EMMC_INTERRUPT;
+        blk_end_request(q, resp);
     }
-    *EMMC_INTERRUPT = i;  // Clear interrupt
-    disb();
 }
 
 /*
- * Sync buf with disk.
- * If BUF_DIRTY is set, write buf to disk, clear BUF_DIRTY, set BUF_VALID.
- * Else if BUF_VALID is not set, read buf from disk, set BUF_VALID.
+ * The interrupt handler, only acknowledges the controller and leaves the rest to the tasklet.
+ * The card raises the next ready interrupt only once the tasklet has moved the block it is ready for.
  */
 void
-sd_rw(struct buf *b)
+sd_intr()
 {
-    //acquire_sleep_lock(&b->lock);
-    _sd_start(b);
-    b->flags &= ~BUF_DIRTY;
-    b->flags |= BUF_VALID;
-    //brelease(b);
+    uint32_t i = *EMMC_INTERRUPT;
+    *EMMC_INTERRUPT = i;
+    __atomic_fetch_or(&sd_irq_pending, i, __ATOMIC_RELEASE);
+    tasklet_schedule(&sd_tasklet);
 }
 
-/*  
- * SD card test and benchmark
+/*
+ * Handle the interrupt bits i of the active request.
+ * Moves a block through the FIFO every time the card is ready for the next one,
+ * and completes the request on data done, after the last block and the auto CMD12 of a multi-block transfer.
+ * Completing it starts the next request, whose command is polled for, so this must not run in the hard handler.
  */
-void
-sd_test()
+static void
+_sd_handle(uint32_t i)
 {
-    static struct buf b[1 << 11];
-    int n = sizeof(b) / sizeof(b[0]);
-    int mb = (n * BSIZE) >> 20;
-    assert(mb);
-
-    int64_t f, t;
-    asm volatile("mrs %[freq], cntfrq_el0" : [freq] "=r"(f));
-    cprintf("sd_test: begin nblocks %d\n", n);
-
-    cprintf("sd_test: sd check rw...\n");
-    // Read / write test
-    for (int i = 1; i < n; i++) {
-        // Backup
-        b[0].flags = 0;
-        b[0].blockno = i;
-        bpin(&b[0]);
-        sd_rw(&b[0]);
-
-        // Write some value
-        b[i].flags = BUF_DIRTY;
-        b[i].blockno = i;
-        bpin(&b[i]);
-        for (int j = 0; j < BSIZE; j++) b[i].data[j] = i * j & 0xFF;
-        sd_rw(&b[i]);
-
-        memset(b[i].data, 0, sizeof(b[i].data));
-
-        // Read back and check
-        b[i].flags = 0;
-        bpin(&b[i]);
-        sd_rw(&b[i]);
-
-        for (int j = 0; j < BSIZE; j++) assert(b[i].data[j] == (i * j & 0xFF));
-
-        // Restore previous value
-        b[0].flags = BUF_DIRTY;
-        bpin(&b[0]);
-        sd_rw(&b[0]);
+    acquire_spin_lock(&sd_queue.lock);
+    struct blk_request* r = sd_queue.active;
+    if (r == NULL) {
+        cprintf("\tsd_intr: Unexpected SD interrupt: 0x%x\n", i);
+        release_spin_lock(&sd_queue.lock);
+        return;
     }
 
-    // Read benchmark
-    disb();
-    t = timestamp();
-    disb();
-
-    for (int i = 0; i < n; i++) {
-        b[i].flags = 0;
-        b[i].blockno = i;
-        bpin(&b[i]);
-        sd_rw(&b[i]);
+    // Otherwise the command of the active request is still on its way, or the card is busy
+    if (!sd_dma && !(i & (INT_ERROR_MASK | INT_CMD_TIMEOUT)) && r->xfer < r->nr_blocks) {
+        if (!r->write && (i & INT_READ_RDY))
+            _sd_read_fifo(blk_rq_buf(r, r->xfer++));
+        else if (r->write && (i & INT_WRITE_RDY))
+            _sd_write_fifo(blk_rq_buf(r, r->xfer++));
     }
 
-    disb();
-    t = timestamp() - t;
-    disb();
+    if (i & (INT_ERROR_MASK | INT_CMD_TIMEOUT)) {
+        cprintf(
+            "\tsd_intr: EMMC error 0x%x on block %d of %d at %d, status 0x%x.\n", i,
+            r->xfer, r->nr_blocks, r->blockno, *EMMC_STATUS);
+        if (sd_dma)
+            dma_abort(SD_DMA_CHAN);
+        blk_end_request(&sd_queue, SD_ERROR);
+    } else if (i & INT_DATA_DONE) {
+        disb();
+        if (sd_dma) {
+            // r stays active and only this tasklet completes it, so the channel can be drained
+            // and up to BLK_MAX_BLOCKS blocks of cache flushed with interrupts enabled
+            release_spin_lock(&sd_queue.lock);
+            int resp = _sd_dma_finish(r);
+            acquire_spin_lock(&sd_queue.lock);
+            if (resp) {
+                blk_end_request(&sd_queue, SD_ERROR);
+                release_spin_lock(&sd_queue.lock);
+                return;
+            }
+        }
+        for (uint32_t k = 0; k < r->nr_blocks; k++) {
+            struct buf* b = blk_rq_buf(r, k);
+            b->flags &= ~BUF_DIRTY;
+            b->flags |= BUF_VALID;
+        }
+        blk_end_request(&sd_queue, r->xfer == r->nr_blocks ? SD_OK : SD_ERROR);
+    }
+    release_spin_lock(&sd_queue.lock);
+}
 
-    cprintf(
-        "sd_test: read %lld B (%lld MB), t: %lld cycles, speed: %lld.%lld MB/s\n",
-        n * BSIZE, mb, t, mb * f / t, (mb * f * 10 / t) % 10);
+/*
+ * SD tasklet, handle what sd_intr() acknowledged, including what it acknowledges meanwhile
+ */
+static void
+_sd_tasklet_fn(uint64_t data)
+{
+    uint32_t i;
+    while ((i = __atomic_exchange_n(&sd_irq_pending, 0, __ATOMIC_ACQUIRE)) != 0) {
+        _sd_handle(i);
+    }
+}
 
-    // Write benchmark
-    disb();
-    t = timestamp();
-    disb();
+/*
+ * Sync buf with sector b->blockno + start of the card by polling the controller, while sd_init() reads the MBR
+ */
+static void
+_sd_rw_polled(struct buf* b, uint32_t start)
+{
+    bool write = b->flags & BUF_DIRTY;
+    int resp = _sd_start(b->blockno + start, 1, write);
+    asserts(!resp, "\tEMMC ERROR: Send command error.\n");
+    resp = _sd_wait_for_interrupt(write ? INT_WRITE_RDY : INT_READ_RDY);
+    asserts(!resp, "\tEMMC ERROR: Timeout waiting for ready to transfer.\n");
+    asserts(
+        !*EMMC_INTERRUPT,
+        "\tEMMC ERROR: Interrupt flag should be empty: 0x%x\n",
+        *EMMC_INTERRUPT);
+    if (write)
+        _sd_write_fifo(b);
+    else
+        _sd_read_fifo(b);
+    resp = _sd_wait_for_interrupt(INT_DATA_DONE);
+    asserts(!resp, "\tEMMC ERROR: Timeout waiting for data done.\n");
+    b->flags &= ~BUF_DIRTY;
+    b->flags |= BUF_VALID;
+}
 
-    for (int i = 0; i < n; i++) {
-        b[i].flags = BUF_DIRTY;
-        b[i].blockno = i;
-        bpin(&b[i]);
-        sd_rw(&b[i]);
+/*
+ * Block device submit of the card and its partitions, bufs[i] holds sector bufs[i]->blockno + start.
+ * Once interrupt mode is on consecutive blocks are moved by one command,
+ * and the caller sleeps until sd_intr() is done with all of them, so it must be a process.
+ */
+static void
+_sd_submit(struct block_device* disk, struct buf** bufs, int n, uint32_t start)
+{
+    if (!sd_irq_mode) {
+        for (int i = 0; i < n; ++i) {
+            _sd_rw_polled(bufs[i], start);
+        }
+        return;
     }
+    int resp = blk_submit_list(&sd_queue, bufs, n, start);
+    asserts(!resp, "\tEMMC ERROR: Transfer of %d blocks from %d failed: %d\n", n, bufs[0]->blockno + start, resp);
+}
 
-    disb();
-    t = timestamp() - t;
-    disb();
+/*
+ * Sync buf with sector b->blockno of the whole card.
+ * If BUF_DIRTY is set, write buf to disk, clear BUF_DIRTY, set BUF_VALID.
+ * Else if BUF_VALID is not set, read buf from disk, set BUF_VALID.
+ * Once interrupt mode is on the caller sleeps until sd_intr() is done with b, so it must be a process.
+ */
+void
+sd_rw(struct buf *b)
+{
+    _sd_submit(sd_disk, &b, 1, 0);
+}
 
-    cprintf(
-        "sd_test: write %lld B (%lld MB), t: %lld cycles, speed: %lld.%lld MB/s\n",
-        n * BSIZE, mb, t, mb * f / t, (mb * f * 10 / t) % 10);
+/*
+ * Block device hook, fill in the request statistics of the SD card
+ */
+static void
+_sd_stat(struct block_device* disk, struct blkstat* st)
+{
+    blk_stat(&sd_queue, st);
+}
+
+/*
+ * Block device hook, switch the I/O scheduler of the SD card
+ */
+static int
+_sd_set_scheduler(struct block_device* disk, const char* name)
+{
+    return blk_set_elevator(&sd_queue, name);
 }
 
 static int
@@ -13,6 +13,7 @@
 #define SD_H
 
 #include "buffer/buf.h"
+#include "block/blk.h"
 
 #define SD_OK              0
 #define SD_ERROR           1
@@ -32,6 +33,7 @@
 
 /**
  * @brief Initialize SD card and parse MBR.
+ * The card is registered as block device "sd" and the partitions of the MBR as "sd1" to "sd4".
  * @retval None
  */
 void sd_init();
@@ -43,17 +45,11 @@ void sd_init();
 void sd_intr();
 
 /**
- * @brief Sync buf with disk.
+ * @brief Sync buf with sector b->blockno of the whole card, the buffer cache goes through blkdev_submit() instead.
  * If BUF_DIRTY is set, write buf to disk, clear BUF_DIRTY, set BUF_VALID.
  * Else if BUF_VALID is not set, read buf from disk, set BUF_VALID.
  * @retval None
  */
 void sd_rw(struct buf *);
 
-/**
- * @brief SD card test and benchmark
- * @retval None
- */
-void sd_test();
-
 #endif /* SD_H */
\ No newline at end of file
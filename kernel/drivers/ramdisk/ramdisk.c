@@ -0,0 +1,89 @@
+/**
+ * @file ramdisk.c
+ * @author ylp
+ * @brief RAM disk, a block device kept in kernel pages
+ * @version 0.1
+ * @date 2022-06-26
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "ramdisk.h"
+#include "include/param.h"
+#include "block/blkdev.h"
+#include "memory/kalloc.h"
+#include "sync/spinlock.h"
+#include "lib/string.h"
+#include "printf.h"
+
+#define RAMDISK_PER_PAGE    (PGSIZE / BSIZE)
+#define RAMDISK_PAGES       ((RAMDISK_SECTORS + RAMDISK_PER_PAGE - 1) / RAMDISK_PER_PAGE)
+
+static struct {
+    struct spinlock lock;           // Protects page[] while a page is allocated
+    char *page[RAMDISK_PAGES];      // NULL until a sector of it is written, reads of it find zeros
+} ramdisk;
+
+/*
+ * Page holding sector blockno, allocated if alloc is set
+ */
+static char *ramdisk_page(uint32_t blockno, bool alloc)
+{
+    char **slot = &ramdisk.page[blockno / RAMDISK_PER_PAGE];
+    char *page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (page != NULL || !alloc)
+        return page;
+
+    char *new = kalloc(PGSIZE);
+    if (new == NULL)
+        panic("ramdisk: out of memory for sector %d.\n", blockno);
+    memset(new, 0, PGSIZE);
+    acquire_spin_lock(&ramdisk.lock);
+    page = *slot;
+    if (page == NULL) {
+        __atomic_store_n(slot, new, __ATOMIC_RELEASE);
+        page = new;
+        new = NULL;
+    }
+    release_spin_lock(&ramdisk.lock);
+    if (new != NULL)
+        kfree(new);
+    return page;
+}
+
+/*
+ * Copy the bufs to or from memory, done before it returns
+ */
+static void ramdisk_submit(struct block_device *disk, struct buf **bufs, int n, uint32_t start)
+{
+    for (int i = 0; i < n; i++) {
+        struct buf *b = bufs[i];
+        uint32_t blockno = b->blockno + start;
+        uint32_t off = (blockno % RAMDISK_PER_PAGE) * BSIZE;
+        if (b->flags & BUF_DIRTY) {
+            memmove(ramdisk_page(blockno, true) + off, b->data, BSIZE);
+            b->flags &= ~BUF_DIRTY;
+        } else {
+            char *page = ramdisk_page(blockno, false);
+            if (page != NULL)
+                memmove(b->data, page + off, BSIZE);
+            else
+                memset(b->data, 0, BSIZE);
+        }
+        b->flags |= BUF_VALID;
+    }
+}
+
+static const struct block_device_ops ramdisk_ops = {
+    .submit = ramdisk_submit,
+};
+
+/*
+ * Register the RAM disk
+ */
+void ramdisk_init(void)
+{
+    init_spin_lock(&ramdisk.lock, "ramdisk");
+    blkdev_add_disk("ram0", BSIZE, RAMDISK_SECTORS, &ramdisk_ops, &ramdisk);
+}
@@ -0,0 +1,22 @@
+/**
+ * @file ramdisk.h
+ * @author ylp
+ * @brief RAM disk, a block device kept in kernel pages
+ * @version 0.1
+ * @date 2022-06-26
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+/**
+ * @brief Register the RAM disk "ram0" of RAMDISK_SECTORS sectors, all of them zero.
+ * Its pages are allocated as it is written to
+ * @retval None
+ */
+void ramdisk_init(void);
+
+#endif /* RAMDISK_H */
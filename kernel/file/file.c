@@ -19,8 +19,11 @@
 #include "../pipe/pipe.h"
 
 struct devsw devsw[NDEV];
+// The lock only protects the free list, references are counted atomically. A closed file goes back to the
+// free list after an rcu grace period, so fileget() never takes a reference to a reused slot.
 struct ftable {
     struct spinlock lock;
+    struct file *free_list;
     struct file file[NFILE];
 } ftable;
 
@@ -30,27 +33,44 @@ struct ftable {
 void file_init(void)
 {
     init_spin_lock(&ftable.lock, "ftable");
+    ftable.free_list = NULL;
+    for (struct file *f = ftable.file + NFILE - 1; f >= ftable.file; f--) {
+        init_sleep_lock(&f->pos_lock, "file_pos");
+        f->next_free = ftable.free_list;
+        ftable.free_list = f;
+    }
 }
 
 /*
  * Allocate a file structure.
- * Scan the Ftable for the first free slot and return the new reference.  
+ * Take the first slot of the free list and return the new reference.  
  * When the maximum number of open files is reached, 
  * filealloc simply returns NULL and does not panic.
  */
 struct file *filealloc(void)
 {
     acquire_spin_lock(&ftable.lock);
-    for (struct file *f = ftable.file; f < ftable.file + NFILE; f++) { 
-        if (f->ref == 0) { 
-            f->ref = 1;
-            release_spin_lock(&ftable.lock);
-            return f;
-        }
+    struct file *f = ftable.free_list;
+    if (f != NULL) {
+        ftable.free_list = f->next_free;
+        f->next_free = NULL;
+        __atomic_store_n(&f->ref, 1, __ATOMIC_RELEASE);
     }
     release_spin_lock(&ftable.lock);
     // don't panic when run out of files
-    return NULL;
+    return f;
+}
+
+/*
+ * Put a file back on the free list once no lockless lookup can see it any more
+ */
+static void file_free_rcu(struct rcu_head *head)
+{
+    struct file *f = container_of(head, struct file, rcu);
+    acquire_spin_lock(&ftable.lock);
+    f->next_free = ftable.free_list;
+    ftable.free_list = f;
+    release_spin_lock(&ftable.lock);
 }
 
 /*
@@ -59,32 +79,51 @@ struct file *filealloc(void)
  */
 struct file *filedup(struct file *f)
 {
-    acquire_spin_lock(&ftable.lock);
-    if (f->ref < 1)
-        panic("filedup: ref: %d.\n", f->ref);
-    f->ref++;
-    release_spin_lock(&ftable.lock);
+    int ref = __atomic_fetch_add(&f->ref, 1, __ATOMIC_RELAXED);
+    if (ref < 1)
+        panic("filedup: ref: %d.\n", ref);
+    return f;
+}
+
+/*
+ * Take a reference to the file stored at *fp without locks, NULL if there is none or it is being closed
+ * The slot is read under rcu, so the file it points to can not have been put back on the free list yet.
+ */
+struct file *fileget(struct file **fp)
+{
+    rcu_read_lock();
+    struct file *f = rcu_dereference(*fp);
+    if (f != NULL) {
+        // Only take a reference while somebody else still holds one
+        int ref = __atomic_load_n(&f->ref, __ATOMIC_RELAXED);
+        do {
+            if (ref == 0) {
+                f = NULL;
+                break;
+            }
+        } while (!__atomic_compare_exchange_n(&f->ref, &ref, ref + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    }
+    rcu_read_unlock();
     return f;
 }
 
 /*
  * Close specified files (Decrement ref count, close when reaches 0.)
+ * The slot is not reused before a grace period has elapsed, fileget() may still be looking at it.
  */
 void fileclose(struct file *f)
 {
-    acquire_spin_lock(&ftable.lock);
-    if (f->ref < 1)
-        panic("fileclose: ref: %d.\n", f->ref);
+    int ref = __atomic_sub_fetch(&f->ref, 1, __ATOMIC_ACQ_REL);
+    if (ref < 0)
+        panic("fileclose: ref: %d.\n", ref + 1);
     
-    if (--f->ref > 0) {
-        release_spin_lock(&ftable.lock);
+    if (ref > 0) {
         return;
     }
 
     struct file ff = *f;
-    f->ref = 0;
     f->type = FD_NONE;
-    release_spin_lock(&ftable.lock);
+    call_rcu(&f->rcu, file_free_rcu);
 
     // Releases the underlying pipe or inode, according to the type.
     if (ff.type == FD_PIPE) {
@@ -105,9 +144,9 @@ void fileclose(struct file *f)
 int32_t filestat(struct file *f, struct stat *st)
 {
     if (f->type == FD_INODE || f->type == FD_DEVICE) {
-        ilock(f->ip);
+        ilock_shared(f->ip);
         stati(f->ip, st);
-        iunlock(f->ip);
+        iunlock_shared(f->ip);
         return 0;
     }
     return -1;
@@ -137,11 +176,16 @@ int32_t fileread(struct file *f, char *addr, int32_t n)
             return -1;
         r = devsw[f->major].read(addr, n);
     } else if (f->type == FD_INODE) { 
-        ilock(f->ip);
+        // Readers of the inode run concurrently, so the offset of this open file needs its own lock
+        acquire_sleep_lock(&f->pos_lock);
+        ilock_shared(f->ip);
         // If the file represents an inode,fileread and filewrite use the I/O offset as the offset for the operation and then advance it
-        if ((r = readi(f->ip, addr, f->off, n)) > 0)
+        if ((r = readi(f->ip, addr, f->off, n)) > 0) {
+            file_readahead(f->ip, &f->ra, f->off, r);
             f->off += r;
-        iunlock(f->ip);
+        }
+        iunlock_shared(f->ip);
+        release_sleep_lock(&f->pos_lock);
     } else { 
         panic("unsupported file type: %d.\n", f->type);
     }
@@ -185,10 +229,12 @@ int32_t filewrite(struct file *f, char *addr, int32_t n)
                 if(n1 > max)
                     n1 = max;
                 begin_op();
+                acquire_sleep_lock(&f->pos_lock);
                 ilock(f->ip);
                 if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
                     f->off += r;
                 iunlock(f->ip);
+                release_sleep_lock(&f->pos_lock);
                 end_op();
                 if (r != n1)
                     break;
@@ -13,7 +13,9 @@
 #define FILE_H
 
 #include "../fs/fs.h"
+#include "../fs/readahead.h"
 #include "../sync/sleeplock.h"
+#include "../sync/rcu.h"
 
 /*
  * File structure, some of the following fields may be able to use union, implement first and then worry about optimization
@@ -21,13 +23,17 @@
  */
 struct file {
     enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
-    int ref;                // reference count
+    int ref;                // reference count, changed atomically, a file with ref 0 can not be picked up again
     char readable;          // Whether the file can be read
     char writable;          // Whether the file can be writtens
     struct pipe *pipe;      // FD_PIPE
     struct inode *ip;       // FD_INODE and FD_DEVICE
     size_t off;             // File offset for FD_INODE  
+    struct sleeplock pos_lock;  // Serializes the reads and writes that move off, the inode lock may be shared
+    struct file_ra ra;      // FD_INODE read-ahead state, protected by pos_lock
     int16_t major;          // FD_DEVICE
+    struct file *next_free; // Free list of the file table, protected by its lock
+    struct rcu_head rcu;    // Returns the file to the free list after the last lockless lookup is done with it
 };
 
 #define major(dev)  ((dev)>>16 & 0xFFFF)
@@ -69,6 +75,14 @@ struct file *filedup(struct file *f);
  */
 void fileclose(struct file *f);
 
+/**
+ * @brief  Take a reference to the file stored at *fp without locks, for descriptor lookups
+ * A file that is being closed concurrently is not returned.
+ * @param  **fp: Slot of a descriptor table, which may change at any time
+ * @retval A referenced file to be released with fileclose(), or NULL
+ */
+struct file *fileget(struct file **fp);
+
 /**
  * @brief  Get metadata about file f.
  * @param  file*: A pointer to file structure
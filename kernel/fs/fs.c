@@ -21,6 +21,7 @@
 #include "../include/param.h"
 #include "../printf.h"
 #include "../proc/proc.h"
+#include "../block/blkdev.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static struct inode *iget(uint32_t dev, uint32_t inum);
@@ -118,8 +119,12 @@ static void bfree(int dev, uint32_t b)
 void iinit()
 {
     init_spin_lock(&itable.lock, "itable");
-    for (int i = 0; i < NINODE; i++) {
-        init_sleep_lock(&itable.inode[i].lock, "inode");
+    itable.free_list = NULL;
+    itable.npending = 0;
+    for (int i = NINODE - 1; i >= 0; i--) {
+        init_rw_sleep_lock(&itable.inode[i].lock, "inode");
+        itable.inode[i].next_free = itable.free_list;
+        itable.free_list = &itable.inode[i];
     }
 }
 
@@ -172,41 +177,116 @@ void iupdate(struct inode *ip)
     brelease(bp);
 }
 
+/*
+ * Hash bucket of the inode inum of device dev
+ */
+static inline struct inode **inode_bucket(uint32_t dev, uint32_t inum)
+{
+    return &itable.hash[(dev * 31 + inum) % NINODEHASH];
+}
+
+/*
+ * Take a reference to a cached inode unless it is being recycled
+ */
+static bool inode_get_ref(struct inode *ip)
+{
+    int ref = __atomic_load_n(&ip->ref, __ATOMIC_RELAXED);
+    do {
+        if (ref < 0)
+            return false;
+    } while (!__atomic_compare_exchange_n(&ip->ref, &ref, ref + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    return true;
+}
+
+/*
+ * Return a recycled slot to the free list once no lockless lookup can be walking through it
+ */
+static void inode_free_rcu(struct rcu_head *head)
+{
+    struct inode *ip = container_of(head, struct inode, rcu);
+    acquire_spin_lock(&itable.lock);
+    ip->next_free = itable.free_list;
+    itable.free_list = ip;
+    itable.npending--;
+    release_spin_lock(&itable.lock);
+}
+
+/*
+ * Take cached inodes nobody refers to out of the hash, they become free after a grace period
+ * itable.lock must be held. Returns the number of inodes recycled.
+ */
+static int inode_evict(int n)
+{
+    int evicted = 0;
+    for (int b = 0; b < NINODEHASH && evicted < n; b++) {
+        for (struct inode **pp = &itable.hash[b]; *pp != NULL && evicted < n; ) {
+            struct inode *ip = *pp;
+            int ref = 0;
+            // A lockless iget() may be taking a reference at the same time, whoever changes ref first wins
+            if (__atomic_compare_exchange_n(&ip->ref, &ref, -1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                // Readers on ip still follow ip->hash_next to the rest of the bucket
+                rcu_assign_pointer(*pp, ip->hash_next);
+                itable.npending++;
+                call_rcu(&ip->rcu, inode_free_rcu);
+                evicted++;
+            } else {
+                pp = &ip->hash_next;
+            }
+        }
+    }
+    return evicted;
+}
+
 /*
  * Find the inode with number inum on device dev
  * and return the in-memory copy. Does not lock
  * the inode and does not read it from disk.
  * iget() provides non-exclusive access to an inode, 
  * so that there can be many pointers to the same inode
+ * A cached inode is found through the hash under rcu without the table lock. A slot leaves the hash
+ * before it is reused for another inode and only comes back after a grace period, so a reader never
+ * sees a slot change identity under it.
  */
 static struct inode * iget(uint32_t dev, uint32_t inum)
 {
-    acquire_spin_lock(&itable.lock);
-    struct inode *empty = NULL;
-    struct inode *ip = NULL;
-    // Is the inode already cached?
-    for (ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ++ip) {
-        // Check the icache cache to see if it is already cached
-        if (ip->ref > 0 && ip->dev == dev && ip->inum == inum) {
-            ip->ref++;
+    struct inode *ip;
+
+    rcu_read_lock();
+    for (ip = rcu_dereference(*inode_bucket(dev, inum)); ip != NULL; ip = rcu_dereference(ip->hash_next)) {
+        if (ip->dev == dev && ip->inum == inum && inode_get_ref(ip)) {
+            rcu_read_unlock();
+            return ip;
+        }
+    }
+    rcu_read_unlock();
+
+    while (1) {
+        acquire_spin_lock(&itable.lock);
+        // Another process may have cached it meanwhile, hashed inodes are not being recycled while we hold the lock
+        for (ip = *inode_bucket(dev, inum); ip != NULL; ip = ip->hash_next) {
+            if (ip->dev == dev && ip->inum == inum) {
+                __atomic_fetch_add(&ip->ref, 1, __ATOMIC_RELAXED);
+                release_spin_lock(&itable.lock);
+                return ip;
+            }
+        }
+        if ((ip = itable.free_list) != NULL) {
+            itable.free_list = ip->next_free;
+            ip->dev = dev;
+            ip->inum = inum;
+            ip->valid = 0;
+            ip->ref = 1;
+            ip->hash_next = *inode_bucket(dev, inum);
+            rcu_assign_pointer(*inode_bucket(dev, inum), ip);
             release_spin_lock(&itable.lock);
             return ip;
         }
-        // Find the first empty icache slot
-        if (empty == NULL && ip->ref == 0)
-            empty = ip;
+        // Recycle a batch of unused inode cache entries and wait for them to become free.
+        if (inode_evict(NINODE / 8) == 0 && itable.npending == 0)
+            panic("iget: no available inodes.\n");
+        release_spin_lock(&itable.lock);
+        synchronize_rcu();
     }
-    // Recycle an inode cache entry.
-    if (empty == NULL)
-        panic("iget: no available inodes.\n");
-    // Empty is the first empty slot in the icache 
-    ip = empty;
-    ip->dev = dev;
-    ip->inum = inum;
-    ip->ref = 1;
-    ip->valid = 0;
-    release_spin_lock(&itable.lock);
-    return ip;
 }
 
 /*
@@ -214,30 +294,18 @@ static struct inode * iget(uint32_t dev, uint32_t inum)
  */
 struct inode *idup(struct inode *ip)
 {
-    acquire_spin_lock(&itable.lock);
-    ip->ref++;
-    release_spin_lock(&itable.lock);
+    __atomic_fetch_add(&ip->ref, 1, __ATOMIC_RELAXED);
     return ip;
 }
 
 /*
- * Lock the given inode.
- * Reads the inode from disk if necessary.
- * The struct inode that iget returns may not have any useful content. 
- * In order to ensure it holds a copy of the on-disk inode, code must call ilock. 
- * This locks the inode (so that no other process can ilock it) and reads the inode from the disk, if it has not already been read.
- * Multiple processes can hold a C pointer to an inode returned by iget, but only one process can lock the inode at a time.
+ * Read the inode from disk if it has not already been read, ip->lock must be held exclusive
  */
-void ilock(struct inode *ip)
+static void iload(struct inode *ip)
 {
     struct buf *bp;
     struct dinode *dip;
 
-    if (ip == NULL || ip->ref < 1)
-        panic("ilock");
-
-    acquire_sleep_lock(&ip->lock);
-
     // The inode pointer just obtained from iget is valid=0
     if (ip->valid == 0) {
         bp = bread(ip->dev, IBLOCK(ip->inum, sb[0]));
@@ -255,20 +323,67 @@ void ilock(struct inode *ip)
     }
 }
 
+/*
+ * Lock the given inode.
+ * Reads the inode from disk if necessary.
+ * The struct inode that iget returns may not have any useful content. 
+ * In order to ensure it holds a copy of the on-disk inode, code must call ilock. 
+ * This locks the inode (so that no other process can ilock it) and reads the inode from the disk, if it has not already been read.
+ * Multiple processes can hold a C pointer to an inode returned by iget, but only one process can lock the inode at a time.
+ */
+void ilock(struct inode *ip)
+{
+    if (ip == NULL || ip->ref < 1)
+        panic("ilock");
+
+    acquire_rw_sleep_lock_exclusive(&ip->lock);
+    iload(ip);
+}
+
 /*
  * Unlock the given inode.
  */
 void iunlock(struct inode *ip)
 {
-    if (ip == NULL || !is_current_cpu_holing_sleep_lock(&ip->lock) || ip->ref < 1)
+    if (ip == NULL || !is_current_proc_holding_rw_sleep_lock_exclusive(&ip->lock) || ip->ref < 1)
         panic("ilock.\n");
 
-    release_sleep_lock(&ip->lock);
+    release_rw_sleep_lock_exclusive(&ip->lock);
+}
+
+/*
+ * Lock the given inode shared, for readi(), stati() and dirlookup() only.
+ * Several processes reading the same file or directory hold it at the same time. Reading the 
+ * inode from disk changes it, so the first user takes the lock exclusive and downgrades it.
+ */
+void ilock_shared(struct inode *ip)
+{
+    if (ip == NULL || ip->ref < 1)
+        panic("ilock_shared");
+
+    acquire_rw_sleep_lock_shared(&ip->lock);
+    if (ip->valid == 0) {
+        release_rw_sleep_lock_shared(&ip->lock);
+        acquire_rw_sleep_lock_exclusive(&ip->lock);
+        iload(ip);
+        downgrade_rw_sleep_lock(&ip->lock);
+    }
+}
+
+/*
+ * Unlock the given inode locked with ilock_shared().
+ */
+void iunlock_shared(struct inode *ip)
+{
+    if (ip == NULL || !is_rw_sleep_lock_held(&ip->lock) || ip->ref < 1)
+        panic("iunlock_shared.\n");
+
+    release_rw_sleep_lock_shared(&ip->lock);
 }
 
 /*
  * Truncate inode (discard contents).
- * Caller must hold ip->lock.
+ * Caller must hold ip->lock exclusive.
  * truncate the file to zero bytes, freeing the data blocks 
  * sets the inode type to 0 ，and writes the inode to disk
  */
@@ -309,7 +424,7 @@ void iput(struct inode *ip)
     acquire_spin_lock(&itable.lock);
     if (ip->ref == 1 && ip->valid && ip->nlink == 0) {
         // The inode on disk is released only if ref = 0 and nlink = 0, no pointer or directory entry refers to the inode
-        acquire_sleep_lock(&ip->lock);
+        acquire_rw_sleep_lock_exclusive(&ip->lock);
         release_spin_lock(&itable.lock);
 
         itrunc(ip);
@@ -317,10 +432,11 @@ void iput(struct inode *ip)
         iupdate(ip);
         ip->valid = 0;
 
-        release_sleep_lock(&ip->lock);
+        release_rw_sleep_lock_exclusive(&ip->lock);
         acquire_spin_lock(&itable.lock);
     }
-    ip->ref--;
+    // iget() may be adding references without the lock, and inode_evict() needs to see 0 to recycle the slot
+    __atomic_fetch_sub(&ip->ref, 1, __ATOMIC_RELEASE);
     release_spin_lock(&itable.lock);
 }
 
@@ -372,9 +488,20 @@ static uint32_t bmap(struct inode *ip, uint32_t bn)
     return -1;
 }
 
+/*
+ * Disk block of block bn of ip, for read-ahead
+ * Caller must hold ip->lock, shared is enough, and bn must be below the size of the file so that nothing is allocated.
+ */
+uint32_t ibmap(struct inode *ip, uint32_t bn)
+{
+    if (bn >= (ip->size + BSIZE - 1) / BSIZE)
+        panic("ibmap: block %d is beyond the end of the file.\n", bn);
+    return bmap(ip, bn);
+}
+
 /*
  * Copy stat information from inode.
- * Caller must hold ip->lock.
+ * Caller must hold ip->lock, shared is enough.
  */
 void stati(struct inode *ip, struct stat *st)
 {
@@ -386,7 +513,8 @@ void stati(struct inode *ip, struct stat *st)
 }
 
 /*
- * Read data from inode. Caller must hold ip->lock.
+ * Read data from inode. Caller must hold ip->lock, shared is enough.
+ * bmap() does not allocate here, the blocks below ip->size all exist.
  */
 int readi(struct inode *ip, char *dst, uint32_t offset, uint32_t n)
 {
@@ -408,7 +536,7 @@ int readi(struct inode *ip, char *dst, uint32_t offset, uint32_t n)
 }
 
 /*
- * Write data to inode. Caller must hold ip->lock.
+ * Write data to inode. Caller must hold ip->lock exclusive.
  * If the file grows, update its inode size information
  */
 int writei(struct inode *ip, char *src, uint32_t offset, uint32_t n)
@@ -422,7 +550,7 @@ int writei(struct inode *ip, char *src, uint32_t offset, uint32_t n)
     uint32_t tot = 0, m = 0;
     for (tot = 0; tot < n; tot += m, offset += m, src += m) {
         struct buf *bp = bread(ip->dev, bmap(ip, offset / BSIZE));
-        m = min(n - tot, BSIZE - offset / BSIZE);
+        m = min(n - tot, BSIZE - offset % BSIZE);
         memmove(bp->data + offset % BSIZE, src, m);
         // The cache block is modified, and the update is written to the log
         log_write(bp);
@@ -446,7 +574,7 @@ int namecmp(const char *s, const char *t)
 }
 
 /*
- * Look for a directory entry in a directory.
+ * Look for a directory entry in a directory. Caller must hold dp->lock, shared is enough.
  * If found, set *poff to byte offset of entry.
  */
 struct inode *dirlookup(struct inode *dp, char *name, uint32_t *poff)
@@ -471,7 +599,7 @@ struct inode *dirlookup(struct inode *dp, char *name, uint32_t *poff)
 }
 
 /*
- * Write a new directory entry (name, inum) into the directory dp.
+ * Write a new directory entry (name, inum) into the directory dp. Caller must hold dp->lock exclusive.
  */
 int dirlink(struct inode *dp, char *name, uint32_t inum)
 {
@@ -545,27 +673,28 @@ static char* skipelem(char *path, char *name)
 static struct inode *namex(char *path, int nameiparent, char *name)
 {
     // Decide where to start, starting with the root directory if there is a '/', or the current directory otherwise 
-    struct inode *ip = (*path == '/') ? iget(ROOTDEV, ROOTINO) : idup(myproc()->cwd);
+    struct inode *ip = (*path == '/') ? iget(rootdev, ROOTINO) : proc_cwd(myproc());
     // uses skipelem to consider each element of the path in turn
     while ((path = skipelem(path, name)) != 0) {
-        ilock(ip);
+        // Lookups only read the directories, so walks through the same directories run side by side
+        ilock_shared(ip);
         // Check whether the ip address of the current node is a directory
         if (ip->type != T_DIR) {
-            iunlock(ip);
+            iunlock_shared(ip);
             return NULL;
         }
         if (nameiparent && *path == '\0') {
             // path='\0' indicates that name is the last element
-            iunlock(ip);
+            iunlock_shared(ip);
             return ip;
         }
         struct inode *next = dirlookup(ip, name, 0);
         if (next == NULL) {
             // Cannot be found under current directory node
-            iunlock(ip);
+            iunlock_shared(ip);
             return NULL;
         }
-        iunlock(ip);
+        iunlock_shared(ip);
         ip = next;
     }
     if (nameiparent) {
@@ -17,6 +17,8 @@
 #include "../include/stdint.h"
 #include "../include/param.h"
 #include "../sync/sleeplock.h"
+#include "../sync/rwsleeplock.h"
+#include "../sync/rcu.h"
 #include "../include/stat.h"
 
 #define ROOTINO       1                                     // root inode number
@@ -68,8 +70,11 @@ struct dinode {
 struct inode {
     uint32_t dev;           // device number
     uint32_t inum;          // inode number
-    int ref;                // reference count, The number of Pointers in memory to this inode
-    struct sleeplock lock;  // Protects everything below here
+    int ref;                // reference count, The number of Pointers in memory to this inode, -1 while the slot is being recycled
+    struct inode *hash_next;    // Next inode in the hash bucket of the inode table, read under rcu
+    struct inode *next_free;    // Free list of the inode table
+    struct rcu_head rcu;        // Puts the slot on the free list after a grace period
+    struct rwsleeplock lock; // Protects everything below here, shared for readi/stati/dirlookup, exclusive to change the inode
     int valid;              // inode has been read from disk?
     // copy of disk inode
     uint16_t type;
@@ -84,7 +89,10 @@ struct inode {
  * The cache used to cache inodes 
  */
 struct itable {
-    struct spinlock lock;       // The spin lock is used to protect the icache cache
+    struct spinlock lock;       // The spin lock is used to protect the icache cache, lookups of cached inodes go without it under rcu
+    struct inode *hash[NINODEHASH]; // Cached inodes by (dev, inum), changed under the lock and read under rcu
+    struct inode *free_list;    // Slots that are in no hash bucket and that no rcu reader can see
+    int npending;               // Slots taken out of the hash that wait for a grace period to become free
     struct inode inode[NINODE]; // Each inode's sleep lock is used to protect each inode's information
 };
 
@@ -118,6 +126,21 @@ void ilock(struct inode *ip);
  */
 void iunlock(struct inode *ip);
 
+/**
+ * @brief  Lock the given inode shared, for readi(), stati() and dirlookup() only.
+ * Reads the inode from disk if necessary. Other readers may hold it at the same time.
+ * @param  *ip: Pointer to an in-memory inode.
+ * @retval None
+ */
+void ilock_shared(struct inode *ip);
+
+/**
+ * @brief  Unlock the given inode locked with ilock_shared().
+ * @param  *ip: Pointer to an in-memory inode.
+ * @retval None
+ */
+void iunlock_shared(struct inode *ip);
+
 /**
  * @brief   Allocates an inode on disk, Mark it as allocated by giving it type type
  * @param  dev: Devvice number
@@ -151,6 +174,14 @@ void stati(struct inode *ip, struct stat *st);
  */
 int readi(struct inode *ip, char *dst, uint32_t offset, uint32_t n);
 
+/**
+ * @brief  Disk block of a block of the file, which must be below its size. Caller must hold ip->lock, shared is enough.
+ * @param  *ip: Pointer to an in-memory inode.
+ * @param  bn: Block of the file
+ * @retval Disk block number
+ */
+uint32_t ibmap(struct inode *ip, uint32_t bn);
+
 /**
  * @brief  Write data to inode. Caller must hold ip->lock, If the file grows, update its inode size information
  * @param  *ip: Pointer to an in-memory inode.
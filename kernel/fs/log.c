@@ -37,11 +37,13 @@ struct log {
     int32_t commiting;      // Is it being submitted, in commit(), please wait.
     int32_t dev;
     struct logheader lh;
+    struct logheader committed; // Installed into the cache, the header on disk still holds it until checkpoint()
 };
 
 struct log log;
 static void recover_fromlog(void);
 static void commit(void);
+static void checkpoint(void);
 
 /*
  * What it does is it reads information about the logging system from the superblock, 
@@ -64,9 +66,12 @@ void initlog(int dev, struct superblock *sb)
 /*
  * Copy committed blocks from log to their home location
  * reads each block from the log and writes it to the proper place in the file system
+ * Except when recovering, the blocks are only marked dirty, the flusher or checkpoint() writes them back.
  */
 static void install_trans(int recovering)
 {
+    struct buf *batch[BUF_BATCH];
+    int n = 0;
     for (int32_t tail = 0; tail < log.lh.n; tail++) {
         // read log block
         struct buf *lbuf = bread(log.dev, log.start + tail + 1);
@@ -74,14 +79,24 @@ static void install_trans(int recovering)
         struct buf *dbuf = bread(log.dev, log.lh.block[tail]);
         // copy block to dst
         memmove(dbuf->data, lbuf->data, BSIZE);
-        // write dst to disk
-        bwrite(dbuf);  
-        // In log_write, bpin the corresponding Cache block. Here we bunpin it, so after this, the Cache block can be recycled by the Buffer Cache 
-        if (recovering == 0) {
+        brelease(lbuf);
+        if (recovering) {
+            // write dst to disk, a batch at a time
+            batch[n++] = dbuf;
+            if (n == BUF_BATCH || tail == log.lh.n - 1) {
+                bwrite_list(batch, n);
+                while (n > 0) {
+                    brelease(batch[--n]);
+                }
+            }
+        } else {
+            // The transaction has committed, dst may reach the disk whenever the flusher gets to it
+            dbuf->flags &= ~BUF_LOGGED;
+            bdwrite(dbuf);
+            // In log_write, bpin the corresponding Cache block. Here we bunpin it, so after this, the Cache block can be recycled by the Buffer Cache once it is clean
             bunpin(dbuf);
+            brelease(dbuf);
         }
-        brelease(lbuf);
-        brelease(dbuf);
     }
 }
 
@@ -100,20 +115,20 @@ static void read_head(void)
 }
 
 /*
- * Write logHeader in memory to disk
+ * Write logHeader lh to disk
  * This is the true point at which the
  * current transaction commits.
  */
-static void write_head(void)
+static void write_head(struct logheader *lh)
 {
     // Get the logheader cache block from bread
     struct buf *buf = bread(log.dev, log.start);
     struct logheader *hb = (struct logheader *)(buf->data);
     // Update n for logheader on disk
-    hb->n = log.lh.n;
+    hb->n = lh->n;
     // Update the block number for each log block(data block)
-    for (int32_t i = 0; i < log.lh.n; ++i) {
-        hb->block[i] = log.lh.block[i];
+    for (int32_t i = 0; i < lh->n; ++i) {
+        hb->block[i] = lh->block[i];
     }
     // Write the updated logheader back to disk
     // From here, the transaction commit is actually complete, so the crash that started here can be recovered 
@@ -136,7 +151,7 @@ static void recover_fromlog(void)
     install_trans(1);
     // clear the log
     log.lh.n = 0;
-    write_head(); 
+    write_head(&log.lh); 
 }
 
 /*
@@ -200,9 +215,12 @@ void end_op(void)
 /*
  * Copy modified blocks from cache to log.
  * copies each block modified in the transaction from the buffer cache to its slot in the log on disk.
+ * The log area is consecutive, so BUF_BATCH log blocks go out in one command.
  */
 static void write_log(void)
 {
+    struct buf *batch[BUF_BATCH];
+    int n = 0;
     for (int32_t tail = 0; tail < log.lh.n; tail++) {
         // Read the disk blocks of the log area sequentially from disk, with an extra 1 to skip the logheader 
         struct buf *to = bread(log.dev, log.start + tail + 1);
@@ -210,34 +228,97 @@ static void write_log(void)
         struct buf *from = bread(log.dev, log.lh.block[tail]);
         // Copy from from to to With memmove, both cache block copies are now in the updated state 
         memmove(to->data, from->data, BSIZE);
-        // Write the updated logged block back to the log area of the disk
-        bwrite(to);
-        // When both cache blocks are used, call brelse to update the lis
         brelease(from);
-        brelease(to);
+        // Write the updated logged blocks back to the log area of the disk
+        batch[n++] = to;
+        if (n == BUF_BATCH || tail == log.lh.n - 1) {
+            bwrite_list(batch, n);
+            while (n > 0) {
+                brelease(batch[--n]);
+            }
+        }
+    }
+}
+
+/*
+ * Make sure the home locations of the committed transaction are on disk, then erase it from the log
+ * The flusher has usually written them back by now. A block the running transaction modified again can not be
+ * written from the cache, its committed copy is written from the log area instead.
+ */
+static void checkpoint(void)
+{
+    struct buf *batch[BUF_BATCH];
+    int n = 0;
+    if (log.committed.n == 0)
+        return;
+    for (int32_t tail = 0; tail < log.committed.n; tail++) {
+        struct buf *dbuf = bread(log.dev, log.committed.block[tail]);
+        if ((dbuf->flags & BUF_DIRTY) && (dbuf->flags & BUF_LOGGED)) {
+            struct buf *lbuf = bread(log.dev, log.start + tail + 1);
+            bwrite_to(lbuf, log.committed.block[tail]);
+            brelease(lbuf);
+            brelease(dbuf);
+        } else if (dbuf->flags & BUF_DIRTY) {
+            batch[n++] = dbuf;
+        } else {
+            brelease(dbuf);
+        }
+        if (n == BUF_BATCH || (tail == log.committed.n - 1 && n > 0)) {
+            bwrite_list(batch, n);
+            while (n > 0) {
+                brelease(batch[--n]);
+            }
+        }
     }
+    // Erase the transaction from the log, The updated n=0 is written to disk's logheader, so the old log is released/reused 
+    log.committed.n = 0;
+    write_head(&log.committed);
 }
 
 /*
  * Commit a log operation
+ * The home locations are written back later, the previous transaction is only erased from the log
+ * right before this one overwrites the log area.
  */
 static void commit(void)
 {
     if (log.lh.n > 0) {
+        checkpoint();
         // Write modified blocks from cache to log
         write_log();
         // Write header to disk -- the real commit
         // this is the commit point, and a crash after the write will result in recovery replaying the transaction’s writes from the log
-        write_head();
+        write_head(&log.lh);
         // Add checkpoint
         install_trans(0);
-        // By the time n=0 is reset here, the checkpoint has been successfully completed, but n=0 has not yet been written to disk's logheader 
+        // The header on disk keeps the transaction until the next commit or log_sync() checkpoints it
+        log.committed = log.lh;
         log.lh.n = 0;
-        // Erase the transaction from the log, The updated n=0 is written to disk's logheader, so the old log is released/reused 
-        write_head();
     }
 }
 
+/*
+ * Force everything out to disk: the dirty buffers, then the erased log
+ * Waits for the running transaction to commit and keeps new ones from starting meanwhile.
+ */
+void log_sync(void)
+{
+    acquire_spin_lock(&log.lock);
+    while (log.commiting || log.outstanding > 0) {
+        sleep(&log, &log.lock);
+    }
+    log.commiting = 1;
+    release_spin_lock(&log.lock);
+
+    bsync();
+    checkpoint();
+
+    acquire_spin_lock(&log.lock);
+    log.commiting = 0;
+    wakeup(&log);
+    release_spin_lock(&log.lock);
+}
+
 /*
  * Caller has modified b->data and is done with the buffer.
  * Record the block number and pin in the cache by increasing refcnt.
@@ -262,9 +343,9 @@ void log_write(struct buf *b)
             break;
         }
     }
-    // TODO: A temporary solution
-    const uint32_t LBA = 0x20800; 
-    log.lh.block[i] = b->blockno - LBA;
+    log.lh.block[i] = b->blockno;
+    // Keeps the flusher from writing it to its home location before the transaction commits
+    b->flags |= BUF_LOGGED;
     if (i == log.lh.n) {
         // pins the buffer in the block cache to prevent the block cache from evicting it
         bpin(b);
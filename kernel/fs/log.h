@@ -44,4 +44,10 @@ void begin_op(void);
  */
 void end_op(void);
 
+/**
+ * @brief  Force the dirty buffers and the committed transaction out to disk
+ * @retval None
+ */
+void log_sync(void);
+
 #endif /* LOG_H */
\ No newline at end of file
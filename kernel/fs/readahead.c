@@ -0,0 +1,153 @@
+/**
+ * @file readahead.c
+ * @author ylp
+ * @brief Sequential read-ahead of file blocks into the buffer cache
+ * A reader that keeps reading where it left off gets the blocks after its position read into the cache by
+ * the kreadahead thread, so that it finds them there instead of waiting for the SD card one block at a time.
+ * The window starts at READAHEAD_MIN blocks and doubles on every sequential read up to the knob.
+ * @version 0.1
+ * @date 2022-06-20
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "readahead.h"
+#include "buffer/buf.h"
+#include "proc/workqueue.h"
+#include "sync/spinlock.h"
+#include "printf.h"
+#include "include/util.h"
+#include "include/kernel.h"
+
+#define NRAREQ  8       // Read-ahead requests in flight
+
+/*
+ * Blocks to read ahead, handed to the kreadahead thread
+ * They are resolved to disk blocks by the reader, so the request does not depend on the file or the inode.
+ */
+struct ra_req {
+    struct work_struct work;
+    uint32_t dev;
+    uint32_t n;
+    uint32_t blocks[READAHEAD_MAX];
+    struct ra_req *next_free;
+};
+
+static struct {
+    struct spinlock lock;
+    struct ra_req req[NRAREQ];
+    struct ra_req *free_list;   // Protected by the lock
+    uint32_t max;               // The knob, largest window in blocks
+} ra;
+
+static struct workqueue_struct ra_wq;
+
+/*
+ * Read the blocks of a request into the cache and give the request back
+ */
+static void ra_work(struct work_struct *work)
+{
+    struct ra_req *req = container_of(work, struct ra_req, work);
+    breadahead(req->dev, req->blocks, req->n);
+    acquire_spin_lock(&ra.lock);
+    req->next_free = ra.free_list;
+    ra.free_list = req;
+    release_spin_lock(&ra.lock);
+}
+
+/*
+ * Reset the read-ahead state of a newly opened file
+ */
+void file_ra_init(struct file_ra *ra)
+{
+    ra->next = 0;
+    ra->ahead = 0;
+    ra->window = 0;
+}
+
+/*
+ * Queue the read of file blocks [start, end) of ip
+ * Dropped if every request is in flight already, the reader is far enough behind then.
+ */
+static void ra_submit(struct inode *ip, uint32_t start, uint32_t end)
+{
+    acquire_spin_lock(&ra.lock);
+    struct ra_req *req = ra.free_list;
+    if (req != NULL)
+        ra.free_list = req->next_free;
+    release_spin_lock(&ra.lock);
+    if (req == NULL)
+        return;
+
+    req->dev = ip->dev;
+    req->n = 0;
+    for (uint32_t bn = start; bn < end; ++bn) {
+        req->blocks[req->n++] = ibmap(ip, bn);
+    }
+    queue_work(&ra_wq, &req->work);
+}
+
+/*
+ * Account a read of n bytes at offset of ip and read the next window ahead if it is sequential
+ * The next window is requested once the reader is half way into the current one, so that it arrives in time.
+ */
+void file_readahead(struct inode *ip, struct file_ra *ra_state, uint32_t offset, uint32_t n)
+{
+    uint32_t max = __atomic_load_n(&ra.max, __ATOMIC_RELAXED);
+    uint32_t first = offset / BSIZE;
+    uint32_t next = (offset + n) / BSIZE;
+    if (first == ra_state->next && max > 0) {
+        // Sequential, the first read at offset 0 counts as one
+        if (ra_state->window == 0)
+            ra_state->window = MIN(READAHEAD_MIN, max);
+    } else {
+        ra_state->window = 0;
+        ra_state->ahead = next;
+    }
+    ra_state->next = next;
+    if (ra_state->window == 0)
+        return;
+
+    uint32_t start = MAX(ra_state->ahead, next);
+    if (start - next >= ra_state->window / 2)
+        return;
+    // The reader got into what was read ahead for it, so read further ahead next time
+    if (start > next)
+        ra_state->window = MIN(ra_state->window * 2, max);
+    uint32_t end = MIN(next + ra_state->window, (ip->size + BSIZE - 1) / BSIZE);
+    end = MIN(end, start + READAHEAD_MAX);
+    if (start >= end)
+        return;
+    ra_state->ahead = end;
+    ra_submit(ip, start, end);
+}
+
+/*
+ * Set the largest read-ahead window, returns the previous one
+ */
+int32_t readahead_set_max(int32_t blocks)
+{
+    if (blocks > READAHEAD_MAX)
+        return -1;
+    if (blocks < 0)
+        return __atomic_load_n(&ra.max, __ATOMIC_RELAXED);
+    return __atomic_exchange_n(&ra.max, blocks, __ATOMIC_RELAXED);
+}
+
+/*
+ * Start the read-ahead work queue
+ */
+void readahead_init(void)
+{
+    init_spin_lock(&ra.lock, "readahead");
+    ra.max = READAHEAD_MAX;
+    ra.free_list = NULL;
+    for (int i = 0; i < NRAREQ; ++i) {
+        INIT_WORK(&ra.req[i].work, ra_work);
+        ra.req[i].next_free = ra.free_list;
+        ra.free_list = &ra.req[i];
+    }
+    if (init_workqueue(&ra_wq, "kreadahead") < 0)
+        panic("readahead_init: can not start the read-ahead work queue.\n");
+}
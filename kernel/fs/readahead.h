@@ -0,0 +1,58 @@
+/**
+ * @file readahead.h
+ * @author ylp
+ * @brief Sequential read-ahead of file blocks into the buffer cache
+ * @version 0.1
+ * @date 2022-06-20
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include "include/stdint.h"
+#include "fs.h"
+
+/*
+ * Read-ahead state of an open file, protected by the pos_lock of the file
+ */
+struct file_ra {
+    uint32_t next;          // Block a sequential read would start at
+    uint32_t ahead;         // Blocks below it have been read or read ahead
+    uint32_t window;        // Blocks read ahead at a time, 0 while the reads are not sequential
+};
+
+/**
+ * @brief  Reset the read-ahead state of a newly opened file
+ * @param  *ra: Read-ahead state
+ * @retval None
+ */
+void file_ra_init(struct file_ra *ra);
+
+/**
+ * @brief  Account a read of n bytes at offset of ip and read the next window ahead if it is sequential.
+ * Caller must hold ip->lock, shared is enough.
+ * @param  *ip: The inode that was read
+ * @param  *ra: Read-ahead state of the open file
+ * @param  offset: Start of the read
+ * @param  n: Bytes read
+ * @retval None
+ */
+void file_readahead(struct inode *ip, struct file_ra *ra, uint32_t offset, uint32_t n);
+
+/**
+ * @brief  Set the largest read-ahead window, the knob
+ * @param  blocks: At most READAHEAD_MAX, 0 turns read-ahead off, negative only queries
+ * @retval The previous largest window
+ */
+int32_t readahead_set_max(int32_t blocks);
+
+/**
+ * @brief  Start the read-ahead work queue, Called once at boot
+ * @retval None
+ */
+void readahead_init(void);
+
+#endif /* READAHEAD_H */
@@ -13,18 +13,33 @@
 #define PARAM_H
 
 #define NCPU        4        // the number of cpu
-#define NPROC       64       // Maximum number of processes
+#define NPIDHASH    64       // Number of PID hash buckets, processes are allocated on demand
+#define NPROCINFO   1024     // The most processes one procinfo() call reports
+#define NFUTEXHASH  31       // Number of futex wait queue hash buckets
+#define LOCKSTAT             // Gather lock contention statistics, comment out to compile them out
+#define NLOCKCLASS  64       // Maximum number of lock classes (distinct lock names) with statistics
+#define SLEEPLOCK_SPIN_US 50 // How long a sleep lock waiter spins on an owner running on another CPU before sleeping
+#define SCHED_MIGRATE_IMBALANCE 2   // Running and runnable processes a CPU must be ahead of an idle one before they are pulled away
 #define NOFILE      16       // Maximum number of files that can be opened by each process
 #define KSTACKSIZE  4096     // The size of the kernel stack per process
 
 #define MAXOPBLOCKS 10       // The maximum number of blocks allowed per transaction
-#define NBUF        (MAXOPBLOCKS * 3) // Buffer Size
+#define NBUF        (MAXOPBLOCKS * 3) // Buffers allocated at boot, the fewest the buffer cache shrinks to
+#define NBUF_MAX    16384   // The most buffers the buffer cache grows to
+#define BCACHE_MEM_DIV 8    // The buffer cache may grow to 1/BCACHE_MEM_DIV of the memory free at boot
+#define BFLUSH_INTERVAL 5   // Ticks between two runs of the buffer flusher
+#define BDIRTY_EXPIRE 30    // Ticks a buffer may stay dirty before the flusher writes it back
+#define BDIRTY_RATIO 20     // Percent of the buffers that may be dirty before the flusher writes the oldest back
+#define READAHEAD_MIN 4     // Blocks read ahead once a file is read sequentially
+#define READAHEAD_MAX 32    // The most blocks read ahead at a time, the default of the knob
 #define LOGSIZE     (MAXOPBLOCKS * 3)
 
 #define NINODE      50      // Maximum number of active inodes
+#define NINODEHASH  31      // Number of hash buckets of the inode table
 #define NFILE       100     // Maximum number of files that can be opened by the operating system
 #define NDEV        10      // Maximum number of devices
-#define ROOTDEV     1       // device number of file system root disk
+#define RAMDISK_SECTORS 8192    // Size of the RAM disk ram0, 4 MB
+#define ROOTDEV_NAME "sd2"  // block device holding the file system root, the second partition of the SD card
 #define MAXARG      32      // max exec arguments
 #define INPUT_BUF   128
 
@@ -0,0 +1,78 @@
+/**
+ * @file percpu.h
+ * @author ylp
+ * @brief Per-CPU variables, refer to the Linux kernel source code include/linux/percpu-defs.h (5.10.0)
+ * @version 0.1
+ * @date 2022-06-06
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include "stdint.h"
+#include "param.h"
+#include "arch/aarch64/arm.h"
+#include "sync/spinlock.h"
+
+/*
+ * Per-CPU variables are placed in the .percpu section, which linker.ld follows with room for NCPU - 1 more copies
+ * of it, the Makefile hands NCPU to the linker. The address of a variable is the one of CPU 0's copy, and the copy of CPU n is n * PERCPU_SIZE further.
+ * TPIDR_EL1 holds the offset of this CPU's copy, set up by percpu_init().
+ * Every copy starts zeroed with the rest of .bss, so per-CPU variables can not have initializers.
+ * Each copy starts on a cache line of its own, so CPUs updating their own copy never share a line.
+ */
+#define DEFINE_PER_CPU(type, name)  __attribute__((section(".percpu"))) __typeof__(type) name
+#define DECLARE_PER_CPU(type, name) extern __attribute__((section(".percpu"))) __typeof__(type) name
+
+extern char __per_cpu_start[], __per_cpu_end[];
+
+#define PERCPU_SIZE     ((uint64_t)(__per_cpu_end - __per_cpu_start))
+
+/*
+ * Pointer to CPU cpu's copy of the per-CPU variable ptr points to
+ */
+#define per_cpu_ptr(ptr, cpu)   ((__typeof__(ptr))((char *)(ptr) + (uint64_t)(cpu) * PERCPU_SIZE))
+#define per_cpu(var, cpu)       (*per_cpu_ptr(&(var), cpu))
+
+/*
+ * Pointer to this CPU's copy, one MRS and one ADD. Interrupts must be disabled for the pointer to stay this CPU's
+ * after the call, otherwise the process may be moved to another CPU meanwhile.
+ */
+#define this_cpu_ptr(ptr)       ((__typeof__(ptr))((char *)(ptr) + r_tpidr_el1()))
+
+/*
+ * Read-modify-write this CPU's copy with interrupts disabled, so that neither an interrupt handler
+ * nor a migration to another CPU can come between the read and the write
+ */
+#define this_cpu_add(var, n)        \
+do {                                \
+    push_off();                     \
+    *this_cpu_ptr(&(var)) += (n);   \
+    pop_off();                      \
+} while (0)
+
+#define this_cpu_inc(var)   this_cpu_add(var, 1)
+
+/*
+ * Sum of the copies of a per-CPU counter over all CPUs, the CPUs may be updating them meanwhile
+ */
+#define per_cpu_sum(var)                                                \
+({                                                                      \
+    __typeof__(var) __sum = 0;                                          \
+    for (int __cpu = 0; __cpu < NCPU; __cpu++)                          \
+        __sum += __atomic_load_n(per_cpu_ptr(&(var), __cpu), __ATOMIC_RELAXED); \
+    __sum;                                                              \
+})
+
+/*
+ * Point TPIDR_EL1 at this CPU's copy of the per-CPU area, Called first thing by every CPU
+ */
+static inline void percpu_init(uint64_t cpu)
+{
+    l_tpidr_el1(cpu * PERCPU_SIZE);
+}
+
+#endif /* PERCPU_H */
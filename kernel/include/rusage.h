@@ -0,0 +1,52 @@
+/**
+ * @file rusage.h
+ * @author ylp
+ * @brief Resource usage reported to user space by getrusage, procinfo and cpuinfo
+ * @version 0.1
+ * @date 2022-05-18
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef RUSAGE_H
+#define RUSAGE_H
+
+#include "stdint.h"
+
+/*
+ * Resource usage of a process, times in microseconds
+ */
+struct rusage {
+	uint64_t utime;         // Time spent in user space
+	uint64_t stime;         // Time spent in the kernel
+	uint64_t wait_time;     // Time spent runnable waiting for a CPU
+	uint64_t nvcsw;         // Voluntary context switches, the process blocked
+	uint64_t nivcsw;        // Involuntary context switches, the process was preempted or yielded
+	uint64_t nr_migrations; // Number of times the process was moved to another CPU
+};
+
+/*
+ * One entry of the process list
+ */
+struct procinfo {
+	int pid;
+	int state;              // enum process_state
+	int last_cpu;           // CPU the process last ran on, -1 if it never ran
+	int kthread;            // Non-zero for a kernel thread
+	char name[16];
+	struct rusage ru;
+};
+
+/*
+ * Time accounting of a CPU, times in microseconds
+ */
+struct cpuinfo {
+	uint64_t clock;         // Time since boot when the entry was filled in
+	uint64_t utime;         // Time spent running user space
+	uint64_t stime;         // Time spent in the kernel on behalf of processes
+	uint64_t idle_time;     // Time spent in the scheduler with nothing to run
+	uint64_t nr_switches;   // Number of switches to a process
+};
+
+#endif /* RUSAGE_H */
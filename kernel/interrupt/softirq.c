@@ -0,0 +1,161 @@
+/**
+ * @file softirq.c
+ * @author ylp
+ * @brief Softirqs and tasklets, the deferred halves of interrupt handlers, refer to the Linux kernel source code
+ * kernel/softirq.c (5.10.0)
+ * @version 0.1
+ * @date 2022-06-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "softirq.h"
+#include "interrupt.h"
+#include "include/percpu.h"
+
+/*
+ * Hard interrupt handlers only acknowledge the device and raise a softirq or schedule a tasklet.
+ * The softirqs run on the way out of the outermost interrupt, with interrupts enabled again, so the
+ * time spent with interrupts masked stays short. An interrupt that comes in meanwhile only raises
+ * more softirqs, which the running do_softirq() picks up.
+ */
+static void (*softirq_vec[NR_SOFTIRQS])(void);
+
+struct tasklet_head {
+    struct tasklet_struct *head;
+    struct tasklet_struct **tail;
+};
+
+// Only touched by their CPU with interrupts disabled
+static DEFINE_PER_CPU(uint32_t, softirq_pending);      // Raised softirqs, bit nr for vector nr
+static DEFINE_PER_CPU(int, softirq_running);           // Is do_softirq() running on this CPU?
+static DEFINE_PER_CPU(struct tasklet_head, tasklet_vec);
+
+/*
+ * Install the handler of a softirq vector
+ */
+void open_softirq(int nr, void (*action)(void))
+{
+    softirq_vec[nr] = action;
+}
+
+/*
+ * Mark a softirq pending on this CPU
+ */
+void raise_softirq(int nr)
+{
+    *this_cpu_ptr(&softirq_pending) |= 1U << nr;
+}
+
+/*
+ * Whether this CPU is running softirqs
+ */
+bool in_softirq(void)
+{
+    return *this_cpu_ptr(&softirq_running) != 0;
+}
+
+/*
+ * Run the pending softirqs, Interrupts are disabled on entry and on return
+ * The handlers run with interrupts enabled but can not sleep, so we stay on this CPU throughout.
+ */
+static void do_softirq(void)
+{
+    int *running = this_cpu_ptr(&softirq_running);
+    uint32_t *pending = this_cpu_ptr(&softirq_pending);
+    *running = 1;
+    for (int restart = 0; restart < MAX_SOFTIRQ_RESTART && *pending; restart++) {
+        uint32_t todo = *pending;
+        *pending = 0;
+        enable_interrupt();
+        for (int nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if ((todo & (1U << nr)) && softirq_vec[nr])
+                softirq_vec[nr]();
+        }
+        disable_interrupt();
+    }
+    // Whatever is still pending runs at the next interrupt
+    *running = 0;
+}
+
+/*
+ * Called when an interrupt handler is done with the device, runs the pending softirqs
+ */
+void irq_exit(void)
+{
+    if (!in_softirq() && *this_cpu_ptr(&softirq_pending))
+        do_softirq();
+}
+
+/*
+ * Initialize a tasklet
+ */
+void tasklet_init(struct tasklet_struct *t, void (*func)(uint64_t), uint64_t data)
+{
+    t->next = NULL;
+    t->state = 0;
+    t->func = func;
+    t->data = data;
+}
+
+/*
+ * Schedule a tasklet to run on this CPU, unless it is scheduled already
+ */
+void tasklet_schedule(struct tasklet_struct *t)
+{
+    push_off();
+    if (!(__atomic_fetch_or(&t->state, TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL) & TASKLET_STATE_SCHED)) {
+        struct tasklet_head *vec = this_cpu_ptr(&tasklet_vec);
+        t->next = NULL;
+        *vec->tail = t;
+        vec->tail = &t->next;
+        raise_softirq(TASKLET_SOFTIRQ);
+    }
+    pop_off();
+}
+
+/*
+ * Run the tasklets scheduled on this CPU
+ * A tasklet running on another CPU is put back and tried again, so the same tasklet never runs twice at once.
+ */
+static void tasklet_action(void)
+{
+    disable_interrupt();
+    struct tasklet_head *vec = this_cpu_ptr(&tasklet_vec);
+    struct tasklet_struct *list = vec->head;
+    vec->head = NULL;
+    vec->tail = &vec->head;
+    enable_interrupt();
+
+    while (list) {
+        struct tasklet_struct *t = list;
+        list = list->next;
+        if (!(__atomic_fetch_or(&t->state, TASKLET_STATE_RUN, __ATOMIC_ACQUIRE) & TASKLET_STATE_RUN)) {
+            // Clear SCHED first, the tasklet may be scheduled again while it runs
+            __atomic_fetch_and(&t->state, ~TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL);
+            t->func(t->data);
+            __atomic_fetch_and(&t->state, ~TASKLET_STATE_RUN, __ATOMIC_RELEASE);
+            continue;
+        }
+        disable_interrupt();
+        t->next = NULL;
+        *vec->tail = t;
+        vec->tail = &t->next;
+        raise_softirq(TASKLET_SOFTIRQ);
+        enable_interrupt();
+    }
+}
+
+/*
+ * Install the tasklet softirq and set up the tasklet queue of every CPU
+ */
+void softirq_init(void)
+{
+    for (int i = 0; i < NCPU; i++) {
+        struct tasklet_head *vec = per_cpu_ptr(&tasklet_vec, i);
+        vec->head = NULL;
+        vec->tail = &vec->head;
+    }
+    open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+}
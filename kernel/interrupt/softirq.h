@@ -0,0 +1,95 @@
+/**
+ * @file softirq.h
+ * @author ylp
+ * @brief Softirqs and tasklets, the deferred halves of interrupt handlers, refer to the Linux kernel source code
+ * include/linux/interrupt.h (5.10.0)
+ * @version 0.1
+ * @date 2022-06-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Softirq vectors, run in this order
+ */
+enum {
+    TIMER_SOFTIRQ,      // Wake up the processes sleeping on ticks
+    TASKLET_SOFTIRQ,    // Run the tasklets scheduled on this CPU
+    NR_SOFTIRQS
+};
+
+#define MAX_SOFTIRQ_RESTART 10  // Rounds of newly raised softirqs do_softirq() handles before leaving them to the next interrupt
+
+/*
+ * A tasklet is deferred work of a driver, run in softirq context on the CPU that scheduled it.
+ * Scheduling it again before it ran has no effect, and it never runs on two CPUs at the same time.
+ */
+struct tasklet_struct {
+    struct tasklet_struct *next;    // Next tasklet scheduled on the same CPU
+    uint64_t state;                 // TASKLET_STATE_* bits
+    void (*func)(uint64_t data);
+    uint64_t data;
+};
+
+#define TASKLET_STATE_SCHED     (1 << 0)    // Scheduled, not run yet
+#define TASKLET_STATE_RUN       (1 << 1)    // Running on some CPU
+
+/**
+ * @brief  Install the handler of a softirq vector
+ * @param  nr: Softirq vector
+ * @param  action: Handler, runs with interrupts enabled and must not sleep
+ * @retval None
+ */
+void open_softirq(int nr, void (*action)(void));
+
+/**
+ * @brief  Mark a softirq pending on this CPU, it runs when the current interrupt handler returns. Interrupts must be disabled
+ * @param  nr: Softirq vector
+ * @retval None
+ */
+void raise_softirq(int nr);
+
+/**
+ * @brief  Called when an interrupt handler is done with the device, runs the pending softirqs with interrupts
+ * enabled unless the interrupt came in while softirqs were running already
+ * @retval None
+ */
+void irq_exit(void);
+
+/**
+ * @brief  Whether this CPU is running softirqs, or an interrupt that came in while it was
+ * Code in softirq context must not sleep and the scheduler must not preempt it.
+ * @retval true in softirq context
+ */
+bool in_softirq(void);
+
+/**
+ * @brief  Initialize a tasklet
+ * @param  *t: The tasklet
+ * @param  func: Work to do, called with data
+ * @param  data: Argument of func
+ * @retval None
+ */
+void tasklet_init(struct tasklet_struct *t, void (*func)(uint64_t), uint64_t data);
+
+/**
+ * @brief  Schedule a tasklet to run on this CPU, Called from interrupt handlers
+ * @param  *t: The tasklet
+ * @retval None
+ */
+void tasklet_schedule(struct tasklet_struct *t);
+
+/**
+ * @brief  Install the tasklet softirq, Called once at boot
+ * @retval None
+ */
+void softirq_init(void);
+
+#endif /* SOFTIRQ_H */
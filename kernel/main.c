@@ -14,18 +14,27 @@
 #include "memory/kalloc.h"
 #include "proc/proc.h"
 #include "interrupt/interrupt.h"
+#include "arch/aarch64/board/raspi3/irq.h"
 #include "arch/aarch64/timer.h"
 #include "file/file.h"
 #include "buffer/buf.h"
+#include "block/blkdev.h"
 #include "drivers/mmc/sd.h"
+#include "drivers/ramdisk/ramdisk.h"
 #include "lib/string.h"
+#include "sync/futex.h"
+#include "sync/rcu.h"
+#include "interrupt/softirq.h"
+#include "proc/workqueue.h"
+#include "fs/readahead.h"
 
-extern void irq_init();
 extern char edata[], edata_end[];
 
 __attribute__((noreturn))
 void main() 
 {
+    // Before anything takes a lock, which needs mycpu()
+    init_this_cpu();
     if (cpuid() == 0) {
         // Initialize .bss section data to zero
         memset(edata, 0, edata_end - edata);
@@ -39,8 +48,16 @@ void main()
         alloc_init();
         // Initialize the process management subsystem
         proc_init();
+        // Initialize the futex wait queues
+        futex_init();
+        // Initialize the rcu grace period state
+        rcu_init();
+        // Initialize the deferred halves of interrupt handlers
+        softirq_init();
         // Initialize Interrupt exception subsystem, Load base address of EL1's exception vector table to vbar_el1
         exception_handler_init();
+        // Trap the first FP/SIMD use of user processes
+        fpsimd_init();
         // Initialize board level interrupt controller
         irq_init();
         // Initialize the Arm Generic Timer
@@ -49,18 +66,29 @@ void main()
         enable_interrupt();
         // Initialize the system buffer cache
         binit();
+        // Initialize the registry of block devices
+        blkdev_init();
         // Initialize SD card and parse MBR
         sd_init();
+        // Register the RAM disk
+        ramdisk_init();
         // initialize the inode table
         iinit();
         // initialize the kernel file table
         file_init();
         // Initialize the init process 
         init_user();
+        // Start the system work queue thread
+        workqueue_init();
+        // Start the buffer cache flusher thread
+        bflush_init();
+        // Start the read-ahead thread
+        readahead_init();
         // Wake up other cores
         init_awake_ap_by_spintable();
     } else {
         exception_handler_init();
+        fpsimd_init();
         timer_init();
         enable_interrupt();
     }
@@ -41,6 +41,7 @@ struct zone {
 
 struct zone zone;
 struct spinlock alloc_lock;
+static struct shrinker *shrinkers;
 
 /*
  * Initialize memory management system
@@ -198,8 +199,41 @@ static inline struct page* _rm_smallest(order_t order)
     return NULL;
 }
 
+/*
+ * Number of free pages
+ */
+uint64_t kalloc_available_pages(void)
+{
+    return __atomic_load_n(&zone.available_pages, __ATOMIC_RELAXED);
+}
+
+/*
+ * Ask a cache to give memory back when kalloc runs out
+ * The list only grows, so kalloc walks it without a lock
+ */
+void register_shrinker(struct shrinker *shrinker)
+{
+    acquire_spin_lock(&alloc_lock);
+    shrinker->next = shrinkers;
+    __atomic_store_n(&shrinkers, shrinker, __ATOMIC_RELEASE);
+    release_spin_lock(&alloc_lock);
+}
+
+/*
+ * Ask the shrinkers for nr_pages pages, returns how many they freed
+ */
+static uint64_t shrink_caches(uint64_t nr_pages)
+{
+    uint64_t freed = 0;
+    for (struct shrinker *s = __atomic_load_n(&shrinkers, __ATOMIC_ACQUIRE); s != NULL && freed < nr_pages; s = s->next) {
+        freed += s->scan(nr_pages - freed);
+    }
+    return freed;
+}
+
 /* 
  * Memory allocation function in kernel
+ * When out of memory the caches are shrunk once before giving up.
  * Returns the start virtual address assigned. 
  * NULL indicates that the assignment failed.
  */
@@ -214,9 +248,14 @@ void *kalloc(size_t size)
     
     struct page *page;
     pg_idx_t pg_idx;
-    acquire_spin_lock(&alloc_lock);
-    if (kalloc_pages(&page, &pg_idx,pages_n) != 0)
-        return NULL;
+    for (int shrunk = 0; ; shrunk = 1) {
+        acquire_spin_lock(&alloc_lock);
+        if (kalloc_pages(&page, &pg_idx,pages_n) == 0)
+            break;
+        release_spin_lock(&alloc_lock);
+        if (shrunk || shrink_caches(pages_n) == 0)
+            return NULL;
+    }
 
     release_spin_lock(&alloc_lock);
     return (void *)PA2VA(PFn2PHY(pg_idx));
@@ -239,11 +278,11 @@ int kalloc_pages(struct page **page, pg_idx_t *pfn, int pages_n)
     struct page *_page;
     pg_idx_t _pfn;
     _page = _rm_smallest(order);
+    if(_page == NULL)
+        return -1;
     set_page_order(_page,order);
     set_page_used(_page);
     _pfn = _page - pages;
-    if(_page == NULL)
-        return -1;
 
     *page = _page;
     *pfn = _pfn;
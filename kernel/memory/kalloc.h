@@ -15,6 +15,14 @@
 #include <stddef.h>
 #include "memory.h"
 
+/*
+ * A cache that gives pages back when kalloc runs out of memory
+ */
+struct shrinker {
+    uint64_t (*scan)(uint64_t nr_pages);    // Free about nr_pages pages, returns how many it freed
+    struct shrinker *next;
+};
+
 /**
  * @brief  Initialize memory management system
  * @retval None
@@ -28,6 +36,21 @@ void alloc_init(void);
  */
 void log_alloc_system_info(void);
 
+/**
+ * @brief  Number of free pages
+ * @retval The pages the buddy system has on its free lists
+ */
+uint64_t kalloc_available_pages(void);
+
+/**
+ * @brief  Ask a cache to give memory back when kalloc runs out.
+ * The scan function is called without any kalloc lock held and must not call kalloc.
+ * Its caller may hold its own proc lock, so scan must not sleep, take proc locks or call wakeup
+ * @param  *shrinker: Registered for good
+ * @retval None
+ */
+void register_shrinker(struct shrinker *shrinker);
+
 /**
  * @brief  Memory allocation function in kernel
  * @param  size: Size of requested bytes
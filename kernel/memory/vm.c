@@ -74,13 +74,13 @@ void unmunmap(pagetable_t pagetable, uint64_t va, uint64_t npages, int do_free)
         panic("unmunmap: invalid virtual address, which is not aligned.\n");
 
     for (uint64_t a = va; a < va + npages * PGSIZE; a += PGSIZE) {
-        pte_t *pte = walk(pagetable, va, 0, NULL);
-        if (pte != NULL)
+        pte_t *pte = walk(pagetable, a, 0, NULL);
+        if (pte == NULL)
             panic("unmunmap: walk. \n");
         if ((*pte & PTE_VALID) == 0)
             panic("unmunmap: not mapped. \n");
         // If it is not a leaf node, there is only one valid bit and no permission bit 
-        if (PTE_FLAG(*pagetable) == PTE_VALID) 
+        if (PTE_FLAG(*pte) == PTE_VALID) 
             panic("unmunmap: note a leaf. \n");
         if (do_free) {
             uint64_t pa = PA2VA(PTE_ADDR(*pte));
@@ -205,8 +205,35 @@ uint64_t uvmdealloc(pagetable_t pagetable, uint64_t oldsz, uint64_t newsz)
 {
     if(newsz >= oldsz) 
         return oldsz;
-    int npages = (oldsz - newsz) / PGSIZE;
-    unmunmap(pagetable, newsz, npages, 1);
+    if (PGROUNDUP(newsz) < PGROUNDUP(oldsz)) {
+        int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
+        unmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+    }
+    return newsz;
+}
+
+/*
+ * Shrink user memory of a page table that threads on other cores may be using.
+ * Until the TLBI is done they may still write through stale translations, so the pages are
+ * only invalidated first, their entries keep the address, and freed afterwards
+ */
+uint64_t uvmdealloc_shared(pagetable_t pagetable, uint64_t oldsz, uint64_t newsz)
+{
+    if (newsz >= oldsz)
+        return oldsz;
+    uint64_t start = PGROUNDUP(newsz), end = PGROUNDUP(oldsz);
+    for (uint64_t a = start; a < end; a += PGSIZE) {
+        pte_t *pte = walk(pagetable, a, 0, NULL);
+        if (pte == NULL || (*pte & PTE_VALID) == 0)
+            panic("uvmdealloc_shared: not mapped.\n");
+        *pte &= ~PTE_VALID;
+    }
+    tlbi_vmalle1is();
+    for (uint64_t a = start; a < end; a += PGSIZE) {
+        pte_t *pte = walk(pagetable, a, 0, NULL);
+        kfree((void *)PA2VA(PTE_ADDR(*pte)));
+        *pte = 0;
+    }
     return newsz;
 }
 
@@ -386,4 +413,14 @@ void uvmswitch(struct proc *p)
         panic("uvmswitch: process' pagetable invalid.\n");
 
     lttbr0(VA2PA(p->pagetable));
+}
+
+/*
+ * Switches the user page table for this core to one that maps nothing, for kernel threads.
+ * The table of the process that ran last may be freed by another CPU while they run
+ */
+void uvmswitch_kernel(void)
+{
+    static uint64_t empty_pagetable[PGSIZE / sizeof(uint64_t)] __attribute__((aligned(PGSIZE)));
+    lttbr0(VA2PA(empty_pagetable));
 }
\ No newline at end of file
@@ -85,6 +85,16 @@ uint64_t uvmalloc(pagetable_t pagetable,uint64_t oldsz, uint64_t newsz);
  */
 uint64_t uvmdealloc(pagetable_t, uint64_t, uint64_t);
 
+/**
+ * @brief  Like uvmdealloc() for a page table other cores may be using, that of a thread group.
+ * The pages are freed only after the TLBs of all cores have been invalidated
+ * @param  pagetable: The page table
+ * @param  oldsz: Current size
+ * @param  newsz: Size to shrink to
+ * @retval The new size
+ */
+uint64_t uvmdealloc_shared(pagetable_t pagetable, uint64_t oldsz, uint64_t newsz);
+
 /**
  * @brief  Given the page table of a parent process, copy the memory of this process into the page table of the child process
  * @retval Both content and page table entries are copied, 0 indicates success -1 indicates failure
@@ -153,4 +163,10 @@ int copyinstr(pagetable_t pagetable, char *dst, uint64_t srcva, uint64_t max);
  */
 void uvmswitch(struct proc *p);
 
+/**
+ * @brief  Switches the user page table for this core to an empty one, for kernel threads which have no user space
+ * @retval None
+ */
+void uvmswitch_kernel(void);
+
 #endif /* VM_H */
\ No newline at end of file
@@ -38,6 +38,16 @@ static int loadseg(pagetable_t pgdir, uint64_t va, struct inode *ip, uint32_t of
     return 0;
 }
 
+/*
+ * Let clone() add threads to the group of leader again, exec() is done with its page table
+ */
+static void exec_end(struct proc *leader)
+{
+    acquire_spin_lock(&wait_lock);
+    leader->flags &= ~PF_EXECING;
+    release_spin_lock(&wait_lock);
+}
+
 /* 
  *  Load a file and execute it with arguments; only returns if error.
  */
@@ -45,14 +55,28 @@ int exec(char *path, char **argv)
 {
     pagetable_t pagetable = 0, oldpagetable;
     struct inode *ip;
+    struct proc *leader = myproc()->group_leader;
+
+    // Other threads would be left running on the freed page table.
+    // clone() checks PF_EXECING under wait_lock, so none can be added once this check passed
+    acquire_spin_lock(&wait_lock);
+    if (leader->nr_threads > 1 || (leader->flags & PF_EXITING)) {
+        release_spin_lock(&wait_lock);
+        cprintf("exec: %s from a multi-threaded process\n", path);
+        return -1;
+    }
+    leader->flags |= PF_EXECING;
+    release_spin_lock(&wait_lock);
     
     begin_op();
     if ((ip = namei(path)) == NULL) {
         end_op();
+        exec_end(leader);
         cprintf("exec: %s not found\n", path);
         return -1;
     }
-    ilock(ip);
+    // Many processes may be loading the same program, reading it only needs the inode shared
+    ilock_shared(ip);
     struct elfhdr elf;
     // check ELF Header
     if (readi(ip, (char *)&elf, 0, sizeof(elf)) != sizeof(elf)) {
@@ -100,7 +124,8 @@ int exec(char *path, char **argv)
             goto bad;
         }
     }
-    iunlockandput(ip);
+    iunlock_shared(ip);
+    iput(ip);
     end_op();
     ip = NULL;
 
@@ -161,18 +186,23 @@ int exec(char *path, char **argv)
     p->sz = sz;
     p->tf->sp = sp;
     p->tf->pc = elf.entry;
+    // The new image starts with zeroed FP/SIMD registers
+    fpsimd_reset(p);
     uvmswitch(p);
     if (oldpagetable != NULL)
         uvmfree(oldpagetable,4);
+    exec_end(leader);
     return argc;
 
 bad:
     if(pagetable)
         uvmfree(pagetable,4);
     if (ip) {
-        iunlockandput(ip);
+        iunlock_shared(ip);
+        iput(ip);
         end_op();
     }
+    exec_end(leader);
     return -1;
 }
 
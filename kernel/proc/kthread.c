@@ -0,0 +1,156 @@
+/**
+ * @file kthread.c
+ * @author ylp
+ * @brief Kernel threads, refer to the Linux kernel source code kernel/kthread.c
+ * @version 0.1
+ * @date 2022-04-12
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "kthread.h"
+#include "proc.h"
+#include "../lib/string.h"
+#include "../printf.h"
+
+/*
+ * The first scheduling of a kernel thread by scheduler() will swich to kthread_entry
+ */
+static void kthread_entry(void)
+{
+    struct proc *p = myproc();
+    int ret = -1;
+    // Still holding p->lock from scheduler
+    release_spin_lock(&p->lock);
+    // A thread stopped before it ever ran does not call threadfn at all
+    if (!kthread_should_stop()) {
+        ret = p->threadfn(p->data);
+    }
+    exit(ret);
+}
+
+/*
+ * Create a kernel thread, which is left in the EMBRYO state until wake_up_process() is called on it
+ * The thread gets a kernel stack but no page table, open files or working directory.
+ */
+struct proc *kthread_create(int (*threadfn)(void *), void *data, const char *name)
+{
+    struct proc *p = allocproc();
+    if (p == NULL) {
+        return NULL;
+    }
+    p->flags = PF_KTHREAD;
+    p->threadfn = threadfn;
+    p->data = data;
+    p->parent = NULL;
+    p->cwd = NULL;
+    // Start in kthread_entry instead of forkret, there is no user space to return to
+    p->context.x30 = (uint64_t)kthread_entry;
+    safestrcpy(p->name, name, sizeof(p->name));
+    release_spin_lock(&p->lock);
+    return p;
+}
+
+/*
+ * Create a kernel thread and make it runnable
+ */
+struct proc *kthread_run(int (*threadfn)(void *), void *data, const char *name)
+{
+    struct proc *p = kthread_create(threadfn, data, name);
+    if (p != NULL) {
+        wake_up_process(p);
+    }
+    return p;
+}
+
+/*
+ * Bind a kernel thread to a CPU, the scheduler will only run it on that CPU from now on
+ */
+void kthread_bind(struct proc *p, int cpu)
+{
+    if (cpu < 0 || cpu >= NCPU) {
+        panic("kthread_bind: invalid cpu %d.\n", cpu);
+    }
+    acquire_spin_lock(&p->lock);
+    p->cpus_allowed = 1UL << cpu;
+    release_spin_lock(&p->lock);
+}
+
+/*
+ * Ask a kernel thread to stop and wait for it to exit, return the return value of threadfn
+ */
+int kthread_stop(struct proc *p)
+{
+    acquire_spin_lock(&wait_lock);
+    p->flags |= PF_KTHREAD_STOP;
+    p->flags &= ~PF_KTHREAD_PARK;
+    // It may be sleeping in kthread_parkme()
+    wakeup(&p->flags);
+    release_spin_lock(&wait_lock);
+    // It may never have been started
+    wake_up_process(p);
+    return waitproc(p);
+}
+
+/*
+ * Ask a kernel thread to park and wait until it sleeps in kthread_parkme()
+ */
+void kthread_park(struct proc *p)
+{
+    acquire_spin_lock(&wait_lock);
+    p->flags |= PF_KTHREAD_PARK;
+    if (p != myproc()) {
+        while (!(p->flags & PF_KTHREAD_PARKED)) {
+            sleep(&p->flags, &wait_lock);
+        }
+    }
+    release_spin_lock(&wait_lock);
+}
+
+/*
+ * Let a parked kernel thread continue
+ */
+void kthread_unpark(struct proc *p)
+{
+    acquire_spin_lock(&wait_lock);
+    p->flags &= ~PF_KTHREAD_PARK;
+    wakeup(&p->flags);
+    release_spin_lock(&wait_lock);
+}
+
+/*
+ * Called by the current kernel thread at a safe point, sleeps while kthread_park() is in effect
+ * Both sides sleep on &p->flags, every change of the control bits wakes them up to recheck.
+ */
+void kthread_parkme(void)
+{
+    struct proc *p = myproc();
+    acquire_spin_lock(&wait_lock);
+    while (p->flags & PF_KTHREAD_PARK) {
+        if (!(p->flags & PF_KTHREAD_PARKED)) {
+            p->flags |= PF_KTHREAD_PARKED;
+            // kthread_park() is waiting for us to get here
+            wakeup(&p->flags);
+        }
+        sleep(&p->flags, &wait_lock);
+    }
+    p->flags &= ~PF_KTHREAD_PARKED;
+    release_spin_lock(&wait_lock);
+}
+
+/*
+ * Whether kthread_stop() has been called on the current kernel thread
+ */
+bool kthread_should_stop(void)
+{
+    return (myproc()->flags & PF_KTHREAD_STOP) != 0;
+}
+
+/*
+ * Whether kthread_park() has been called on the current kernel thread
+ */
+bool kthread_should_park(void)
+{
+    return (myproc()->flags & PF_KTHREAD_PARK) != 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file kthread.h
+ * @author ylp
+ * @brief Kernel threads, refer to the Linux kernel source code include/linux/kthread.h
+ * @version 0.1
+ * @date 2022-04-12
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef KTHREAD_H
+#define KTHREAD_H
+
+#include "include/stdint.h"
+#include "proc.h"
+
+/**
+ * @brief  Create a kernel thread, which is left in the EMBRYO state until wake_up_process() is called on it
+ * The thread runs threadfn(data) without a user page table and exits with its return value.
+ * @param  threadfn: The function to run in the thread
+ * @param  *data: Argument passed to threadfn
+ * @param  *name: Thread name shown by proc_dump()
+ * @retval The new thread, or NULL if no process could be allocated
+ */
+struct proc *kthread_create(int (*threadfn)(void *), void *data, const char *name);
+
+/**
+ * @brief  Create a kernel thread and make it runnable
+ * @param  threadfn: The function to run in the thread
+ * @param  *data: Argument passed to threadfn
+ * @param  *name: Thread name shown by proc_dump()
+ * @retval The new thread, or NULL if no process could be allocated
+ */
+struct proc *kthread_run(int (*threadfn)(void *), void *data, const char *name);
+
+/**
+ * @brief  Bind a kernel thread to a CPU, the scheduler will only run it on that CPU from now on
+ * @param  *p: The kernel thread
+ * @param  cpu: CPU number
+ * @retval None
+ */
+void kthread_bind(struct proc *p, int cpu);
+
+/**
+ * @brief  Ask a kernel thread to stop and wait for it to exit. Must be called from process context.
+ * The thread must check kthread_should_stop() and return from threadfn when it is true.
+ * A thread that returns on its own stays a zombie until this reaps it, so every kernel thread that may
+ * return must be stopped exactly once.
+ * @param  *p: The kernel thread
+ * @retval The return value of threadfn, or -1 if the thread never ran
+ */
+int kthread_stop(struct proc *p);
+
+/**
+ * @brief  Ask a kernel thread to park and wait until it sleeps in kthread_parkme()
+ * @param  *p: The kernel thread
+ * @retval None
+ */
+void kthread_park(struct proc *p);
+
+/**
+ * @brief  Let a parked kernel thread continue
+ * @param  *p: The kernel thread
+ * @retval None
+ */
+void kthread_unpark(struct proc *p);
+
+/**
+ * @brief  Called by the current kernel thread at a safe point, sleeps while kthread_park() is in effect
+ * @retval None
+ */
+void kthread_parkme(void);
+
+/**
+ * @brief  Whether kthread_stop() has been called on the current kernel thread
+ * @retval true if the thread should return from threadfn
+ */
+bool kthread_should_stop(void);
+
+/**
+ * @brief  Whether kthread_park() has been called on the current kernel thread
+ * @retval true if the thread should call kthread_parkme()
+ */
+bool kthread_should_park(void);
+
+#endif /* KTHREAD_H */
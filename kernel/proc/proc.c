@@ -18,13 +18,18 @@
 #include "../interrupt/interrupt.h"
 #include "../fs/fs.h"
 #include "../fs/log.h"
+#include "../block/blkdev.h"
 
-struct process_table process_table;
-struct cpu cpus[NCPU];
+DEFINE_PER_CPU(struct cpu, cpu_data);
 int nextpid = 1;
 static struct proc *initproc;
+// Procs are carved out of pages on demand and recycled, but never freed, so the list of all procs
+// only grows and can be walked without a lock. pid_lock protects the PID hash and the free list.
+static struct proc *proc_list;
+static struct proc *proc_free_list;
+static struct proc *pid_hash[NPIDHASH];
 static struct spinlock pid_lock;
-static struct spinlock wait_lock;
+struct spinlock wait_lock;
 static volatile uint64_t *_spintable = (uint64_t *)PA2VA(0xD8);
 
 extern void _entry();
@@ -32,40 +37,26 @@ extern void user_trapret();
 extern void _forkret(struct trapframe *);
 extern void swich(struct context *old, struct context *new);
 static void freeproc(struct proc *p);
+static uint64_t counts_to_us(uint64_t counts);
+static void exit_thread(struct proc *p, int status);
+static void exit_group(struct proc *p);
 void forkret();
 
-/* 
- * Return this CPU's cpu struct, Interrupts must be disabled
- */
-struct cpu *mycpu(void)
-{
-    return &cpus[cpuid()];
-}
-
 /* 
  * Initialize the CPU array
  */
 void init_cpu_info()
 {
     for (int i = 0; i < NCPU; ++i) {
-        cpus[i].depth_spin_lock = 0;
-        cpus[i].cpuid = i;
+        struct cpu *c = cpu_of(i);
+        c->depth_spin_lock = 0;
+        c->cpuid = i;
+        c->rcu_read_depth = 0;
+        c->rcu_next_list = c->rcu_wait_list = NULL;
+        c->rcu_next_tail = &c->rcu_next_list;
     }
 }
 
-/* 
- * Return the current struct proc *, or zero if none
- * Keep interrupt off while fetching process structure.  Interrupts can be closed when the process structure is removed 
- */
-struct proc *myproc(void)
-{
-    push_off();
-    struct cpu *cpu = mycpu();
-    struct proc *proc = cpu->proc;
-    pop_off();
-    return proc;
-}
-
 /*
  * Initialize the process management subsystem
  */
@@ -74,56 +65,168 @@ void proc_init()
     init_cpu_info();
     init_spin_lock(&wait_lock, "wait_lock");
     init_spin_lock(&pid_lock, "pid_lock");
-    for (struct proc *p = process_table.proc; p < &process_table.proc[NPROC]; ++p) {
+}
+
+/* 
+ * Carve a page into UNUSED procs, publish them on the list of all procs and put them on the free list
+ * Returns 0 on success, -1 if out of memory
+ */
+static int grow_proc_pool(void)
+{
+    struct proc *chunk = kalloc(PGSIZE);
+    if (chunk == NULL) {
+        return -1;
+    }
+    memset(chunk, 0, PGSIZE);
+    int n = PGSIZE / sizeof(struct proc);
+    for (int i = 0; i < n; ++i) {
+        struct proc *p = &chunk[i];
         init_spin_lock(&p->lock, "proc");
+        init_spin_lock(&p->grow_lock, "grow_lock");
+        INIT_LIST_HEAD(&p->children);
+        INIT_LIST_HEAD(&p->sibling);
+        p->state = UNUSED;
+    }
+
+    acquire_spin_lock(&pid_lock);
+    for (int i = 0; i < n; ++i) {
+        struct proc *p = &chunk[i];
+        p->pid_next = proc_free_list;
+        proc_free_list = p;
+        // Lockless walkers must see an initialized proc before they can reach it
+        p->next_proc = proc_list;
+        __atomic_store_n(&proc_list, p, __ATOMIC_RELEASE);
+    }
+    release_spin_lock(&pid_lock);
+    return 0;
+}
+
+/* 
+ * Take a proc off the free list, growing the pool when it is empty, NULL if out of memory
+ */
+static struct proc *get_free_proc(void)
+{
+    while (1) {
+        acquire_spin_lock(&pid_lock);
+        struct proc *p = proc_free_list;
+        if (p != NULL) {
+            proc_free_list = p->pid_next;
+            p->pid_next = NULL;
+            release_spin_lock(&pid_lock);
+            return p;
+        }
+        release_spin_lock(&pid_lock);
+        if (grow_proc_pool() < 0) {
+            return NULL;
+        }
+    }
+}
+
+/* 
+ * Hash bucket of a PID
+ */
+static inline struct proc **pid_bucket(int pid)
+{
+    return &pid_hash[(uint32_t)pid % NPIDHASH];
+}
+
+/* 
+ * Return the live proc with the given pid with p->lock held, or NULL if there is none
+ * The proc may be freed and reused between the hash lookup and the acquire, so the pid is checked again
+ * under p->lock. This is safe because procs are never returned to the page allocator.
+ */
+static struct proc *find_proc(int pid)
+{
+    struct proc *p;
+    acquire_spin_lock(&pid_lock);
+    for (p = *pid_bucket(pid); p != NULL; p = p->pid_next) {
+        if (p->pid == pid)
+            break;
+    }
+    release_spin_lock(&pid_lock);
+    if (p == NULL) {
+        return NULL;
+    }
+    acquire_spin_lock(&p->lock);
+    if (p->pid != pid || p->state == UNUSED) {
+        release_spin_lock(&p->lock);
+        return NULL;
     }
+    return p;
 }
 
 /* 
- * Allocate an available PID
+ * Allocate an available PID and enter p in the PID hash under it
  */
-static int allocpid()
+static int allocpid(struct proc *p)
 {
     int pid;
     acquire_spin_lock(&pid_lock);
     pid = nextpid;
     nextpid += 1;
+    p->pid = pid;
+    p->pid_next = *pid_bucket(pid);
+    *pid_bucket(pid) = p;
     release_spin_lock(&pid_lock);
     return pid;
 }
 
 /* 
- * Look for an UNUSED state process in the process_table. If it finds one, initialize it and run it.
- * Lock process->lock, NULL is returned if no process is available or memory allocation fails
- * Look in the process table for an UNUSED proc. If found, change state to EMBRYO and initialize
- * state required to run in the kernel. Otherwise return NULL.
+ * Remove p from the PID hash and put it on the free list, p->lock must be held
  */
-static struct proc *allocproc(void)
+static void freepid(struct proc *p)
 {
-    struct proc *p;
-    for (p = process_table.proc; p < &process_table.proc[NPROC]; ++p) {
-        acquire_spin_lock(&p->lock);
-        if (p->state == UNUSED) {
-            goto found;
-        } else {
-            release_spin_lock(&p->lock);
+    acquire_spin_lock(&pid_lock);
+    if (p->pid != 0) {
+        for (struct proc **pp = pid_bucket(p->pid); *pp != NULL; pp = &(*pp)->pid_next) {
+            if (*pp == p) {
+                *pp = p->pid_next;
+                break;
+            }
         }
     }
-    return NULL;
+    p->pid = 0;
+    p->pid_next = proc_free_list;
+    proc_free_list = p;
+    release_spin_lock(&pid_lock);
+}
 
-found:
-    p->pid = allocpid();
-    p->state = EMBRYO;
+/* 
+ * Set p->state to RUNNABLE and start its run-queue wait, p->lock must be held
+ */
+static void make_runnable(struct proc *p)
+{
+    p->state = RUNNABLE;
+    p->runnable_stamp = timestamp();
+}
 
-    // Allocate memory space for the kernel stack
-    if ((p->kstack = kalloc(KSTACKSIZE)) == NULL) {
-        freeproc(p);
-        release_spin_lock(&p->lock);
+/* 
+ * Take an UNUSED proc from the free list, allocating more when it is empty. If it finds one, initialize it and run it.
+ * Lock process->lock, NULL is returned if memory allocation fails
+ * Change state to EMBRYO and initialize state required to run in the kernel. Otherwise return NULL.
+ */
+struct proc *allocproc(void)
+{
+    struct proc *p = get_free_proc();
+    if (p == NULL) {
         return NULL;
     }
+    acquire_spin_lock(&p->lock);
+    allocpid(p);
+    p->state = EMBRYO;
+    p->flags = 0;
+    p->cpus_allowed = CPU_MASK_ALL;
+    p->last_cpu = -1;
+    p->nr_migrations = 0;
+    p->utime = p->stime = p->wait_time = 0;
+    p->nvcsw = p->nivcsw = 0;
+    p->acct_stamp = p->runnable_stamp = 0;
+    p->group_leader = p;
+    p->nr_threads = 1;
+    fpsimd_reset(p);
 
-    // Assign a page table
-    if ((p->pagetable = alloc_pagetable()) == NULL) {
+    // Allocate memory space for the kernel stack
+    if ((p->kstack = kalloc(KSTACKSIZE)) == NULL) {
         freeproc(p);
         release_spin_lock(&p->lock);
         return NULL;
@@ -149,16 +252,24 @@ found:
 }
 
 /* 
- * Find the child of the given process and reset the child's parent to init process
+ * Reset the parent of the children of the given process to init process, wait_lock must be held
+ * Exited children go to the head of the children list of init and the others to the tail, keeping
+ * the zombies first as wait() expects.
  */
 void reparent(struct proc *p)
 {
-    for (struct proc *child_proc = process_table.proc; child_proc < &process_table.proc[NPROC]; child_proc++) {
-        if (child_proc->parent == p) {
-            child_proc->parent = initproc;
-            wakeup(initproc);
-        }
+    struct proc *child_proc, *next;
+    if (list_is_empty(&p->children)) {
+        return;
+    }
+    list_for_each_entry_safe(child_proc, next, &p->children, sibling) {
+        child_proc->parent = initproc;
+        if (child_proc->state == ZOMBIE) 
+            list_move(&child_proc->sibling, &initproc->children);
+        else
+            list_move_tail(&child_proc->sibling, &initproc->children);
     }
+    wakeup(initproc);
 }
 
 /* 
@@ -171,20 +282,31 @@ static void freeproc(struct proc *p)
     p->chan = NULL;
     p->killed = 0;
     p->xstate = 0;
-    p->pid = 0;
     p->parent = NULL;
+    // Only a proc that was given to a parent is on a children list, and then wait_lock is held
+    if (!list_is_empty(&p->sibling)) {
+        list_del(&p->sibling);
+        INIT_LIST_HEAD(&p->sibling);
+    }
     if (p->kstack) {
         kfree(p->kstack);
     }
     p->kstack = NULL;
     p->sz = 0;
-    if (p->pagetable) {
+    // Threads share the page table of the group leader, which frees it
+    if (p->pagetable && p->group_leader == p) {
         uvmfree(p->pagetable, 4);
     }
     p->pagetable = NULL;
+    p->group_leader = NULL;
+    p->nr_threads = 0;
     p->tf = NULL;
     p->name[0] = '\0';
+    p->flags = 0;
+    p->threadfn = NULL;
+    p->data = NULL;
     p->state = UNUSED;
+    freepid(p);
 }
 
 /* 
@@ -201,8 +323,11 @@ void forkret(void)
         // regular process (e.g., because it calls sleep), and thus cannot
         // be run from main().
         first = 0;
-        fsinit(ROOTDEV);
+        if (rootdev == BLKDEV_NODEV)
+            panic("forkret: no block device %s for the root.\n", ROOTDEV_NAME);
+        fsinit(rootdev);
     }
+    account_return_user();
     _forkret(p->tf);
 }
 
@@ -217,6 +342,8 @@ void init_user(void)
     struct proc *p = allocproc();
     if (p == NULL) 
         panic("init_user: Failed to allocate proc.\n");
+    if ((p->pagetable = alloc_pagetable()) == NULL)
+        panic("init_user: Failed to allocate pagetable.\n");
 
     initproc = p;
     p->sz = PGSIZE;
@@ -230,7 +357,7 @@ void init_user(void)
 
     safestrcpy(p->name, "initcode", sizeof(p->name));
     p->cwd = namei("/");
-    p->state = RUNNABLE;
+    make_runnable(p);
     release_spin_lock(&p->lock);
 }
 
@@ -256,6 +383,9 @@ void sched(void)
     if (mycpu()->depth_spin_lock != 1) {
         panic("sched: sched locks.\n");
     }
+    if (mycpu()->rcu_read_depth != 0) {
+        panic("sched: sleeping in an rcu read-side critical section.\n");
+    }
     // The process status and interrupt checks are then completed
     if (p->state == RUNNING) {
         panic("sched: process is running.\n");
@@ -264,12 +394,94 @@ void sched(void)
         panic("sched: interrupt is enabled.\n");
     }
 
+    // Charge the kernel time up to the switch, run_proc() restarts the clock when we are resumed
+    uint64_t now = timestamp();
+    p->stime += now - p->acct_stamp;
+    mycpu()->stime += now - p->acct_stamp;
+    if (p->state == SLEEPING) 
+        p->nvcsw++;
+    else if (p->state == RUNNABLE)
+        p->nivcsw++;
+
     // Finally, through SWICH, switch to the scheduler that schedules the thread
     intena = mycpu()->depth_spin_lock;
     swich(&p->context, &mycpu()->context);
     mycpu()->depth_spin_lock = intena;
 }
 
+/* 
+ * Switch this CPU to the process p, which must be RUNNABLE with p->lock held
+ * It is the process's job to release its lock and then reacquire it before jumping back to us.
+ */
+static void run_proc(struct cpu *c, struct proc *p)
+{
+    uint64_t now = timestamp();
+    c->idle_time += now - c->idle_stamp;
+    c->nr_switches++;
+    p->wait_time += now - p->runnable_stamp;
+    p->acct_stamp = now;
+    p->state = RUNNING;
+    c->proc = p;
+    c->need_resched = false;
+    // Remember where it ran, the scheduler prefers this CPU next time
+    if (p->last_cpu != c->cpuid) {
+        if (p->last_cpu >= 0)
+            p->nr_migrations++;
+        p->last_cpu = c->cpuid;
+    }
+    // A kernel thread has no user space, the table of the previous process may be freed under it
+    if (p->flags & PF_KTHREAD)
+        uvmswitch_kernel();
+    else
+        uvmswitch(p);
+    fpsimd_switch_in(c, p);
+    l_sp_el0((uint64_t)p);
+    swich(&c->context, &p->context);
+
+    // Process is done running for now
+    // It should have changed its p->state before coming back
+    fpsimd_switch_out(c, p);
+    c->proc = NULL;
+    l_sp_el0(0);
+    c->idle_stamp = timestamp();
+}
+
+/* 
+ * Whether p last ran on a CPU other than cpu which it is still allowed to run on
+ */
+static bool is_cache_affine_elsewhere(struct proc *p, int cpu)
+{
+    return p->last_cpu >= 0 && p->last_cpu != cpu && (p->cpus_allowed & (1UL << p->last_cpu));
+}
+
+/* 
+ * Return the CPU with the most load, the process running on it and the RUNNABLE ones that last ran on it,
+ * if it has at least SCHED_MIGRATE_IMBALANCE more than cpu, otherwise -1.
+ * Without the running one two processes taking turns on a CPU would look like one and never be spread out.
+ * The counts are read without locks, they are only a hint.
+ */
+static int find_busiest_cpu(int cpu)
+{
+    int nr_queued[NCPU];
+    int busiest = -1;
+    for (int i = 0; i < NCPU; ++i) {
+        nr_queued[i] = 0;
+    }
+    for (struct proc *p = proc_list; p != NULL; p = p->next_proc) {
+        int last_cpu = p->last_cpu;
+        if ((p->state == RUNNABLE || p->state == RUNNING) && last_cpu >= 0) {
+            nr_queued[last_cpu]++;
+        }
+    }
+    for (int i = 0; i < NCPU; ++i) {
+        if (i != cpu && nr_queued[i] - nr_queued[cpu] >= SCHED_MIGRATE_IMBALANCE 
+            && (busiest < 0 || nr_queued[i] > nr_queued[busiest])) {
+            busiest = i;
+        }
+    }
+    return busiest;
+}
+
 /* 
  * Each CPU has one scheduling thread, Per-CPU process scheduler
  * Each CPU calls scheduler() after setting itself up.
@@ -287,26 +499,36 @@ void scheduler(void)
 {
     struct cpu *c = mycpu();
     c->proc = NULL;
+    c->idle_stamp = timestamp();
 
     while (1) {
         // Avoid deadlock by ensuring that devices can interrupt
         enable_interrupt();
 
-        for (struct proc *p = process_table.proc; p < &process_table.proc[NPROC]; ++p) {
+        // Back in the scheduler, so this CPU is outside any rcu read-side critical section
+        push_off();
+        rcu_quiescent_state();
+        pop_off();
+
+        // Run the processes whose cache and TLB contents are on this CPU, or on no CPU
+        for (struct proc *p = proc_list; p != NULL; p = p->next_proc) {
             acquire_spin_lock(&p->lock);
-            if (p->state == RUNNABLE) {
-                // Switch to chosen process. It is the process's job
-                // to release its lock and then reacquire it
-                // before jumping back to us.
-                //cprintf("cpu %d to %s\n", cpuid(), p->name);
-                p->state = RUNNING;
-                c->proc = p;
-                uvmswitch(p);
-                swich(&c->context, &p->context);
-
-                // Process is done running for now
-                // It should have changed its p->state before coming back
-                c->proc = NULL;
+            if (p->state == RUNNABLE && (p->cpus_allowed & (1UL << c->cpuid)) && !is_cache_affine_elsewhere(p, c->cpuid)) {
+                run_proc(c, p);
+            }
+            release_spin_lock(&p->lock);
+        }
+
+        // Pull one process from another CPU only when it is overloaded compared to this one
+        int busiest = find_busiest_cpu(c->cpuid);
+        if (busiest < 0) 
+            continue;
+        for (struct proc *p = proc_list; p != NULL; p = p->next_proc) {
+            acquire_spin_lock(&p->lock);
+            if (p->state == RUNNABLE && (p->cpus_allowed & (1UL << c->cpuid)) && p->last_cpu == busiest) {
+                run_proc(c, p);
+                release_spin_lock(&p->lock);
+                break;
             }
             release_spin_lock(&p->lock);
         }
@@ -319,19 +541,25 @@ void scheduler(void)
 void proc_dump()
 {
     static char* states[] = {
-        [UNUSED] "UNUSED",  [SLEEPING] "SLEEPING", [RUNNABLE] "RUNNABLE",
+        [UNUSED] "UNUSED",  [EMBRYO] "EMBRYO", [SLEEPING] "SLEEPING", [RUNNABLE] "RUNNABLE",
         [RUNNING] "RUNNING", [ZOMBIE] "ZOMBIE",
     };
 
     cprintf("\n====== PROCESS DUMP ======\n");
-    for (struct proc *p = process_table.proc; p < &process_table.proc[NPROC]; ++p) {
+    for (struct proc *p = proc_list; p != NULL; p = p->next_proc) {
         if (p->state == UNUSED) 
             continue;
         char *state =
             (p->state >= 0 && p->state < ARRAY_SIZE(states) && states[p->state])
                 ? states[p->state]
                 : "UNKNOWN";
-        cprintf("[%s] %d (%s)\n", state, p->pid, p->name);
+        // Kernel threads are shown with their name in square brackets, like ps on Linux
+        if (p->flags & PF_KTHREAD)
+            cprintf("[%s] %d [%s]", state, p->pid, p->name);
+        else
+            cprintf("[%s] %d (%s)", state, p->pid, p->name);
+        cprintf(" cpu %d migrations %d utime %d stime %d\n", p->last_cpu, (int)p->nr_migrations, 
+            (int)counts_to_us(p->utime), (int)counts_to_us(p->stime));
     }
     cprintf("====== DUMP END ======\n\n");
 }
@@ -351,6 +579,60 @@ void trapframe_dump(struct proc* p)
     cprintf("====== DUMP END ======\n\n");
 }
 
+/* 
+ * Terminate a thread which is not the group leader. Does not return.
+ * The thread stays ZOMBIE until another thread of the group joins it or the group leader exits.
+ */
+static void exit_thread(struct proc *p, int status)
+{
+    struct proc *leader = p->group_leader;
+    acquire_spin_lock(&wait_lock);
+    leader->nr_threads -= 1;
+    // join() and exit_group() sleep on the thread count of the group leader
+    wakeup(&leader->nr_threads);
+    acquire_spin_lock(&p->lock);
+    p->xstate = status;
+    p->state = ZOMBIE;
+    release_spin_lock(&wait_lock);
+
+    sched();
+    panic("exit: zombie thread exit.\n");
+}
+
+/* 
+ * Kill the other threads of the group led by p, wait for them to exit and free them
+ */
+static void exit_group(struct proc *p)
+{
+    acquire_spin_lock(&wait_lock);
+    // clone() checks this with wait_lock held, so no thread can be added from now on
+    p->flags |= PF_EXITING;
+    while (p->nr_threads > 1) {
+        for (struct proc *t = proc_list; t != NULL; t = t->next_proc) {
+            if (t != p && t->group_leader == p) {
+                acquire_spin_lock(&t->lock);
+                t->killed = 1;
+                if (t->state == SLEEPING) {
+                    make_runnable(t);
+                }
+                release_spin_lock(&t->lock);
+            }
+        }
+        sleep(&p->nr_threads, &wait_lock);
+    }
+    // Free the threads nobody has joined
+    for (struct proc *t = proc_list; t != NULL; t = t->next_proc) {
+        if (t != p && t->group_leader == p) {
+            acquire_spin_lock(&t->lock);
+            if (t->state == ZOMBIE) {
+                freeproc(t);
+            }
+            release_spin_lock(&t->lock);
+        }
+    }
+    release_spin_lock(&wait_lock);
+}
+
 /* 
  * Exit the current process. Does not return.
  * An exited process remains in the zombie state until its parent calls wait().
@@ -370,6 +652,13 @@ void exit(int status)
     if (p == initproc) 
         panic("init proc exit with status code %d\n", status);
 
+    // A thread only ends itself, the group leader ends the whole process
+    if (p->group_leader != p) {
+        exit_thread(p, status);
+    }
+    // The other threads must be gone before the files and memory they share are released
+    exit_group(p);
+
     // Close all open files for the process
     for (int fd = 0; fd < NOFILE; ++fd) {
         if (p->ofile[fd] != NULL) {
@@ -379,18 +668,29 @@ void exit(int status)
         }
     }
 
-    begin_op();
-    iput(p->cwd);
-    end_op();
-    p->cwd = NULL;
+    // Kernel threads have no working directory
+    if (p->cwd != NULL) {
+        begin_op();
+        iput(p->cwd);
+        end_op();
+        p->cwd = NULL;
+    }
 
     // we need the parent's lock in order to wake it up from wait().
     // the parent-then-child rule says we have to lock it first.
     acquire_spin_lock(&wait_lock);
     // Give any children to init.
     reparent(p);
-    // Parent might be sleeping in wait().
-    wakeup(p->parent);
+    if (p->flags & PF_KTHREAD) {
+        // Only kthread_stop() frees a kernel thread, which may not have been called yet.
+        // Reaped by anybody else its struct proc could be reused under the one who stops it
+        wakeup(p);
+    } else {
+        // Move to the head of the children list, where wait() looks for exited children
+        list_move(&p->sibling, &p->parent->children);
+        // Parent might be sleeping in wait().
+        wakeup(p->parent);
+    }
     // Set the exit status and call Sched to reschedule
     acquire_spin_lock(&p->lock);
     p->xstate = status;
@@ -439,11 +739,11 @@ void sleep(void *chan, struct spinlock *lk)
  */
 void wakeup(void *chan)
 { 
-    for (struct proc *p = process_table.proc; p < &process_table.proc[NPROC]; p++) {
+    for (struct proc *p = proc_list; p != NULL; p = p->next_proc) {
         if (p != myproc()) {
             acquire_spin_lock(&p->lock);
             if (p->state == SLEEPING && p->chan == chan) {
-                p -> state = RUNNABLE;
+                make_runnable(p);
             }
             release_spin_lock(&p->lock);
         }
@@ -456,20 +756,17 @@ void wakeup(void *chan)
  */
 int32_t kill(int pid)
 {
-    for (struct proc *p = process_table.proc; p < &process_table.proc[NPROC]; p++) { 
-        acquire_spin_lock(&p->lock);
-        if (p->pid == pid) {
-            p->killed = 1;
-            if (p->state == SLEEPING) {
-                // Wake process from sleep()
-                p->state = RUNNABLE;
-            }
-            release_spin_lock(&p->lock);
-            return 0;
-        }
-        release_spin_lock(&p->lock);
+    struct proc *p = find_proc(pid);
+    if (p == NULL) {
+        return -1;
     }
-    return -1;
+    p->killed = 1;
+    if (p->state == SLEEPING) {
+        // Wake process from sleep()
+        make_runnable(p);
+    }
+    release_spin_lock(&p->lock);
+    return 0;
 }
 
 /* 
@@ -478,42 +775,58 @@ int32_t kill(int pid)
 int32_t fork(void)
 {
     struct proc *parent_proc = myproc();
+    // The address space, open files and cwd of a thread belong to its group leader
+    struct proc *leader = parent_proc->group_leader;
     struct proc *child_proc = allocproc();
     if (child_proc == NULL) {
         return -1;
     }
 
+    // Assign a page table
+    if ((child_proc->pagetable = alloc_pagetable()) == NULL) {
+        freeproc(child_proc);
+        release_spin_lock(&child_proc->lock);
+        return -1;
+    }
     // Copy the parent process memory to the child process
-    if (uvmcopy(parent_proc->pagetable, child_proc->pagetable, parent_proc->sz) < 0) {
+    acquire_spin_lock(&leader->grow_lock);
+    if (uvmcopy(leader->pagetable, child_proc->pagetable, leader->sz) < 0) {
+        release_spin_lock(&leader->grow_lock);
         freeproc(child_proc);
         release_spin_lock(&child_proc->lock);
         cprintf("fork: copy memory to child process failed.\n");
         return -1;
     }
-    child_proc->sz = parent_proc->sz;
+    child_proc->sz = leader->sz;
+    release_spin_lock(&leader->grow_lock);
     // Copy the register
     *(child_proc->tf) = *(parent_proc->tf);
     // The child process returns 0
     child_proc->tf->regs[0] = 0;
+    // The thread pointer is still the one of the calling thread, the kernel does not use TPIDR_EL0
+    child_proc->context.tpidr_el0 = r_tpidr_el0();
+    fpsimd_copy(child_proc, parent_proc);
     // The parent process starts file synchronization
+    // Other threads of the group may be closing descriptors meanwhile
     for (int i = 0; i < NOFILE; ++i) {
-        if (parent_proc->ofile[i] != NULL) {
-            child_proc->ofile[i] = filedup(parent_proc->ofile[i]);
-        }
+        child_proc->ofile[i] = fileget(&leader->ofile[i]);
     }
     // Configure the working directory
-    child_proc->cwd = idup(parent_proc->cwd);
+    child_proc->cwd = proc_cwd(leader);
     strncpy(child_proc->name, parent_proc->name, sizeof(child_proc->name));
+    child_proc->cpus_allowed = parent_proc->cpus_allowed;
 
     int child_pid = child_proc->pid;
     release_spin_lock(&child_proc->lock);
 
+    // A child forked by a thread belongs to the process, any thread may wait for it
     acquire_spin_lock(&wait_lock);
-    child_proc->parent = parent_proc;
+    child_proc->parent = leader;
+    list_add_tail(&child_proc->sibling, &leader->children);
     release_spin_lock(&wait_lock);
 
     acquire_spin_lock(&child_proc->lock);
-    child_proc->state = RUNNABLE;
+    make_runnable(child_proc);
     release_spin_lock(&child_proc->lock);
 
     return child_pid;
@@ -530,40 +843,319 @@ int32_t fork(void)
 int32_t wait(int64_t *xstate)
 {
     struct proc *p = myproc();
-    int is_have_child, pid;
+    // Children belong to the group leader, see fork()
+    struct proc *leader = p->group_leader;
+    int pid;
     acquire_spin_lock(&wait_lock);
 
     while (1) {
-        // Scan through table looking for exited children.
-        is_have_child = 0;
-        for (struct proc *np = process_table.proc; np < &process_table.proc[NPROC]; np++) {
-            if (np->parent == p) {
-                // np->parent can't change between the check and the acquire()
-                // because only the parent changes it, and we're the parent.
-                acquire_spin_lock(&np->lock);
-                is_have_child = 1;
-                if (np->state == ZOMBIE) {
-                    // Found an exited child process
-                    pid = np->pid;
-                    if (xstate != NULL) {
-                        *xstate = (int64_t)np->xstate;
-                    }
-                    freeproc(np);
-                    release_spin_lock(&np->lock);
-                    release_spin_lock(&wait_lock);
-                    return pid;
+        // Exited children are kept at the head of the list, so only the first one needs a look.
+        if (!list_is_empty(&leader->children)) {
+            struct proc *np = list_first_entry(&leader->children, struct proc, sibling);
+            // np->state only becomes ZOMBIE with wait_lock held, see exit()
+            acquire_spin_lock(&np->lock);
+            if (np->state == ZOMBIE) {
+                // Found an exited child process
+                pid = np->pid;
+                if (xstate != NULL) {
+                    *xstate = (int64_t)np->xstate;
                 }
+                freeproc(np);
                 release_spin_lock(&np->lock);
+                release_spin_lock(&wait_lock);
+                return pid;
             }
+            release_spin_lock(&np->lock);
         }
         // No point waiting if we don't have any children.
-        if (is_have_child == 0 || p->killed) {
+        if (list_is_empty(&leader->children) || p->killed) {
             release_spin_lock(&wait_lock);
             return -1;
         }
         // Wait for a child to exit.
+        sleep(leader, &wait_lock);
+    }
+}
+
+/* 
+ * Create a thread sharing the address space, open files and cwd of the current process, return its thread id.
+ * The thread starts at entry with arg in x0, its stack pointer at stack and TPIDR_EL0 set to tls.
+ * It has its own kernel stack, trap frame and context, and is a member of the group of the caller.
+ */
+int32_t clone(uint64_t entry, uint64_t arg, uint64_t stack, uint64_t tls)
+{
+    struct proc *p = myproc();
+    struct proc *leader = p->group_leader;
+    struct proc *np = allocproc();
+    if (np == NULL) {
+        return -1;
+    }
+
+    // Share the page table, freeproc() leaves it to the group leader
+    np->pagetable = leader->pagetable;
+    np->group_leader = leader;
+    *(np->tf) = *(p->tf);
+    np->tf->pc = entry;
+    np->tf->sp = stack;
+    np->tf->regs[0] = arg;
+    np->tf->regs[30] = 0;
+    np->context.tpidr_el0 = tls;
+    fpsimd_copy(np, p);
+    np->cpus_allowed = p->cpus_allowed;
+    safestrcpy(np->name, p->name, sizeof(np->name));
+    int tid = np->pid;
+    release_spin_lock(&np->lock);
+
+    acquire_spin_lock(&wait_lock);
+    if ((leader->flags & (PF_EXITING | PF_EXECING)) || p->killed) {
+        release_spin_lock(&wait_lock);
+        acquire_spin_lock(&np->lock);
+        freeproc(np);
+        release_spin_lock(&np->lock);
+        return -1;
+    }
+    leader->nr_threads += 1;
+    // Still under wait_lock, so exit_group() either waits for this thread or never sees it
+    acquire_spin_lock(&np->lock);
+    make_runnable(np);
+    release_spin_lock(&np->lock);
+    release_spin_lock(&wait_lock);
+    return tid;
+}
+
+/* 
+ * Wait for the thread tid of the current thread group to exit and free it
+ * Return 0 on success, -1 if tid is not another thread of the group or the caller was killed
+ */
+int32_t join(int tid, int32_t *xstate)
+{
+    struct proc *p = myproc();
+    struct proc *leader = p->group_leader;
+    acquire_spin_lock(&wait_lock);
+
+    while (1) {
+        struct proc *t = find_proc(tid);
+        if (t != NULL && (t->group_leader != leader || t == leader || t == p)) {
+            release_spin_lock(&t->lock);
+            t = NULL;
+        }
+        if (t == NULL || p->killed) {
+            if (t != NULL) 
+                release_spin_lock(&t->lock);
+            release_spin_lock(&wait_lock);
+            return -1;
+        }
+        if (t->state == ZOMBIE) {
+            if (xstate != NULL) {
+                *xstate = t->xstate;
+            }
+            freeproc(t);
+            release_spin_lock(&t->lock);
+            release_spin_lock(&wait_lock);
+            return 0;
+        }
+        release_spin_lock(&t->lock);
+        // exit_thread() wakes up the thread count of the group leader
+        sleep(&leader->nr_threads, &wait_lock);
+    }
+}
+
+/* 
+ * Set the mask of CPUs the process pid (0 for the calling process) may run on, returns 0 or -1
+ * A process that is running on a CPU no longer in its mask moves at its next scheduling point,
+ * the calling process yields at once.
+ */
+int32_t sched_setaffinity(int pid, uint64_t mask)
+{
+    struct proc *self = myproc();
+    mask &= CPU_MASK_ALL;
+    if (mask == 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        pid = self->pid;
+    }
+    struct proc *p = find_proc(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    // Kernel threads are placed by kthread_bind(), per-CPU ones must stay where they are
+    if (p->flags & PF_KTHREAD) {
+        release_spin_lock(&p->lock);
+        return -1;
+    }
+    p->cpus_allowed = mask;
+    release_spin_lock(&p->lock);
+    push_off();
+    int cpu = cpuid();
+    pop_off();
+    if (pid == self->pid && !(mask & (1UL << cpu))) {
+        yield();
+    }
+    return 0;
+}
+
+/* 
+ * Return the mask of CPUs the process pid (0 for the calling process) may run on, -1 if there is no such process
+ */
+int64_t sched_getaffinity(int pid)
+{
+    int64_t mask;
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    struct proc *p = find_proc(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    mask = (int64_t)p->cpus_allowed;
+    release_spin_lock(&p->lock);
+    return mask;
+}
+
+/* 
+ * Convert CNTPCT_EL0 counts to microseconds without overflowing the multiplication
+ */
+static uint64_t counts_to_us(uint64_t counts)
+{
+    uint64_t freq = r_cntfrq_el0();
+    return (counts / freq) * 1000000 + (counts % freq) * 1000000 / freq;
+}
+
+/* 
+ * Charge the time since the last accounting point to user time, called on trap entry from EL0
+ */
+void account_enter_kernel(void)
+{
+    push_off();
+    struct proc *p = mycpu()->proc;
+    if (p != NULL) {
+        uint64_t now = timestamp();
+        p->utime += now - p->acct_stamp;
+        mycpu()->utime += now - p->acct_stamp;
+        p->acct_stamp = now;
+    }
+    pop_off();
+}
+
+/* 
+ * Charge the time since the last accounting point to system time, called before returning to EL0
+ */
+void account_return_user(void)
+{
+    push_off();
+    struct proc *p = mycpu()->proc;
+    if (p != NULL) {
+        uint64_t now = timestamp();
+        p->stime += now - p->acct_stamp;
+        mycpu()->stime += now - p->acct_stamp;
+        p->acct_stamp = now;
+    }
+    pop_off();
+}
+
+/* 
+ * Copy the accounting of p, converted to microseconds, p->lock must be held
+ */
+static void fill_rusage(struct proc *p, struct rusage *ru)
+{
+    ru->utime = counts_to_us(p->utime);
+    ru->stime = counts_to_us(p->stime);
+    ru->wait_time = counts_to_us(p->wait_time);
+    ru->nvcsw = p->nvcsw;
+    ru->nivcsw = p->nivcsw;
+    ru->nr_migrations = p->nr_migrations;
+}
+
+/* 
+ * Get the resource usage of the process pid (0 for the calling process), returns 0 or -1
+ */
+int32_t getrusage(int pid, struct rusage *ru)
+{
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    struct proc *p = find_proc(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    fill_rusage(p, ru);
+    release_spin_lock(&p->lock);
+    return 0;
+}
+
+/* 
+ * Fill in at most n entries of the list of live processes, returns the number filled in
+ */
+int32_t procinfo(struct procinfo *info, int n)
+{
+    int i = 0;
+    for (struct proc *p = proc_list; p != NULL && i < n; p = p->next_proc) {
+        acquire_spin_lock(&p->lock);
+        if (p->state != UNUSED) {
+            info[i].pid = p->pid;
+            info[i].state = p->state;
+            info[i].last_cpu = p->last_cpu;
+            info[i].kthread = (p->flags & PF_KTHREAD) != 0;
+            safestrcpy(info[i].name, p->name, sizeof(info[i].name));
+            fill_rusage(p, &info[i].ru);
+            i++;
+        }
+        release_spin_lock(&p->lock);
+    }
+    return i;
+}
+
+/* 
+ * Fill in the time accounting of the first n CPUs, returns the number filled in
+ * The counters are read without locks, a CPU may be updating them at the same time.
+ */
+int32_t cpuinfo(struct cpuinfo *info, int n)
+{
+    int i;
+    uint64_t clock = counts_to_us(timestamp());
+    for (i = 0; i < NCPU && i < n; i++) {
+        info[i].clock = clock;
+        struct cpu *c = cpu_of(i);
+        info[i].utime = counts_to_us(c->utime);
+        info[i].stime = counts_to_us(c->stime);
+        info[i].idle_time = counts_to_us(c->idle_time);
+        info[i].nr_switches = c->nr_switches;
+    }
+    return i;
+}
+
+/* 
+ * Wait for a parentless process (a kernel thread being stopped) to exit, free it and return its exit status
+ * exit() wakes up the process itself as the channel instead of its parent in this case.
+ */
+int32_t waitproc(struct proc *p)
+{
+    int32_t xstate;
+    acquire_spin_lock(&wait_lock);
+    // p->state only becomes ZOMBIE with wait_lock held, see exit()
+    while (p->state != ZOMBIE) {
         sleep(p, &wait_lock);
     }
+    acquire_spin_lock(&p->lock);
+    xstate = p->xstate;
+    freeproc(p);
+    release_spin_lock(&p->lock);
+    release_spin_lock(&wait_lock);
+    return xstate;
+}
+
+/* 
+ * Make a process runnable, either a newly created one left in the EMBRYO state or a sleeping one. 
+ * A sleeping process wakes up as if its channel had been signalled, so it must recheck its condition.
+ */
+void wake_up_process(struct proc *p)
+{
+    acquire_spin_lock(&p->lock);
+    if (p->state == EMBRYO || p->state == SLEEPING) {
+        make_runnable(p);
+    }
+    release_spin_lock(&p->lock);
 }
 
 /* 
@@ -581,7 +1173,7 @@ void yield(void)
         return;
     }
     acquire_spin_lock(&p->lock);
-    p->state = RUNNABLE;
+    make_runnable(p);
     sched();
     release_spin_lock(&p->lock);
 }
@@ -589,21 +1181,42 @@ void yield(void)
 /* 
  * Adjust the virtual address space of a process
  */
-int32_t growproc(int64_t n)
+int32_t growproc(int64_t n, uint64_t *oldsz)
 {
-    struct proc *p = myproc();
-    int32_t sz = p->sz;
+    // All threads of a group grow the address space of the group leader
+    struct proc *p = myproc()->group_leader;
+    acquire_spin_lock(&p->grow_lock);
+    uint64_t sz = p->sz;
+    if (oldsz != NULL) {
+        *oldsz = sz;
+    }
 
     if (n > 0) {
-        if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) 
+        if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+            release_spin_lock(&p->grow_lock);
             return -1;
+        }
     } else if (n < 0) {
-        sz = uvmdealloc(p->pagetable, sz, sz + n);
+        // Threads of the group on other cores may still cache translations of the pages
+        sz = uvmdealloc_shared(p->pagetable, sz, sz + n);
     }
     p->sz = sz;
+    release_spin_lock(&p->grow_lock);
     return 0;
 }
 
+/*
+ * Take a reference to the working directory of the group of p, a sibling may be in chdir() meanwhile
+ */
+struct inode *proc_cwd(struct proc *p)
+{
+    struct proc *leader = p->group_leader;
+    acquire_spin_lock(&leader->lock);
+    struct inode *ip = idup(leader->cwd);
+    release_spin_lock(&leader->lock);
+    return ip;
+}
+
 /* 
  * Wake up other cores
  */
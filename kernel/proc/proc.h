@@ -16,9 +16,14 @@
 #include "../file/file.h"
 #include "arch/aarch64/arm.h"
 #include "arch/aarch64/include/context.h"
+#include "arch/aarch64/include/fpsimd.h"
 #include "memory/vm.h"
 #include "sync/spinlock.h"
 #include "arch/aarch64/include/trapframe.h"
+#include "include/rusage.h"
+#include "include/list.h"
+#include "sync/rcu.h"
+#include "include/percpu.h"
 
 enum process_state {
     UNUSED,
@@ -30,9 +35,17 @@ enum process_state {
 };
 
 enum task_flags {
-    PF_KTHREAD = 1 << 0,
+    PF_KTHREAD          = 1 << 0,   // Kernel thread, runs without a user page table
+    PF_KTHREAD_STOP     = 1 << 1,   // kthread_stop() has been called on the kernel thread
+    PF_KTHREAD_PARK     = 1 << 2,   // kthread_park() has been called on the kernel thread
+    PF_KTHREAD_PARKED   = 1 << 3,   // The kernel thread is sleeping in kthread_parkme()
+    PF_EXITING          = 1 << 4,   // The thread group leader is exiting, no new threads may be cloned
+    PF_EXECING          = 1 << 5,   // The thread group is replacing its image in exec(), no new threads may be cloned
 };
 
+// A process may run on every CPU by default
+#define CPU_MASK_ALL    ((1UL << NCPU) - 1)
+
 /*
  * Per-process state
  */
@@ -48,6 +61,14 @@ struct proc {
     
     // wait_lock must be held when using this:
     struct proc *parent;        // Points to the parent of the process
+    struct list_head children;  // Child processes, the exited ones first so wait() finds them at the head
+    struct list_head sibling;   // Entry in the children list of the parent
+    int nr_threads;             // Number of live threads in the group, only used in the group leader
+
+    // Threads created by clone() share the page table, size, open files and cwd of the group leader.
+    // Use p->group_leader->sz, ->ofile and ->cwd, which are the process's own for a single threaded process.
+    struct proc *group_leader;  // Thread group leader, the proc itself if it is not a thread
+    struct spinlock grow_lock;  // Serializes growproc() among the threads of a group, used in the group leader
 
     // these are private to the process, so p->lock need not be held.
     uint8_t *kstack;            // Virtual address of kernel stack
@@ -56,29 +77,68 @@ struct proc {
     struct trapframe *tf;       // Used when a process makes a system call
     struct context context;     // Hardware context, swtch() here to run process
     struct file *ofile[NOFILE]; // Open files
-    struct inode *cwd;          // Current working directory inode
+    struct inode *cwd;          // Current working directory inode, the group leader's is swapped under its lock
     char name[16];              // Process name for debugging
 
     // Newly added
     enum task_flags flags;      // Process flag bit
     long count;                 // Time slice for process scheduling
     int priority;               // Process priority
-};
+    uint64_t cpus_allowed;      // Bit mask of the CPUs the process may run on
+    int last_cpu;               // CPU the process last ran on, recorded at swich time, -1 if it never ran
+    uint64_t nr_migrations;     // Number of times the process was moved to another CPU
+
+    // CPU accounting in CNTPCT_EL0 counts, charged at trap entry/exit and in sched()
+    uint64_t utime;             // Time spent in user space
+    uint64_t stime;             // Time spent in the kernel
+    uint64_t wait_time;         // Time spent RUNNABLE waiting for a CPU
+    uint64_t nvcsw;             // Voluntary context switches, the process blocked
+    uint64_t nivcsw;            // Involuntary context switches, the process was preempted or yielded
+    uint64_t acct_stamp;        // Counter value when utime or stime was last charged
+    uint64_t runnable_stamp;    // Counter value when the process last became RUNNABLE
+    int (*threadfn)(void *);    // Entry function of a kernel thread
+    void *data;                 // Argument passed to threadfn
+
+    struct proc *next_proc;     // Next entry of the list of all procs, never changes once the proc is published
+    struct proc *pid_next;      // Next proc in the same PID hash bucket, or on the free list, protected by pid_lock
 
-struct process_table {
-    struct proc proc[NPROC];
+    // FP/SIMD registers, see fpsimd.c. Only saved and loaded for processes that use them.
+    struct fpsimd_state fpsimd; // Saved registers, up to date whenever the process is not running with them loaded
+    bool fpsimd_used;           // Has the process used FP/SIMD since it was created or exec'ed?
+    int fpsimd_cpu;             // CPU its registers were last loaded in, -1 if none
 };
 
+// wait_lock must be held when changing the kthread control bits of flags
+extern struct spinlock wait_lock;
+
 /*
  * Per-CPU state
  * The process structure of the CPU running process, the context of the CPU scheduling thread, and information used to manage interrupts 
  */
 struct cpu {
+    struct proc *proc;          // The process running on this cpu, or null. Must stay first, trap_asm.S loads it
     struct context context;     // swtch() here to enter scheduler()
-    struct proc *proc;          // The process running on this cpu, or null
     bool is_interrupt_enabled;  // Were interrupts enabled before push_off()
     int depth_spin_lock;        // Depth of push_off() nesting
     int cpuid;                  // for debug
+    bool need_resched;          // Set by the timer interrupt, the running process yields on the way out of the interrupt
+
+    // CPU accounting in CNTPCT_EL0 counts
+    uint64_t utime;             // Time spent running user space
+    uint64_t stime;             // Time spent in the kernel on behalf of processes
+    uint64_t idle_time;         // Time spent in the scheduler loop with nothing to run
+    uint64_t nr_switches;       // Number of switches to a process
+    uint64_t idle_stamp;        // Counter value when the scheduler last got the CPU back
+
+    // Lazy FP/SIMD switching, only used by this CPU with interrupts disabled
+    struct proc *fpsimd_last;           // Process whose FP/SIMD registers were last loaded in this CPU
+
+    // RCU, only used by this CPU with interrupts disabled
+    int rcu_read_depth;                 // Nesting of read-side critical sections
+    struct rcu_head *rcu_next_list;     // Callbacks queued by call_rcu() that have no grace period yet
+    struct rcu_head **rcu_next_tail;    // Where to append to rcu_next_list
+    struct rcu_head *rcu_wait_list;     // Callbacks waiting for grace period rcu_wait_gp to complete
+    uint64_t rcu_wait_gp;
 };
 
 #define INIT_TASK(task)     \
@@ -105,18 +165,57 @@ static inline uint64_t cpuid()
     return r_mpidr() & 0xFF;
 }
 
+DECLARE_PER_CPU(struct cpu, cpu_data);
+
 /**
  * @brief  Return this CPU's cpu struct, Interrupts must be disabled
  * @retval struct cpu* A pointer to the CPU structure
  */
-struct cpu *mycpu(void);
+static inline struct cpu *mycpu(void)
+{
+    return this_cpu_ptr(&cpu_data);
+}
 
 /**
- * @brief  Keep interrupt off while fetching process structure.  
- * Interrupts can be closed when the process structure is removed 
- * @retval Return the current struct proc *, or zero if none
+ * @brief  Return the cpu struct of CPU id
+ * @param  id: CPU id
+ * @retval struct cpu* A pointer to the CPU structure
  */
-struct proc *myproc(void);
+static inline struct cpu *cpu_of(int id)
+{
+    return per_cpu_ptr(&cpu_data, id);
+}
+
+/**
+ * @brief  The current process, kept in SP_EL0 while in the kernel (see trap_asm.S and run_proc()).
+ * A single MRS, and safe with interrupts enabled since the value belongs to the process, not to the CPU.
+ * @retval Return the current struct proc *, or zero in the scheduler
+ */
+static inline struct proc *get_current(void)
+{
+    return (struct proc *)r_sp_el0();
+}
+
+#define current     get_current()
+
+/**
+ * @brief  Return the current struct proc *, or zero if none
+ * @retval The current process
+ */
+static inline struct proc *myproc(void)
+{
+    return get_current();
+}
+
+/**
+ * @brief  Point this CPU at its per-CPU area and clear the current process, Called first thing by every CPU
+ * @retval None
+ */
+static inline void init_this_cpu(void)
+{
+    percpu_init(cpuid());
+    l_sp_el0(0);
+}
 
 /**
  * @brief  Wake up other cores
@@ -130,6 +229,13 @@ void init_awake_ap_by_spintable();
  */
 void init_cpu_info();
 
+/**
+ * @brief  Find an UNUSED proc, set it up to run in the kernel and return it in the EMBRYO state
+ * The caller is responsible for the user page table, the proc is returned with p->lock held.
+ * @retval The new proc, or NULL if none is available
+ */
+struct proc *allocproc(void);
+
 /**
  * @brief  Initialize the process management subsystem
  * @retval None
@@ -183,6 +289,31 @@ int32_t kill(int pid);
  */
 int32_t fork(void);
 
+/**
+ * @brief  Create a thread sharing the address space, open files and cwd of the current process
+ * @param  entry: User address at which the thread starts
+ * @param  arg: Passed to the thread in x0
+ * @param  stack: Top of the user stack of the thread
+ * @param  tls: Initial value of TPIDR_EL0 of the thread
+ * @retval Thread id of the new thread, -1 on failure
+ */
+int32_t clone(uint64_t entry, uint64_t arg, uint64_t stack, uint64_t tls);
+
+/**
+ * @brief  Take a reference to the working directory of the thread group of p
+ * @param  *p: Any thread of the group
+ * @retval The directory, to be put with iput()
+ */
+struct inode *proc_cwd(struct proc *p);
+
+/**
+ * @brief  Wait for a thread of the current thread group to exit and free it
+ * @param  tid: Thread id returned by clone()
+ * @param  *xstate: If not NULL, receives the exit status of the thread
+ * @retval 0 on success, -1 if tid is not another thread of the group
+ */
+int32_t join(int tid, int32_t *xstate);
+
 /**
  * @brief  Wait for a child process to exit and return its pid.
  * @param  *xstate: A pointer to the exit state
@@ -196,11 +327,83 @@ int32_t wait(int64_t *xstate);
  */
 void yield(void);
 
+/**
+ * @brief  Make a process created in the EMBRYO state or sleeping process runnable
+ * @param  *p: The process to wake up
+ * @retval None
+ */
+void wake_up_process(struct proc *p);
+
+/**
+ * @brief  Wait for a parentless process (a kernel thread) to exit and free it
+ * @param  *p: The process to wait for
+ * @retval The exit status of the process
+ */
+int32_t waitproc(struct proc *p);
+
+/**
+ * @brief  Set the mask of CPUs a process may run on
+ * @param  pid: The process, 0 for the calling process
+ * @param  mask: Bit mask of CPUs, bits past NCPU are ignored
+ * @retval 0 on success, -1 if there is no such process, it is a kernel thread or the mask has no CPU
+ */
+int32_t sched_setaffinity(int pid, uint64_t mask);
+
+/**
+ * @brief  Get the mask of CPUs a process may run on
+ * @param  pid: The process, 0 for the calling process
+ * @retval The bit mask of CPUs, -1 if there is no such process
+ */
+int64_t sched_getaffinity(int pid);
+
+/**
+ * @brief  Charge the time since the last accounting point to user time, called on trap entry from EL0
+ * @retval None
+ */
+void account_enter_kernel(void);
+
+/**
+ * @brief  Charge the time since the last accounting point to system time, called before returning to EL0
+ * @retval None
+ */
+void account_return_user(void);
+
+/**
+ * @brief  Get the resource usage of a process
+ * @param  pid: The process, 0 for the calling process
+ * @param  *ru: Filled in with times in microseconds
+ * @retval 0 on success, -1 if there is no such process
+ */
+int32_t getrusage(int pid, struct rusage *ru);
+
+/**
+ * @brief  Fill in the list of live processes
+ * @param  *info: Array of n entries
+ * @param  n: Size of the array
+ * @retval Number of entries filled in
+ */
+int32_t procinfo(struct procinfo *info, int n);
+
+/**
+ * @brief  Fill in the time accounting of every CPU
+ * @param  *info: Array of n entries, entry i describes CPU i
+ * @param  n: Size of the array
+ * @retval Number of entries filled in
+ */
+int32_t cpuinfo(struct cpuinfo *info, int n);
+
+/**
+ * @brief  Print the process list to the console for debugging
+ * @retval None
+ */
+void proc_dump(void);
+
 /**
  * @brief  Adjust the virtual address space of a process
  * @param  n: Number of bytes to add or subtract
+ * @param  *oldsz: If not NULL, receives the size before the change
  * @retval 0 means success and -1 means failure
  */
-int32_t growproc(int64_t n);
+int32_t growproc(int64_t n, uint64_t *oldsz);
 
 #endif /* PROC_H */
\ No newline at end of file
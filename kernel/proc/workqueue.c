@@ -0,0 +1,106 @@
+/**
+ * @file workqueue.c
+ * @author ylp
+ * @brief Work queues, deferred work run by kernel threads, refer to the Linux kernel source code
+ * kernel/workqueue.c (5.10.0)
+ * @version 0.1
+ * @date 2022-06-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "workqueue.h"
+#include "kthread.h"
+#include "proc.h"
+#include "../printf.h"
+
+struct workqueue_struct system_wq;
+
+/*
+ * Worker thread, runs the work of the queue in order and sleeps on the queue when there is none
+ */
+static int worker_thread(void *data)
+{
+    struct workqueue_struct *wq = data;
+    acquire_spin_lock(&wq->lock);
+    while (!kthread_should_stop()) {
+        if (list_is_empty(&wq->worklist)) {
+            sleep(wq, &wq->lock);
+            continue;
+        }
+        struct work_struct *work = list_first_entry(&wq->worklist, struct work_struct, entry);
+        list_del(&work->entry);
+        INIT_LIST_HEAD(&work->entry);
+        // From here on the work may be queued again, and will run once more
+        work->pending = false;
+        release_spin_lock(&wq->lock);
+        work->func(work);
+        acquire_spin_lock(&wq->lock);
+        wq->nr_done++;
+        wakeup(&wq->nr_done);
+    }
+    release_spin_lock(&wq->lock);
+    return 0;
+}
+
+/*
+ * Initialize a work queue and start its worker thread
+ */
+int init_workqueue(struct workqueue_struct *wq, const char *name)
+{
+    init_spin_lock(&wq->lock, "workqueue");
+    INIT_LIST_HEAD(&wq->worklist);
+    wq->nr_queued = wq->nr_done = 0;
+    wq->name = name;
+    wq->worker = kthread_run(worker_thread, wq, name);
+    return wq->worker ? 0 : -1;
+}
+
+/*
+ * Queue work on a work queue
+ */
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+    bool queued = false;
+    acquire_spin_lock(&wq->lock);
+    if (!work->pending) {
+        work->pending = true;
+        list_add_tail(&work->entry, &wq->worklist);
+        wq->nr_queued++;
+        queued = true;
+        wakeup(wq);
+    }
+    release_spin_lock(&wq->lock);
+    return queued;
+}
+
+/*
+ * Queue work on the system work queue
+ */
+bool schedule_work(struct work_struct *work)
+{
+    return queue_work(&system_wq, work);
+}
+
+/*
+ * Wait until all the work queued before the call is done
+ */
+void flush_workqueue(struct workqueue_struct *wq)
+{
+    acquire_spin_lock(&wq->lock);
+    uint64_t target = wq->nr_queued;
+    while (wq->nr_done < target) {
+        sleep(&wq->nr_done, &wq->lock);
+    }
+    release_spin_lock(&wq->lock);
+}
+
+/*
+ * Start the system work queue
+ */
+void workqueue_init(void)
+{
+    if (init_workqueue(&system_wq, "kworker") < 0)
+        panic("workqueue_init: can not start the system work queue.\n");
+}
@@ -0,0 +1,91 @@
+/**
+ * @file workqueue.h
+ * @author ylp
+ * @brief Work queues, deferred work run by kernel threads, refer to the Linux kernel source code
+ * include/linux/workqueue.h (5.10.0)
+ * @version 0.1
+ * @date 2022-06-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "include/stdint.h"
+#include "include/list.h"
+#include "sync/spinlock.h"
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+/*
+ * A piece of work, embedded in the structure it works on. Unlike a tasklet it runs in process context,
+ * so it may sleep, take sleep locks and do I/O.
+ */
+struct work_struct {
+    struct list_head entry;     // Entry in the work list of the queue, protected by the queue lock
+    bool pending;               // Queued and not started yet, queueing it again has no effect
+    work_func_t func;
+};
+
+#define INIT_WORK(work, fn)                 \
+do {                                        \
+    INIT_LIST_HEAD(&(work)->entry);         \
+    (work)->pending = false;                \
+    (work)->func = (fn);                    \
+} while (0)
+
+/*
+ * A queue of work run in order by one kernel thread
+ */
+struct workqueue_struct {
+    struct spinlock lock;
+    struct list_head worklist;  // Queued work, oldest first
+    struct proc *worker;        // The kernel thread running the work
+    uint64_t nr_queued;         // Work queued since boot, to wait for in flush_workqueue()
+    uint64_t nr_done;           // Work done since boot
+    const char *name;
+};
+
+// Queue for work that has no queue of its own
+extern struct workqueue_struct system_wq;
+
+/**
+ * @brief  Initialize a work queue and start its worker thread
+ * @param  *wq: The work queue
+ * @param  *name: Name of the worker thread
+ * @retval 0 on success, -1 if the thread could not be created
+ */
+int init_workqueue(struct workqueue_struct *wq, const char *name);
+
+/**
+ * @brief  Queue work on a work queue, Can be called from interrupt and softirq context
+ * @param  *wq: The work queue
+ * @param  *work: The work
+ * @retval true if queued, false if it was pending already
+ */
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+
+/**
+ * @brief  Queue work on the system work queue
+ * @param  *work: The work
+ * @retval true if queued, false if it was pending already
+ */
+bool schedule_work(struct work_struct *work);
+
+/**
+ * @brief  Wait until all the work queued before the call is done, Process context only
+ * @param  *wq: The work queue
+ * @retval None
+ */
+void flush_workqueue(struct workqueue_struct *wq);
+
+/**
+ * @brief  Start the system work queue, Called once at boot
+ * @retval None
+ */
+void workqueue_init(void);
+
+#endif /* WORKQUEUE_H */
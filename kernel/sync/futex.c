@@ -0,0 +1,144 @@
+/**
+ * @file futex.c
+ * @author ylp
+ * @brief Fast user space mutexes, refer to the Linux kernel source code kernel/futex.c
+ * @version 0.1
+ * @date 2022-05-14
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "futex.h"
+#include "spinlock.h"
+#include "include/list.h"
+#include "include/param.h"
+#include "proc/proc.h"
+#include "memory/vm.h"
+#include "arch/aarch64/mmu.h"
+
+extern uint64_t ticks;
+
+/*
+ * A process sleeping in futex_wait(), lives on its kernel stack
+ */
+struct futex_q {
+    uint64_t key;               // Kernel address of the futex word, the same for every process mapping the page
+    void *chan;                 // Channel the waiter sleeps on
+    bool woken;                 // Set by futex_wake() after unlinking the waiter
+    struct list_head list;      // Entry in the hash bucket
+};
+
+/*
+ * Waiters hashed by key, the bucket lock also orders the check of the futex word against wake ups
+ */
+struct futex_bucket {
+    struct spinlock lock;
+    struct list_head chain;
+};
+
+static struct futex_bucket futex_queues[NFUTEXHASH];
+
+/*
+ * Initialize the futex hash table
+ */
+void futex_init(void)
+{
+    for (int i = 0; i < NFUTEXHASH; ++i) {
+        init_spin_lock(&futex_queues[i].lock, "futex");
+        INIT_LIST_HEAD(&futex_queues[i].chain);
+    }
+}
+
+/*
+ * Translate the futex word at uaddr of the current process to its key, the kernel alias of the physical address.
+ * Threads sharing a page table, or any mapping of the same page, get the same key. Returns 0 on a bad address.
+ */
+static uint64_t futex_key(uint64_t uaddr)
+{
+    struct proc *p = myproc()->group_leader;
+    if ((uaddr % sizeof(uint32_t)) != 0 || uaddr + sizeof(uint32_t) > p->sz) {
+        return 0;
+    }
+    uint64_t page = walkaddr(p->pagetable, PGROUNDDOWN(uaddr));
+    if (page == 0) {
+        return 0;
+    }
+    return page + (uaddr & (PGSIZE - 1));
+}
+
+/*
+ * Hash a key to its bucket
+ */
+static struct futex_bucket *futex_hash(uint64_t key)
+{
+    return &futex_queues[(key >> 2) % NFUTEXHASH];
+}
+
+/*
+ * Sleep on the futex word at uaddr of the current process if it holds val, for at most timeout ticks if timeout is not 0
+ */
+int64_t futex_wait(uint64_t uaddr, uint32_t val, uint64_t timeout)
+{
+    struct proc *p = myproc();
+    uint64_t key = futex_key(uaddr);
+    if (key == 0) {
+        return -1;
+    }
+    struct futex_bucket *hb = futex_hash(key);
+    acquire_spin_lock(&hb->lock);
+    // A user changes the word before calling futex_wake(), which takes the bucket lock,
+    // so checking it with the lock held cannot miss a wake up
+    if (*(volatile uint32_t *)key != val) {
+        release_spin_lock(&hb->lock);
+        return FUTEX_EAGAIN;
+    }
+
+    struct futex_q q;
+    q.key = key;
+    q.woken = false;
+    // A timed waiter sleeps on the ticks so that it notices the deadline, futex_wake() wakes that channel too
+    q.chan = timeout ? (void *)&ticks : (void *)&q;
+    list_add_tail(&q.list, &hb->chain);
+    uint64_t deadline = ticks + timeout;
+    while (!q.woken && !p->killed && (timeout == 0 || ticks < deadline)) {
+        sleep(q.chan, &hb->lock);
+    }
+    if (!q.woken) {
+        list_del(&q.list);
+    }
+    release_spin_lock(&hb->lock);
+
+    if (q.woken) {
+        return 0;
+    }
+    return p->killed ? -1 : FUTEX_ETIMEDOUT;
+}
+
+/*
+ * Wake up at most nr_wake waiters of the futex word at uaddr of the current process, return the number woken up
+ */
+int64_t futex_wake(uint64_t uaddr, int64_t nr_wake)
+{
+    uint64_t key = futex_key(uaddr);
+    if (key == 0) {
+        return -1;
+    }
+    struct futex_bucket *hb = futex_hash(key);
+    int64_t nr_woken = 0;
+    acquire_spin_lock(&hb->lock);
+    struct list_head *pos = hb->chain.next;
+    while (pos != &hb->chain && nr_woken < nr_wake) {
+        struct futex_q *q = list_entry(pos, struct futex_q, list);
+        pos = pos->next;
+        if (q->key == key) {
+            // q stays valid until we drop the bucket lock, the waiter needs it to return
+            list_del(&q->list);
+            q->woken = true;
+            wakeup(q->chan);
+            nr_woken++;
+        }
+    }
+    release_spin_lock(&hb->lock);
+    return nr_woken;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file futex.h
+ * @author ylp
+ * @brief Fast user space mutexes, refer to the Linux kernel source code kernel/futex.c
+ * @version 0.1
+ * @date 2022-05-14
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "include/stdint.h"
+
+#define FUTEX_WAIT          0       // Sleep if the futex word still holds the expected value
+#define FUTEX_WAKE          1       // Wake up at most val waiters of the futex word
+
+#define FUTEX_EAGAIN        (-11)   // The futex word did not hold the expected value
+#define FUTEX_ETIMEDOUT     (-110)  // The timeout expired before a wake up
+
+/**
+ * @brief  Initialize the futex hash table
+ * @retval None
+ */
+void futex_init(void);
+
+/**
+ * @brief  Sleep on the futex word at uaddr of the current process if it holds val
+ * @param  uaddr: User virtual address of a 4-byte aligned futex word
+ * @param  val: Expected value of the futex word
+ * @param  timeout: Maximum number of ticks to sleep, 0 to sleep until woken up
+ * @retval 0 when woken up, FUTEX_EAGAIN, FUTEX_ETIMEDOUT, or -1 on a bad address or if killed
+ */
+int64_t futex_wait(uint64_t uaddr, uint32_t val, uint64_t timeout);
+
+/**
+ * @brief  Wake up waiters of the futex word at uaddr of the current process
+ * @param  uaddr: User virtual address of a 4-byte aligned futex word
+ * @param  nr_wake: Maximum number of waiters to wake up
+ * @retval Number of waiters woken up, or -1 on a bad address
+ */
+int64_t futex_wake(uint64_t uaddr, int64_t nr_wake);
+
+#endif /* FUTEX_H */
@@ -0,0 +1,164 @@
+/**
+ * @file lockstat.c
+ * @author ylp
+ * @brief Lock contention statistics per lock class, refer to the Linux kernel source code kernel/locking/lockdep.c (CONFIG_LOCK_STAT)
+ * @version 0.1
+ * @date 2022-06-02
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "lockstat.h"
+#include "spinlock.h"
+#include "proc/proc.h"
+#include "lib/string.h"
+
+#ifdef LOCKSTAT
+
+/*
+ * Classes are only ever added, a lock keeps a pointer to its class for its whole life.
+ * The registry lock is not registered itself (stat is NULL), or taking it would recurse.
+ */
+static struct {
+    struct spinlock lock;
+    int nclass;
+    struct lock_class class[NLOCKCLASS];
+} lockstat = { .lock = { .name = "lockstat" } };
+
+/*
+ * Find the class of the locks named name, creating it on first use
+ */
+struct lock_class *lockstat_class(const char *name)
+{
+    struct lock_class *class = NULL;
+    if (name == NULL)
+        return NULL;
+    acquire_spin_lock(&lockstat.lock);
+    for (int i = 0; i < lockstat.nclass; i++) {
+        if (strncmp(lockstat.class[i].name, name, strlen(name) + 1) == 0) {
+            class = &lockstat.class[i];
+            break;
+        }
+    }
+    if (class == NULL && lockstat.nclass < NLOCKCLASS) {
+        class = &lockstat.class[lockstat.nclass];
+        class->name = name;
+        lockstat.nclass++;
+    }
+    release_spin_lock(&lockstat.lock);
+    return class;
+}
+
+/*
+ * Account an acquisition of a lock of the class on this CPU
+ */
+void lockstat_acquired(struct lock_class *class, uint64_t wait, bool contended)
+{
+    if (class == NULL)
+        return;
+    struct lock_stat *st = &class->cpu[cpuid()];
+    st->acquisitions++;
+    if (contended) {
+        st->contended++;
+        st->wait_cycles += wait;
+        if (wait > st->max_wait_cycles)
+            st->max_wait_cycles = wait;
+    }
+}
+
+/*
+ * Account a release of a lock of the class on this CPU
+ */
+void lockstat_released(struct lock_class *class, uint64_t hold)
+{
+    if (class == NULL)
+        return;
+    struct lock_stat *st = &class->cpu[cpuid()];
+    st->hold_cycles += hold;
+    if (hold > st->max_hold_cycles)
+        st->max_hold_cycles = hold;
+}
+
+/*
+ * Count an event of a sleep lock of the class on this CPU
+ */
+void lockstat_count(struct lock_class *class, enum lockstat_event event)
+{
+    if (class == NULL)
+        return;
+    struct lock_stat *st = &class->cpu[cpuid()];
+    switch (event) {
+    case LOCKSTAT_SPIN:
+        st->spins++;
+        break;
+    case LOCKSTAT_SLEEP:
+        st->sleeps++;
+        break;
+    case LOCKSTAT_WAKEUP:
+        st->wakeups++;
+        break;
+    }
+}
+
+/*
+ * Copy the statistics of at most n lock classes, summed over the CPUs, and clear them if asked to
+ * Counters updated by other CPUs meanwhile may be off by one event, which is fine for statistics.
+ */
+int32_t lockstat_read(struct lockinfo *info, int n, int flags)
+{
+    int nclass = __atomic_load_n(&lockstat.nclass, __ATOMIC_ACQUIRE);
+    int i;
+    for (i = 0; i < nclass && i < n; i++) {
+        struct lock_class *class = &lockstat.class[i];
+        struct lock_stat *sum = &info[i].stat;
+        safestrcpy(info[i].name, class->name, sizeof(info[i].name));
+        memset(sum, 0, sizeof(*sum));
+        for (int c = 0; c < NCPU; c++) {
+            struct lock_stat *st = &class->cpu[c];
+            sum->acquisitions += st->acquisitions;
+            sum->contended += st->contended;
+            sum->wait_cycles += st->wait_cycles;
+            sum->hold_cycles += st->hold_cycles;
+            sum->spins += st->spins;
+            sum->sleeps += st->sleeps;
+            sum->wakeups += st->wakeups;
+            if (st->max_wait_cycles > sum->max_wait_cycles)
+                sum->max_wait_cycles = st->max_wait_cycles;
+            if (st->max_hold_cycles > sum->max_hold_cycles)
+                sum->max_hold_cycles = st->max_hold_cycles;
+        }
+    }
+    if (flags & LOCKSTAT_RESET) {
+        for (int j = 0; j < nclass; j++) {
+            memset(lockstat.class[j].cpu, 0, sizeof(lockstat.class[j].cpu));
+        }
+    }
+    return i;
+}
+
+#else
+
+struct lock_class *lockstat_class(const char *name)
+{
+    return NULL;
+}
+
+void lockstat_acquired(struct lock_class *class, uint64_t wait, bool contended)
+{
+}
+
+void lockstat_released(struct lock_class *class, uint64_t hold)
+{
+}
+
+void lockstat_count(struct lock_class *class, enum lockstat_event event)
+{
+}
+
+int32_t lockstat_read(struct lockinfo *info, int n, int flags)
+{
+    return -1;
+}
+
+#endif /* LOCKSTAT */
@@ -0,0 +1,103 @@
+/**
+ * @file lockstat.h
+ * @author ylp
+ * @brief Lock contention statistics per lock class, refer to the Linux kernel source code include/linux/lockdep.h (CONFIG_LOCK_STAT)
+ * @version 0.1
+ * @date 2022-06-02
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "include/param.h"
+
+#define LOCKSTAT_RESET  1   // lockstat() flag, clear the statistics after reading them
+
+/*
+ * Statistics of one lock class gathered by one CPU, times in CNTPCT_EL0 counts
+ */
+struct lock_stat {
+    uint64_t acquisitions;      // Number of times a lock of the class was taken
+    uint64_t contended;         // Acquisitions that had to wait for another holder
+    uint64_t wait_cycles;       // Total time spent waiting to get the lock
+    uint64_t max_wait_cycles;   // Longest wait
+    uint64_t hold_cycles;       // Total time the lock was held
+    uint64_t max_hold_cycles;   // Longest hold
+    uint64_t spins;             // Contended acquisitions of sleep locks that got the lock by spinning, without sleeping
+    uint64_t sleeps;            // Times a waiter went to sleep on a sleep lock
+    uint64_t wakeups;           // Releases of sleep locks that had to wake up sleepers
+};
+
+/*
+ * Events of sleep locks counted by lockstat_count()
+ */
+enum lockstat_event {
+    LOCKSTAT_SPIN,
+    LOCKSTAT_SLEEP,
+    LOCKSTAT_WAKEUP
+};
+
+/*
+ * All the locks initialized with the same name form one class. Every CPU updates its own entry
+ * with interrupts off, so the counters need neither atomics nor a lock.
+ */
+struct lock_class {
+    const char *name;
+    struct lock_stat cpu[NCPU];
+};
+
+/*
+ * One entry of the lock statistics reported to user space
+ */
+struct lockinfo {
+    char name[16];
+    struct lock_stat stat;      // Summed over the CPUs
+};
+
+/**
+ * @brief  Find the class of the locks named name, creating it on first use
+ * @param  *name: Lock name, compared by content
+ * @retval The class, or NULL if the class table is full or statistics are compiled out
+ */
+struct lock_class *lockstat_class(const char *name);
+
+/**
+ * @brief  Account an acquisition of a lock of the class, Interrupts must be disabled
+ * @param  *class: The lock class, may be NULL
+ * @param  wait: Counts spent waiting for the lock
+ * @param  contended: Whether the lock was held by someone else when we asked for it
+ * @retval None
+ */
+void lockstat_acquired(struct lock_class *class, uint64_t wait, bool contended);
+
+/**
+ * @brief  Account a release of a lock of the class, Interrupts must be disabled
+ * @param  *class: The lock class, may be NULL
+ * @param  hold: Counts the lock was held for
+ * @retval None
+ */
+void lockstat_released(struct lock_class *class, uint64_t hold);
+
+/**
+ * @brief  Count an event of a sleep lock of the class, Interrupts must be disabled
+ * @param  *class: The lock class, may be NULL
+ * @param  event: What happened
+ * @retval None
+ */
+void lockstat_count(struct lock_class *class, enum lockstat_event event);
+
+/**
+ * @brief  Copy the statistics of at most n lock classes
+ * @param  *info: Array of n entries
+ * @param  n: Size of the array
+ * @param  flags: LOCKSTAT_RESET to clear the statistics afterwards
+ * @retval Number of entries filled in, -1 if statistics are compiled out
+ */
+int32_t lockstat_read(struct lockinfo *info, int n, int flags);
+
+#endif /* LOCKSTAT_H */
@@ -0,0 +1,180 @@
+/**
+ * @file rcu.c
+ * @author ylp
+ * @brief Read-copy-update with grace periods detected through the scheduler, refer to the Linux kernel source code kernel/rcu/tiny.c
+ * @version 0.1
+ * @date 2022-05-28
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "rcu.h"
+#include "spinlock.h"
+#include "include/param.h"
+#include "include/compiler_attributes.h"
+#include "proc/proc.h"
+#include "../printf.h"
+
+/*
+ * Readers never sleep and can not be preempted, so a CPU that gets back to scheduler() has left
+ * every read-side critical section it was in. A grace period starts with the bits of all CPUs set
+ * in qs_mask and ends when the last CPU clears its bit there.
+ */
+static struct {
+    struct spinlock lock;
+    uint64_t completed;         // Number of grace periods that have ended
+    uint64_t needed;            // Grace periods must keep running until completed reaches this
+    bool active;                // A grace period is in progress, it will be number completed + 1
+    uint64_t qs_mask;           // CPUs that have not passed a quiescent state in the current grace period
+    uint64_t online_mask;       // CPUs that have reached the scheduler, the others do not hold up grace periods
+} rcu_state;
+
+/*
+ * Initialize the grace period state
+ */
+void rcu_init(void)
+{
+    init_spin_lock(&rcu_state.lock, "rcu");
+    rcu_state.completed = 0;
+    rcu_state.needed = 0;
+    rcu_state.active = false;
+    rcu_state.qs_mask = 0;
+    rcu_state.online_mask = 0;
+}
+
+/*
+ * Enter a read-side critical section
+ * Turning interrupts off keeps the timer from preempting the reader, and the per-CPU depth lets sched() catch a reader that sleeps.
+ */
+void rcu_read_lock(void)
+{
+    push_off();
+    mycpu()->rcu_read_depth++;
+}
+
+/*
+ * Leave a read-side critical section
+ */
+void rcu_read_unlock(void)
+{
+    struct cpu *c = mycpu();
+    if (c->rcu_read_depth < 1) 
+        panic("rcu_read_unlock: not in a read-side critical section.\n");
+    c->rcu_read_depth--;
+    pop_off();
+}
+
+/*
+ * Start a grace period, rcu_state.lock must be held
+ */
+static void rcu_start_gp(void)
+{
+    rcu_state.active = true;
+    rcu_state.qs_mask = rcu_state.online_mask;
+    // Nobody to wait for before the first CPU gets to the scheduler
+    if (rcu_state.qs_mask == 0) {
+        rcu_state.active = false;
+        rcu_state.completed++;
+    }
+}
+
+/*
+ * Return the number of the first grace period that starts after now, starting one if none is running
+ * Waiting for it to complete guarantees that every reader running now has finished.
+ */
+static uint64_t rcu_gp_target(void)
+{
+    uint64_t target;
+    acquire_spin_lock(&rcu_state.lock);
+    // A grace period in progress may already have seen the quiescent states of some CPUs, the next one is needed
+    target = rcu_state.completed + (rcu_state.active ? 2 : 1);
+    if (target > rcu_state.needed) 
+        rcu_state.needed = target;
+    if (!rcu_state.active) 
+        rcu_start_gp();
+    release_spin_lock(&rcu_state.lock);
+    return target;
+}
+
+/*
+ * Queue func(head) on this CPU, it is called once a grace period has elapsed
+ * Callbacks wait on the next list until the wait list is free, and a whole batch then waits for one grace period.
+ */
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head))
+{
+    head->func = func;
+    head->next = NULL;
+    push_off();
+    struct cpu *c = mycpu();
+    *c->rcu_next_tail = head;
+    c->rcu_next_tail = &head->next;
+    pop_off();
+}
+
+/*
+ * Sleep until a full grace period has elapsed
+ */
+void synchronize_rcu(void)
+{
+    uint64_t target = rcu_gp_target();
+    acquire_spin_lock(&rcu_state.lock);
+    while (rcu_state.completed < target) {
+        sleep(&rcu_state, &rcu_state.lock);
+    }
+    release_spin_lock(&rcu_state.lock);
+}
+
+/*
+ * Clear the bit of this CPU in the current grace period, the last CPU ends the grace period
+ */
+static void rcu_report_qs(int cpu)
+{
+    // Read without the lock first, the scheduler loop runs this all the time
+    if ((READ_ONCE(rcu_state.online_mask) & (1UL << cpu)) && !(READ_ONCE(rcu_state.qs_mask) & (1UL << cpu))) 
+        return;
+    acquire_spin_lock(&rcu_state.lock);
+    // A CPU takes part in grace periods from the first time it gets to the scheduler
+    rcu_state.online_mask |= 1UL << cpu;
+    if (rcu_state.active && (rcu_state.qs_mask & (1UL << cpu))) {
+        rcu_state.qs_mask &= ~(1UL << cpu);
+        if (rcu_state.qs_mask == 0) {
+            rcu_state.active = false;
+            rcu_state.completed++;
+            if (rcu_state.needed > rcu_state.completed) 
+                rcu_start_gp();
+            // synchronize_rcu() callers
+            wakeup(&rcu_state);
+        }
+    }
+    release_spin_lock(&rcu_state.lock);
+}
+
+/*
+ * Report a quiescent state of this CPU and run its callbacks whose grace period has ended
+ */
+void rcu_quiescent_state(void)
+{
+    struct cpu *c = mycpu();
+    if (c->rcu_read_depth != 0) 
+        panic("rcu_quiescent_state: cpu %d in a read-side critical section.\n", c->cpuid);
+    rcu_report_qs(c->cpuid);
+
+    // The batch on the wait list is safe to reclaim once its grace period has completed
+    if (c->rcu_wait_list != NULL && READ_ONCE(rcu_state.completed) >= c->rcu_wait_gp) {
+        struct rcu_head *head = c->rcu_wait_list;
+        c->rcu_wait_list = NULL;
+        while (head != NULL) {
+            struct rcu_head *next = head->next;
+            head->func(head);
+            head = next;
+        }
+    }
+    // Start the next batch on its grace period
+    if (c->rcu_wait_list == NULL && c->rcu_next_list != NULL) {
+        c->rcu_wait_list = c->rcu_next_list;
+        c->rcu_next_list = NULL;
+        c->rcu_next_tail = &c->rcu_next_list;
+        c->rcu_wait_gp = rcu_gp_target();
+    }
+}
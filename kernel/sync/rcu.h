@@ -0,0 +1,76 @@
+/**
+ * @file rcu.h
+ * @author ylp
+ * @brief Read-copy-update, refer to the Linux kernel source code include/linux/rcupdate.h
+ * @version 0.1
+ * @date 2022-05-28
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef RCU_H
+#define RCU_H
+
+#include "include/stdint.h"
+
+/*
+ * Deferred callback, embedded in the object it frees
+ */
+struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+};
+
+/*
+ * Publish p at the location of the RCU protected pointer, readers that see p see it initialized
+ */
+#define rcu_assign_pointer(ptr, p)  __atomic_store_n(&(ptr), (p), __ATOMIC_RELEASE)
+
+/*
+ * Read an RCU protected pointer inside a read-side critical section
+ */
+#define rcu_dereference(ptr)        __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+
+/**
+ * @brief  Initialize the grace period state
+ * @retval None
+ */
+void rcu_init(void);
+
+/**
+ * @brief  Enter a read-side critical section, which may nest. It can not sleep, the CPU is not
+ * preempted until the matching rcu_read_unlock(), and the objects it reads are not reclaimed before that.
+ * @retval None
+ */
+void rcu_read_lock(void);
+
+/**
+ * @brief  Leave a read-side critical section
+ * @retval None
+ */
+void rcu_read_unlock(void);
+
+/**
+ * @brief  Call func(head) on this CPU once every CPU has passed a quiescent state, that is once every
+ * read-side critical section that might still see the object has ended. func runs in the scheduler, it must not sleep.
+ * @param  *head: Embedded in the object to reclaim
+ * @param  func: Reclaims the object
+ * @retval None
+ */
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head));
+
+/**
+ * @brief  Sleep until a full grace period has elapsed, must be called from process context outside any read-side critical section
+ * @retval None
+ */
+void synchronize_rcu(void);
+
+/**
+ * @brief  Report a quiescent state of this CPU and run its callbacks whose grace period has ended
+ * Called from the scheduler loop, where the CPU can not be inside a read-side critical section. Interrupts must be disabled.
+ * @retval None
+ */
+void rcu_quiescent_state(void);
+
+#endif /* RCU_H */
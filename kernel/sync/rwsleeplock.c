@@ -0,0 +1,145 @@
+/**
+ * @file rwsleeplock.c
+ * @author ylp
+ * @brief Reader-writer sleep locks, any number of readers or a single writer
+ * @version 0.1
+ * @date 2022-05-24
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "rwsleeplock.h"
+#include "spinlock.h"
+#include "lockstat.h"
+#include "../proc/proc.h"
+#include "../printf.h"
+
+/*
+ * Initialize the reader-writer sleep lock structure
+ */
+void init_rw_sleep_lock(struct rwsleeplock *lock, char *name)
+{
+    init_spin_lock(&lock->lk, "rwsleeplock");
+    lock->name = name;
+    lock->readers = 0;
+    lock->writer = false;
+    lock->writers_waiting = 0;
+    lock->pid = 0;
+    lock->stat = lockstat_class(name);
+    lock->stamp = 0;
+}
+
+/*
+ * Acquire a reader-writer sleep lock shared
+ * New readers queue behind a waiting writer, otherwise readers that keep overlapping would starve it.
+ */
+void acquire_rw_sleep_lock_shared(struct rwsleeplock *lock)
+{
+    uint64_t start = lock->stat ? timestamp() : 0;
+    bool contended = false;
+    acquire_spin_lock(&lock->lk);
+    while (lock->writer || lock->writers_waiting > 0) {
+        contended = true;
+        sleep(lock, &lock->lk);
+    }
+    lock->readers++;
+    if (lock->stat)
+        lockstat_acquired(lock->stat, timestamp() - start, contended);
+    release_spin_lock(&lock->lk);
+}
+
+/*
+ * Release a reader-writer sleep lock held shared, the last reader wakes up the waiting writers
+ */
+void release_rw_sleep_lock_shared(struct rwsleeplock *lock)
+{
+    acquire_spin_lock(&lock->lk);
+    if (lock->readers < 1)
+        panic("release_rw_sleep_lock_shared: %s is not held shared.\n", lock->name);
+    lock->readers--;
+    if (lock->readers == 0) {
+        wakeup(lock);
+    }
+    release_spin_lock(&lock->lk);
+}
+
+/*
+ * Acquire a reader-writer sleep lock exclusive
+ */
+void acquire_rw_sleep_lock_exclusive(struct rwsleeplock *lock)
+{
+    uint64_t start = lock->stat ? timestamp() : 0;
+    bool contended = false;
+    acquire_spin_lock(&lock->lk);
+    lock->writers_waiting++;
+    while (lock->writer || lock->readers > 0) {
+        contended = true;
+        sleep(lock, &lock->lk);
+    }
+    lock->writers_waiting--;
+    lock->writer = true;
+    lock->pid = myproc()->pid;
+    if (lock->stat) {
+        lock->stamp = timestamp();
+        lockstat_acquired(lock->stat, lock->stamp - start, contended);
+    }
+    release_spin_lock(&lock->lk);
+}
+
+/*
+ * Release a reader-writer sleep lock held exclusive, Wake up blocked process on the lock
+ */
+void release_rw_sleep_lock_exclusive(struct rwsleeplock *lock)
+{
+    acquire_spin_lock(&lock->lk);
+    if (lock->stat)
+        lockstat_released(lock->stat, timestamp() - lock->stamp);
+    lock->writer = false;
+    lock->pid = 0;
+    wakeup(lock);
+    release_spin_lock(&lock->lk);
+}
+
+/*
+ * Turn the exclusive hold of the current process into a shared one
+ * Used to read in state under the exclusive lock and then carry on reading along with other readers.
+ */
+void downgrade_rw_sleep_lock(struct rwsleeplock *lock)
+{
+    acquire_spin_lock(&lock->lk);
+    if (!lock->writer || lock->pid != myproc()->pid)
+        panic("downgrade_rw_sleep_lock: %s is not held exclusive.\n", lock->name);
+    if (lock->stat)
+        lockstat_released(lock->stat, timestamp() - lock->stamp);
+    lock->writer = false;
+    lock->pid = 0;
+    lock->readers = 1;
+    // Readers queued behind a waiting writer keep waiting for it
+    wakeup(lock);
+    release_spin_lock(&lock->lk);
+}
+
+/*
+ * Check whether the current process holds the lock exclusive
+ */
+bool is_current_proc_holding_rw_sleep_lock_exclusive(struct rwsleeplock *lock)
+{
+    bool r;
+    acquire_spin_lock(&lock->lk);
+    r = (lock->writer && (lock->pid == myproc()->pid));
+    release_spin_lock(&lock->lk);
+    return r;
+}
+
+/*
+ * Check whether the lock is held shared or exclusive
+ */
+bool is_rw_sleep_lock_held(struct rwsleeplock *lock)
+{
+    bool r;
+    acquire_spin_lock(&lock->lk);
+    r = (lock->writer || lock->readers > 0);
+    release_spin_lock(&lock->lk);
+    return r;
+}
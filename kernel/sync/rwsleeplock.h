@@ -0,0 +1,95 @@
+/**
+ * @file rwsleeplock.h
+ * @author ylp
+ * @brief Reader-writer sleep locks, any number of readers or a single writer
+ * @version 0.1
+ * @date 2022-05-24
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef RWSLEEPLOCK_H
+#define RWSLEEPLOCK_H
+
+#include "spinlock.h"
+
+/*
+ * Long-term reader-writer locks for processes
+ * A waiting writer holds off new readers, so a stream of readers can not starve it.
+ */
+struct rwsleeplock {
+    int readers;            // Number of processes holding the lock shared
+    bool writer;            // Is the lock held exclusive?
+    int writers_waiting;    // Writers sleeping on the lock
+    struct spinlock lk;     // spinlock protecting this sleep lock
+
+    // Fields used for debugging
+    char *name;             // The name of the lock
+    int pid;                // The process that holds the lock exclusive
+
+    // Contention statistics, see lockstat.h. Hold times are only gathered for exclusive holds,
+    // the readers overlap and one stamp can not time them all.
+    struct lock_class *stat;    // Statistics of the locks of this name, NULL if not gathered
+    uint64_t stamp;             // Counter value when the lock was acquired exclusive
+};
+
+/**
+ * @brief  Initialize the reader-writer sleep lock structure
+ * @param  lock: Pointer to a lock structure
+ * @param  *name: Lock name for debugging
+ * @retval None
+ */
+void init_rw_sleep_lock(struct rwsleeplock *lock, char *name);
+
+/**
+ * @brief  Acquire a reader-writer sleep lock shared, sleeps while a writer holds it or waits for it
+ * @param  *lock: Pointer to a lock structure
+ * @retval None
+ */
+void acquire_rw_sleep_lock_shared(struct rwsleeplock *lock);
+
+/**
+ * @brief  Release a reader-writer sleep lock held shared, the last reader wakes up the waiting writers
+ * @param  *lock: Pointer to a lock structure
+ * @retval None
+ */
+void release_rw_sleep_lock_shared(struct rwsleeplock *lock);
+
+/**
+ * @brief  Acquire a reader-writer sleep lock exclusive, sleeps while anyone holds it
+ * @param  *lock: Pointer to a lock structure
+ * @retval None
+ */
+void acquire_rw_sleep_lock_exclusive(struct rwsleeplock *lock);
+
+/**
+ * @brief  Release a reader-writer sleep lock held exclusive, Wake up blocked process on the lock
+ * @param  *lock: Pointer to a lock structure
+ * @retval None
+ */
+void release_rw_sleep_lock_exclusive(struct rwsleeplock *lock);
+
+/**
+ * @brief  Turn the exclusive hold of the current process into a shared one without letting a writer in between
+ * @param  *lock: Pointer to a lock structure held exclusive by the current process
+ * @retval None
+ */
+void downgrade_rw_sleep_lock(struct rwsleeplock *lock);
+
+/**
+ * @brief  Determines whether this lock is held exclusive by the current process
+ * @param  *lock: Pointer to a lock structure
+ * @retval Hold is 1, don't hold is 0
+ */
+bool is_current_proc_holding_rw_sleep_lock_exclusive(struct rwsleeplock *lock);
+
+/**
+ * @brief  Determines whether this lock is held at all, shared or exclusive
+ * The readers are not tracked one by one, so a shared hold can not be attributed to a process.
+ * @param  *lock: Pointer to a lock structure
+ * @retval Held is 1, free is 0
+ */
+bool is_rw_sleep_lock_held(struct rwsleeplock *lock);
+
+#endif /* RWSLEEPLOCK_H */
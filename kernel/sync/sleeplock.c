@@ -11,7 +11,9 @@
 
 #include "sleeplock.h"
 #include "spinlock.h"
+#include "lockstat.h"
 #include "../proc/proc.h"
+#include "../include/param.h"
 
 /*
  * Initialize the sleep lock structure
@@ -22,31 +24,99 @@ void init_sleep_lock(struct sleeplock *lock, char *name)
     lock->name = name;
     lock->locked = 0;
     lock->pid = 0;
+    lock->owner = NULL;
+    lock->waiters = 0;
+    lock->stat = lockstat_class(name);
+    lock->stamp = 0;
+}
+
+/*
+ * Whether owner still holds the lock and is running, on another CPU since we are running on this one
+ * Read without the locks, a stale answer only makes the waiter spin or sleep when it should not have.
+ */
+static inline bool owner_running(struct sleeplock *lock, struct proc *owner)
+{
+    return owner != NULL && __atomic_load_n(&lock->owner, __ATOMIC_RELAXED) == owner
+        && __atomic_load_n(&owner->state, __ATOMIC_RELAXED) == RUNNING;
 }
 
 /*
  * Acquire a sleep lock
+ * A holder running on another CPU is likely to release the lock soon, so the waiter spins on it until
+ * it releases the lock, stops running, or SLEEPLOCK_SPIN_US have passed, and only sleeps otherwise.
  */
 void acquire_sleep_lock(struct sleeplock *lock)
 {
+    uint64_t start = timestamp();
+    uint64_t spin_end = start + r_cntfrq_el0() / 1000000 * SLEEPLOCK_SPIN_US;
+    bool contended = false, slept = false;
     acquire_spin_lock(&lock->lk);
     while (lock->locked) {
+        contended = true;
+        struct proc *owner = lock->owner;
+        if (timestamp() < spin_end && owner_running(lock, owner)) {
+            release_spin_lock(&lock->lk);
+            while (timestamp() < spin_end && owner_running(lock, owner)) {
+                cpu_relax();
+            }
+            acquire_spin_lock(&lock->lk);
+            continue;
+        }
+        lock->waiters++;
+        lockstat_count(lock->stat, LOCKSTAT_SLEEP);
+        slept = true;
         sleep(lock, &lock->lk);
+        lock->waiters--;
     }
     lock->locked = 1;
-    lock->pid = myproc()->pid;
+    lock->owner = myproc();
+    lock->pid = lock->owner->pid;
+    if (lock->stat) {
+        lock->stamp = timestamp();
+        lockstat_acquired(lock->stat, lock->stamp - start, contended);
+        if (contended && !slept)
+            lockstat_count(lock->stat, LOCKSTAT_SPIN);
+    }
     release_spin_lock(&lock->lk);
 }
 
+/*
+ * Acquire a sleep lock only if it is free, never waits
+ */
+bool try_acquire_sleep_lock(struct sleeplock *lock)
+{
+    acquire_spin_lock(&lock->lk);
+    if (lock->locked) {
+        release_spin_lock(&lock->lk);
+        return false;
+    }
+    lock->locked = 1;
+    lock->owner = myproc();
+    lock->pid = lock->owner->pid;
+    if (lock->stat) {
+        lock->stamp = timestamp();
+        lockstat_acquired(lock->stat, 0, false);
+    }
+    release_spin_lock(&lock->lk);
+    return true;
+}
+
 /*
  * Release a sleep lock, Wake up blocked process on the lock
  */
 void release_sleep_lock(struct sleeplock *lock)
 {
     acquire_spin_lock(&lock->lk);
+    if (lock->stat)
+        lockstat_released(lock->stat, timestamp() - lock->stamp);
     lock->locked = 0;
     lock->pid = 0;
-    wakeup(lock);
+    __atomic_store_n(&lock->owner, NULL, __ATOMIC_RELAXED);
+    // Spinning waiters see the lock free by themselves, only sleepers need waking up
+    if (lock->waiters > 0) {
+        lockstat_count(lock->stat, LOCKSTAT_WAKEUP);
+        wakeup(lock);
+    }
     release_spin_lock(&lock->lk);
 }
 
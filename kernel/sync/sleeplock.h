@@ -16,14 +16,22 @@
 
 /*
  * Long-term locks for processes
+ * Adaptive: while the owner is running on another CPU it will likely release the lock soon,
+ * so a waiter spins for a while instead of paying for a sleep and a wakeup.
  */
 struct sleeplock {
     uint32_t locked;     // Is the lock held?
     struct spinlock lk;  // spinlock protecting this sleep lock
+    struct proc *owner;  // The process that holds the lock, read without lk by the spinning waiters
+    int waiters;         // Processes sleeping on the lock, release only calls wakeup() if there are any
     
     // Fields used for debugging
     char *name;         // The name of the lock
     int pid;            // The process that holds the lock
+
+    // Contention statistics, see lockstat.h
+    struct lock_class *stat;    // Statistics of the locks of this name, NULL if not gathered
+    uint64_t stamp;             // Counter value when the lock was acquired
 };
 
 /**
@@ -35,12 +43,19 @@ struct sleeplock {
 void init_sleep_lock(struct sleeplock *lock, char *name);
 
 /**
- * @brief  Acquire a sleep lock
+ * @brief  Acquire a sleep lock, Spin while the owner runs on another CPU, sleep otherwise
  * @param  *lock: Pointer to a lock structure
  * @retval None
  */
 void acquire_sleep_lock(struct sleeplock *lock);
 
+/**
+ * @brief  Acquire a sleep lock only if it is free
+ * @param  *lock: Pointer to a lock structure
+ * @retval true if it was acquired, false if somebody holds it
+ */
+bool try_acquire_sleep_lock(struct sleeplock *lock);
+
 /**
  * @brief  Release a sleep lock, Wake up blocked process on the lock
  * @param  *lock: Pointer to a lock structure
@@ -10,6 +10,7 @@
  */
 
 #include "spinlock.h"
+#include "lockstat.h"
 #include "interrupt/interrupt.h"
 #include "proc/proc.h"
 #include "../printf.h"
@@ -19,9 +20,49 @@
  */
 void init_spin_lock(struct spinlock *lock, const char *name)
 {
-    lock->locked = false;
+    lock->owner = 0;
+    lock->next = 0;
     lock->name = name;
     lock->cpu = NULL;
+    lock->stat = lockstat_class(name);
+    lock->stamp = 0;
+}
+
+/*
+ * Load-acquire the halfword at addr and mark it in the exclusive monitor of this core
+ * Any store to it by another core clears the monitor, which generates the event a following WFE waits for.
+ */
+static inline uint16_t load_acquire_exclusive(volatile uint16_t *addr)
+{
+    uint16_t val;
+    asm volatile("ldaxrh %w[val], %[addr]" : [val] "=r"(val) : [addr] "Q"(*addr) : "memory");
+    return val;
+}
+
+/*
+ * Atomically increment the halfword at addr and return its old value, an LDXRH/STXRH loop
+ */
+static inline uint16_t fetch_inc(volatile uint16_t *addr)
+{
+    uint16_t old;
+    uint32_t tmp, fail;
+    asm volatile(
+        "1: ldxrh %w[old], %[addr]\n"
+        "   add %w[tmp], %w[old], #1\n"
+        "   stxrh %w[fail], %w[tmp], %[addr]\n"
+        "   cbnz %w[fail], 1b\n"
+        : [old] "=&r"(old), [tmp] "=&r"(tmp), [fail] "=&r"(fail), [addr] "+Q"(*addr)
+        :
+        : "memory");
+    return old;
+}
+
+/*
+ * Store-release the halfword val at addr
+ */
+static inline void store_release(volatile uint16_t *addr, uint16_t val)
+{
+    asm volatile("stlrh %w[val], %[addr]" : [addr] "=Q"(*addr) : [val] "r"(val) : "memory");
 }
 
 /*
@@ -58,7 +99,8 @@ void pop_off(void)
 
 /*
  * Acquire the spin lock, Close local interrupt
- * Loops (spins) until the lock is acquired.
+ * Takes a ticket and waits until the owner field reaches it, so CPUs get the lock in FIFO order.
+ * While waiting only the owner field is read, in WFE, and the release of the previous holder wakes us up.
  */
 void acquire_spin_lock(struct spinlock *lock)
 {
@@ -67,12 +109,21 @@ void acquire_spin_lock(struct spinlock *lock)
     if (is_current_cpu_holding_spin_lock(lock))
         panic("acquire_spin_lock: the lock (%s) is already held by %lu\n", lock->name, cpuid());
 
-    while (lock->locked || __atomic_test_and_set(&lock->locked, __ATOMIC_ACQUIRE));
-
-    // memory barriorit, tells the compiler and CPU to not reorder loads or stores across the barrier
-    __sync_synchronize();
+    uint64_t start = lock->stat ? timestamp() : 0;
+    bool contended = false;
+    uint16_t ticket = fetch_inc(&lock->next);
+    // The load-acquire orders the critical section after the lock is seen to be ours. If the owner changes
+    // between the load and the WFE, the monitor is already cleared and the WFE returns at once.
+    while (load_acquire_exclusive(&lock->owner) != ticket) {
+        contended = true;
+        wfe();
+    }
     // Record info about lock acquisition for holding() and debugging.
     lock->cpu = mycpu(); 
+    if (lock->stat) {
+        lock->stamp = timestamp();
+        lockstat_acquired(lock->stat, lock->stamp - start, contended);
+    }
 }
 
 /*
@@ -83,9 +134,12 @@ void release_spin_lock(struct spinlock *lock)
     if (!is_current_cpu_holding_spin_lock(lock))
         panic("release_spin_lock: the lock (%s) held by %lu can't be released by %lu\n", lock->name, lock->cpu->cpuid, cpuid());
 
+    if (lock->stat)
+        lockstat_released(lock->stat, timestamp() - lock->stamp);
     lock->cpu = NULL;
-    __sync_synchronize();
-    __sync_lock_release(&lock->locked);
+    // Hand the lock to the next ticket. The store-release orders the critical section before it,
+    // and clears the exclusive monitor of the waiters, waking them up from WFE without a SEV.
+    store_release(&lock->owner, lock->owner + 1);
     pop_off();
 }
 
@@ -94,5 +148,6 @@ void release_spin_lock(struct spinlock *lock)
  */
 bool is_current_cpu_holding_spin_lock(struct spinlock *lock)
 {
-    return lock->locked && lock->cpu == mycpu();
+    return __atomic_load_n(&lock->owner, __ATOMIC_RELAXED) != __atomic_load_n(&lock->next, __ATOMIC_RELAXED) 
+        && lock->cpu == mycpu();
 }
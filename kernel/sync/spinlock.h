@@ -16,14 +16,20 @@
 #include <stdbool.h>
 
 /* 
- * Mutual exclusion lock
+ * Mutual exclusion lock, a ticket lock so that the CPUs get the lock in the order they asked for it.
+ * The lock is held while owner != next.
  */
 struct spinlock {
-    bool locked;        // Is the lock held?
+    uint16_t owner;     // Ticket of the CPU holding the lock, advanced by the holder on release
+    uint16_t next;      // Next ticket to hand out
 
     // For debugging
     const char *name;   // The lock name
     struct cpu *cpu;    // The cpu holding the lock
+
+    // Contention statistics, see lockstat.h
+    struct lock_class *stat;    // Statistics of the locks of this name, NULL if not gathered
+    uint64_t stamp;             // Counter value when the lock was acquired
 };
 
 /**
@@ -34,7 +40,7 @@ struct spinlock {
 bool is_current_cpu_holding_spin_lock(struct spinlock *lock);
 
 /**
- * @brief  Acquire the spin lock, Close local interrupt
+ * @brief  Acquire the spin lock, Close local interrupt. Waiters are served in FIFO order and wait in WFE.
  * @param  *lock: Pointer to a lock structure
  * @retval None
  */
@@ -67,4 +73,12 @@ void push_off(void);
  */
 void pop_off(void);
 
+/**
+ * @brief  Spin lock contention benchmark, one kernel thread per CPU hammers the old test-and-set lock and then
+ * the ticket lock, and the throughput and per-CPU acquisition counts are printed.
+ * Must be called from process context once all CPUs run the scheduler, the locktest system call does.
+ * @retval 0 on success, -1 if a benchmark is already running or there are no procs for the threads
+ */
+int spin_lock_test(void);
+
 #endif /* SPINLOCK_H */
\ No newline at end of file
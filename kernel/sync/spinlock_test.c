@@ -0,0 +1,168 @@
+/**
+ * @file spinlock_test.c
+ * @author ylp
+ * @brief Spin lock contention benchmark, the ticket lock against the test-and-set lock it replaced
+ * @version 0.1
+ * @date 2022-05-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "spinlock.h"
+#include "include/param.h"
+#include "proc/proc.h"
+#include "proc/kthread.h"
+#include "../printf.h"
+
+#define BENCH_MS        500     // How long every run hammers the lock
+#define BENCH_CS_LOOPS  50      // Work done with the lock held
+#define BENCH_NCS_LOOPS 100     // Work done between two acquisitions
+
+extern uint64_t ticks;
+extern struct spinlock tickslock;
+
+/*
+ * The previous spin lock, every waiter spins on test-and-set of one flag
+ */
+struct tas_lock {
+    bool locked;
+};
+
+static void tas_acquire(struct tas_lock *lock)
+{
+    push_off();
+    while (lock->locked || __atomic_test_and_set(&lock->locked, __ATOMIC_ACQUIRE));
+    __sync_synchronize();
+}
+
+static void tas_release(struct tas_lock *lock)
+{
+    __sync_synchronize();
+    __sync_lock_release(&lock->locked);
+    pop_off();
+}
+
+static struct {
+    bool running;                       // Set while a benchmark runs, there is one set of threads and counters
+    bool use_ticket;
+    struct spinlock ticket;
+    struct tas_lock tas;
+    uint64_t shared;                    // Protected by the lock under test
+    volatile bool go;                   // Set once every thread is on its CPU
+    volatile uint64_t end;              // Counter value at which the threads stop
+    volatile bool ready[NCPU];
+    volatile bool done[NCPU];
+    uint64_t acquisitions[NCPU];
+    uint64_t max_wait[NCPU];            // Longest wait for the lock, in counts
+} bench;
+
+/*
+ * Benchmark thread bound to CPU arg, acquires and releases the lock until the end of the run
+ */
+static int bench_thread(void *arg)
+{
+    int cpu = (int)(uint64_t)arg;
+    bench.ready[cpu] = true;
+    while (!bench.go);
+
+    while (timestamp() < bench.end) {
+        uint64_t start = timestamp();
+        if (bench.use_ticket)
+            acquire_spin_lock(&bench.ticket);
+        else
+            tas_acquire(&bench.tas);
+        uint64_t wait = timestamp() - start;
+        bench.shared++;
+        for (volatile int i = 0; i < BENCH_CS_LOOPS; i++);
+        if (bench.use_ticket)
+            release_spin_lock(&bench.ticket);
+        else
+            tas_release(&bench.tas);
+
+        bench.acquisitions[cpu]++;
+        if (wait > bench.max_wait[cpu])
+            bench.max_wait[cpu] = wait;
+        for (volatile int i = 0; i < BENCH_NCS_LOOPS; i++);
+    }
+    bench.done[cpu] = true;
+    // Left a zombie for kthread_stop()
+    return 0;
+}
+
+/*
+ * Run one thread per CPU against the lock for BENCH_MS and print the throughput and fairness.
+ * Returns -1 if there are no procs for the threads
+ */
+static int bench_run(bool use_ticket)
+{
+    struct proc *threads[NCPU];
+    bench.use_ticket = use_ticket;
+    init_spin_lock(&bench.ticket, "bench");
+    bench.tas.locked = false;
+    bench.shared = 0;
+    bench.go = false;
+    bench.end = 0;
+    for (int i = 0; i < NCPU; i++) {
+        bench.ready[i] = bench.done[i] = false;
+        bench.acquisitions[i] = bench.max_wait[i] = 0;
+        threads[i] = kthread_create(bench_thread, (void *)(uint64_t)i, "lockbench");
+        if (threads[i] == NULL) {
+            // The threads already started see an empty run and return
+            bench.go = true;
+            while (i-- > 0)
+                kthread_stop(threads[i]);
+            return -1;
+        }
+        kthread_bind(threads[i], i);
+        wake_up_process(threads[i]);
+    }
+
+    for (int i = 0; i < NCPU; i++) {
+        while (!bench.ready[i])
+            yield();
+    }
+    bench.end = timestamp() + r_cntfrq_el0() / 1000 * BENCH_MS;
+    __sync_synchronize();
+    bench.go = true;
+    // Sleep rather than yield, the thread bound to this CPU should have it to itself
+    acquire_spin_lock(&tickslock);
+    for (int i = 0; i < NCPU; i++) {
+        while (!bench.done[i])
+            sleep(&ticks, &tickslock);
+    }
+    release_spin_lock(&tickslock);
+    for (int i = 0; i < NCPU; i++) {
+        kthread_stop(threads[i]);
+    }
+
+    uint64_t total = 0, min = ~0UL, max = 0;
+    cprintf("spin_lock_test: %s lock, %d CPUs, %d ms\n", use_ticket ? "ticket" : "test-and-set", NCPU, BENCH_MS);
+    for (int i = 0; i < NCPU; i++) {
+        total += bench.acquisitions[i];
+        if (bench.acquisitions[i] < min)
+            min = bench.acquisitions[i];
+        if (bench.acquisitions[i] > max)
+            max = bench.acquisitions[i];
+        cprintf("  cpu %d: %lld acquisitions, max wait %lld counts\n", i, bench.acquisitions[i], bench.max_wait[i]);
+    }
+    cprintf("  total %lld acquisitions, min/max per CPU %lld/%lld\n", total, min, max);
+    if (bench.shared != total)
+        panic("spin_lock_test: lost updates, %lld != %lld.\n", bench.shared, total);
+    return 0;
+}
+
+/*
+ * Spin lock contention benchmark, must be called from process context once all CPUs run the scheduler.
+ * Returns -1 if another one is running or there are no procs for the threads
+ */
+int spin_lock_test(void)
+{
+    if (__atomic_test_and_set(&bench.running, __ATOMIC_ACQUIRE))
+        return -1;
+    int ret = bench_run(false);
+    if (ret == 0)
+        ret = bench_run(true);
+    __atomic_clear(&bench.running, __ATOMIC_RELEASE);
+    return ret;
+}
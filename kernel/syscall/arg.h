@@ -26,10 +26,10 @@ int64_t argstr(int n, char **pp);
  * @brief  Assign the nth argument in the system call to PP as a pointer and check that the pointer is within the process valid bounds
  * @param  n: parameter index
  * @param  pp: The address of a pointer
- * @param  size: Pointer size
+ * @param  size: Pointer size, in 64 bits so that callers computing n entries cannot wrap it
  * @retval 0 on success, and -1 on failure
  */
-int64_t argptr(int n, char **pp, int size);
+int64_t argptr(int n, char **pp, uint64_t size);
 
 /**
  * @brief  Get the nth parameter in the system call. Up to 6 parameters are supported, that is, 0-5 parameters
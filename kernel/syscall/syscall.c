@@ -41,7 +41,25 @@ static int64_t (*syscalls[])(void) = {
     [SYS_write] sys_write,
     [SYS_dup] sys_dup,
     [SYS_link] sys_link,
-    [SYS_unlink] sys_unlink
+    [SYS_unlink] sys_unlink,
+    [SYS_clone] sys_clone,
+    [SYS_join] sys_join,
+    [SYS_futex] sys_futex,
+    [SYS_sched_setaffinity] sys_sched_setaffinity,
+    [SYS_sched_getaffinity] sys_sched_getaffinity,
+    [SYS_getrusage] sys_getrusage,
+    [SYS_procinfo] sys_procinfo,
+    [SYS_cpuinfo] sys_cpuinfo,
+    [SYS_lockstat] sys_lockstat,
+    [SYS_irqinfo] sys_irqinfo,
+    [SYS_irq_setaffinity] sys_irq_setaffinity,
+    [SYS_bcacheinfo] sys_bcacheinfo,
+    [SYS_sync] sys_sync,
+    [SYS_readahead] sys_readahead,
+    [SYS_blkstat] sys_blkstat,
+    [SYS_blksched] sys_blksched,
+    [SYS_blkbench] sys_blkbench,
+    [SYS_locktest] sys_locktest
 };
 
 /*
@@ -68,7 +86,7 @@ unsupported_syscall:
  */
 int64_t fetchint64ataddr(uint64_t addr, uint64_t *ip)
 {
-    struct proc *proc = myproc();
+    struct proc *proc = myproc()->group_leader;
     if (addr >= proc->sz || addr + sizeof(*ip) > proc->sz)
         return -1;
     *ip = *(int64_t *)(addr);
@@ -84,7 +102,7 @@ int64_t fetchint64ataddr(uint64_t addr, uint64_t *ip)
  */
 int64_t fetchstr(uint64_t addr, char **p)
 {
-    struct proc *proc = myproc();
+    struct proc *proc = myproc()->group_leader;
     if(addr >= proc->sz)
         return -1;
     char *ep = (char *)proc->sz;
@@ -115,14 +133,15 @@ int64_t argint(int n, uint64_t *ip)
 /*
  * Assign the nth argument in the system call to PP as a pointer and check that the pointer is within the process valid bounds
  */
-int64_t argptr(int n, char **pp, int size)
+int64_t argptr(int n, char **pp, uint64_t size)
 {
     uint64_t i;
     if (argint(n, &i) < 0) 
         return -1;
 
-    struct proc *p = myproc();
-    if(i + size > p->sz) 
+    // Threads use the address space size of their group leader, written so that i + size cannot wrap
+    struct proc *p = myproc()->group_leader;
+    if (i > p->sz || size > p->sz - i)
         return -1;
         
     *pp = (char *)i;
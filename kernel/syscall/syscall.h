@@ -34,5 +34,23 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_yield  22
+#define SYS_clone  23
+#define SYS_join   24
+#define SYS_futex  25
+#define SYS_sched_setaffinity 26
+#define SYS_sched_getaffinity 27
+#define SYS_getrusage 28
+#define SYS_procinfo  29
+#define SYS_cpuinfo   30
+#define SYS_lockstat  31
+#define SYS_irqinfo   32
+#define SYS_irq_setaffinity 33
+#define SYS_bcacheinfo 34
+#define SYS_sync      35
+#define SYS_readahead 36
+#define SYS_blkstat   37
+#define SYS_blksched  38
+#define SYS_blkbench  39
+#define SYS_locktest  40
 
 #endif /* SYSCALL_H */
\ No newline at end of file
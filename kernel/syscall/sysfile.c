@@ -20,6 +20,11 @@
 #include "../printf.h"
 #include "../lib/string.h"
 #include "../pipe/pipe.h"
+#include "../buffer/buf.h"
+#include "../fs/readahead.h"
+#include "../block/blkdev.h"
+#include "../block/blk.h"
+#include "../block/blkbench.h"
 
 /*
  * Allocate a file descriptor for the given file.
@@ -28,19 +33,25 @@
 static int fdalloc(struct file *f)
 {
 	int fd;
-	struct proc *p = myproc();
+	// The descriptor table is shared by all threads of the group
+	struct proc *p = myproc()->group_leader;
 
+	acquire_spin_lock(&p->lock);
 	for (fd = 0; fd < NOFILE; fd++) {
 		if (p->ofile[fd] == 0) {
-      		p->ofile[fd] = f;
+			// Other threads look the slot up without the lock, see fileget()
+      		rcu_assign_pointer(p->ofile[fd], f);
+			release_spin_lock(&p->lock);
       		return fd;
    		}
   	}
+	release_spin_lock(&p->lock);
 	return -1;
 }
 
 /*
- * Gets the file descriptor
+ * Gets the file descriptor and takes a reference to its file, which the caller releases with fileclose()
+ * Another thread of the group may close the descriptor meanwhile, the reference keeps the file open until we are done.
  */
 static int argfd(int n, int64_t *pfd, struct file **pf)
 {
@@ -49,8 +60,10 @@ static int argfd(int n, int64_t *pfd, struct file **pf)
 
 	if (argint(n, (uint64_t *)&fd) < 0)
     	return -1;
-	if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0)
+	if (fd < 0 || fd >= NOFILE || (f = fileget(&myproc()->group_leader->ofile[fd])) == NULL)
     	return -1;
+	if (pf == NULL)
+		fileclose(f);
 	if (pfd)
     	*pfd = fd;
 	if (pf)
@@ -202,6 +215,7 @@ int64_t sys_open()
     } else {
         file->type = FD_INODE;
         file->off = 0;
+        file_ra_init(&file->ra);
     }
 
     file->ip = ip;
@@ -226,9 +240,16 @@ int64_t sys_close()
 {
     int64_t fd;
     struct file *file;
-    if (argfd(0, &fd, &file) < 0)
+    struct proc *p = myproc()->group_leader;
+    if (argint(0, (uint64_t *)&fd) < 0 || fd < 0 || fd >= NOFILE)
+        return -1;
+    // Take the file out of the table under the lock, so that two threads can not both close it
+    acquire_spin_lock(&p->lock);
+    file = p->ofile[fd];
+    p->ofile[fd] = NULL;
+    release_spin_lock(&p->lock);
+    if (file == NULL)
         return -1;
-    myproc()->ofile[fd] = 0;
     fileclose(file);
     return 0;
 }
@@ -242,9 +263,12 @@ int64_t sys_read()
     struct file *file;
     int64_t n;
     char *p;
-    if (argfd(0, 0, &file) < 0 || argint(2, (uint64_t *)&n) < 0 || argptr(1, &p, n) < 0)
+    int64_t r;
+    if (argint(2, (uint64_t *)&n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &file) < 0)
         return -1;
-    return fileread(file, p, n);
+    r = fileread(file, p, n);
+    fileclose(file);
+    return r;
 }
 
 /*
@@ -256,9 +280,12 @@ int64_t sys_write()
     struct file *file;
     int64_t n;
     char *p;
-    if(argfd(0, 0, &file) < 0 || argint(2, (uint64_t *)&n) < 0 || argptr(1, &p, n) < 0)
+    int64_t r;
+    if (argint(2, (uint64_t *)&n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &file) < 0)
         return -1;
-    return filewrite(file, p, n);
+    r = filewrite(file, p, n);
+    fileclose(file);
+    return r;
 }
 
 extern int exec(char *path, char **argv);
@@ -311,11 +338,12 @@ int64_t sys_dup()
         cprintf("sys_dup: failed to fetch fd.\n");
         return -1;
     }
+    // The new descriptor takes over the reference from argfd()
     if ((fd = fdalloc(file)) < 0) {
+        fileclose(file);
         cprintf("sys_dup: failed to allocate file.\n");
         return -1;
     }
-    filedup(file);
     return fd;
 }
 
@@ -343,9 +371,14 @@ int64_t sys_chdir()
         return -1;
     }
     iunlock(ip);
-    iput(p->cwd);
+    // Threads of the group may chdir() or look up relative paths at the same time
+    struct proc *leader = p->group_leader;
+    acquire_spin_lock(&leader->lock);
+    struct inode *old = leader->cwd;
+    leader->cwd = ip;
+    release_spin_lock(&leader->lock);
+    iput(old);
     end_op();
-    p->cwd = ip;
     return 0;
 }
 
@@ -358,9 +391,12 @@ int64_t sys_fstat()
     // user pointer to struct stat
     struct stat *st;
 
-    if (argfd(0, 0, &f) < 0 || argptr(1, (char **)&st, sizeof(struct stat)) < 0)
+    int64_t r;
+    if (argptr(1, (char **)&st, sizeof(struct stat)) < 0 || argfd(0, 0, &f) < 0)
         return -1;
-    return filestat(f, st);
+    r = filestat(f, st);
+    fileclose(f);
+    return r;
 }
 
 /*
@@ -522,7 +558,7 @@ int64_t sys_pipe(void)
 {
 	int (*fdarray)[2];
 	struct file *rf, *wf;
-	struct proc *p = myproc();
+	struct proc *p = myproc()->group_leader;
 	int fd0 = -1, fd1 = -1;
 
     if (argptr(0, (char **)&fdarray, sizeof(fdarray)) < 0) 
@@ -531,9 +567,17 @@ int64_t sys_pipe(void)
         return -1;
 	// Assign two new file descriptors fd0 and fd1
     if ((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0) {
-        if (fd0 >= 0) 
-            p->ofile[fd0] = NULL;
-        fileclose(rf);
+        if (fd0 >= 0) {
+            // Another thread may have closed fd0 already and the slot been reused, like sys_close()
+            acquire_spin_lock(&p->lock);
+            if (p->ofile[fd0] != rf)
+                rf = NULL;
+            else
+                p->ofile[fd0] = NULL;
+            release_spin_lock(&p->lock);
+        }
+        if (rf != NULL)
+            fileclose(rf);
         fileclose(wf);
         return -1;
     }
@@ -541,4 +585,86 @@ int64_t sys_pipe(void)
     (*fdarray)[0] = fd0;
     (*fdarray)[1] = fd1;
     return 0;
+}
+
+/*
+ * Fill in the buffer cache statistics
+ * int bcacheinfo(struct bcacheinfo *info);
+ */
+int64_t sys_bcacheinfo()
+{
+    struct bcacheinfo *info;
+    if (argptr(0, (char **)&info, sizeof(*info)) < 0)
+        return -1;
+    return bcacheinfo(info);
+}
+
+/*
+ * Write all dirty buffers and the committed log transaction to disk
+ * int sync(void);
+ */
+int64_t sys_sync()
+{
+    log_sync();
+    return 0;
+}
+
+/*
+ * Set the largest read-ahead window in blocks, 0 turns read-ahead off and a negative value only queries it
+ * Returns the previous largest window, -1 if blocks is above READAHEAD_MAX
+ * int readahead(int blocks);
+ */
+int64_t sys_readahead()
+{
+    int64_t blocks;
+    if (argint(0, (uint64_t *)&blocks) < 0)
+        return -1;
+    return readahead_set_max(blocks);
+}
+
+/*
+ * Fill in the request counts and latencies of the disk block device dev is on
+ * Returns -1 if there is no such device or its driver keeps no statistics
+ * int blkstat(const char *dev, struct blkstat *st);
+ */
+int64_t sys_blkstat()
+{
+    char *dev;
+    struct blkstat *st;
+    struct block_device *bd;
+    if (argstr(0, &dev) < 0 || argptr(1, (char **)&st, sizeof(*st)) < 0)
+        return -1;
+    if ((bd = blkdev_lookup(dev)) == NULL || bd->ops->stat == NULL)
+        return -1;
+    bd->ops->stat(bd->disk, st);
+    return 0;
+}
+
+/*
+ * Switch the I/O scheduler of the disk block device dev is on, "noop" or "deadline"
+ * Returns -1 if there is no such device or scheduler, or the device has no request queue
+ * int blksched(const char *dev, const char *name);
+ */
+int64_t sys_blksched()
+{
+    char *dev, *name;
+    struct block_device *bd;
+    if (argstr(0, &dev) < 0 || argstr(1, &name) < 0)
+        return -1;
+    if ((bd = blkdev_lookup(dev)) == NULL || bd->ops->set_scheduler == NULL)
+        return -1;
+    return bd->ops->set_scheduler(bd->disk, name);
+}
+
+/*
+ * Run a benchmark on a block device, the caller sleeps until it is over
+ * int blkbench(const struct blkbench_args *args, struct blkbench_result *res);
+ */
+int64_t sys_blkbench()
+{
+    struct blkbench_args *args;
+    struct blkbench_result *res;
+    if (argptr(0, (char **)&args, sizeof(*args)) < 0 || argptr(1, (char **)&res, sizeof(*res)) < 0)
+        return -1;
+    return blkbench(args, res);
 }
\ No newline at end of file
@@ -12,6 +12,10 @@
 #include "arg.h"
 #include "../include/stdint.h"
 #include "../proc/proc.h"
+#include "../sync/futex.h"
+#include "../sync/lockstat.h"
+#include "../sync/spinlock.h"
+#include "../arch/aarch64/board/raspi3/irq.h"
 
 extern uint64_t uptime();
 extern struct spinlock tickslock;
@@ -84,8 +88,8 @@ int64_t sys_sbrk()
     int64_t delta;
     if (argint(0, (uint64_t *)&delta) < 0) 
         return -1;
-    int64_t oldaddr = myproc()->sz;
-    if (growproc(delta) < 0) 
+    uint64_t oldaddr;
+    if (growproc(delta, &oldaddr) < 0) 
         return -1;
     return oldaddr;
 }
@@ -118,4 +122,182 @@ int64_t sys_sleep()
     }
     release_spin_lock(&tickslock);
     return 0;
+}
+
+/*
+ * Create a thread in the current process starting at entry(arg) on the given stack, returns the thread id.
+ * int clone(void (*entry)(void *), void *arg, void *stack, void *tls);
+ */
+int64_t sys_clone()
+{
+    uint64_t entry, arg, stack, tls;
+    if (argint(0, &entry) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0 || argint(3, &tls) < 0)
+        return -1;
+    // The stack grows down from its top, which must be inside the address space and 16-byte aligned
+    if (stack > myproc()->group_leader->sz || (stack % 16) != 0)
+        return -1;
+    return clone(entry, arg, stack, tls);
+}
+
+/*
+ * Wait for a thread of the current process to exit; exit status in *status.
+ * int join(int tid, int *status);
+ */
+int64_t sys_join()
+{
+    int64_t tid;
+    int32_t *status = NULL;
+    uint64_t addr;
+    if (argint(0, (uint64_t *)&tid) < 0 || argint(1, &addr) < 0)
+        return -1;
+    if (addr != 0 && argptr(1, (char **)&status, sizeof(int32_t)) < 0)
+        return -1;
+    return join(tid, status);
+}
+
+/*
+ * Wait on or wake up a futex word, timeout in ticks for FUTEX_WAIT (0 waits forever).
+ * int futex(uint32_t *uaddr, int op, uint32_t val, uint64_t timeout);
+ */
+int64_t sys_futex()
+{
+    uint64_t uaddr, op, val, timeout;
+    if (argint(0, &uaddr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0 || argint(3, &timeout) < 0)
+        return -1;
+    switch (op) {
+        case FUTEX_WAIT:
+            return futex_wait(uaddr, (uint32_t)val, timeout);
+        case FUTEX_WAKE:
+            return futex_wake(uaddr, (int64_t)val);
+        default:
+            return -1;
+    }
+}
+
+/*
+ * Set the mask of CPUs process pid (0 for the caller) may run on. Returns 0, or -1 for error
+ * int sched_setaffinity(int pid, uint64_t mask);
+ */
+int64_t sys_sched_setaffinity()
+{
+    int64_t pid;
+    uint64_t mask;
+    if (argint(0, (uint64_t *)&pid) < 0 || argint(1, &mask) < 0)
+        return -1;
+    return sched_setaffinity(pid, mask);
+}
+
+/*
+ * Get the mask of CPUs process pid (0 for the caller) may run on, or -1 for error
+ * int64_t sched_getaffinity(int pid);
+ */
+int64_t sys_sched_getaffinity()
+{
+    int64_t pid;
+    if (argint(0, (uint64_t *)&pid) < 0)
+        return -1;
+    return sched_getaffinity(pid);
+}
+
+/*
+ * Get the CPU usage of process pid (0 for the caller). Returns 0, or -1 for error
+ * int getrusage(int pid, struct rusage *ru);
+ */
+int64_t sys_getrusage()
+{
+    int64_t pid;
+    struct rusage *ru;
+    if (argint(0, (uint64_t *)&pid) < 0 || argptr(1, (char **)&ru, sizeof(*ru)) < 0)
+        return -1;
+    return getrusage(pid, ru);
+}
+
+/*
+ * Fill in up to n entries describing the live processes, returns the number of entries
+ * int procinfo(struct procinfo *info, int n);
+ */
+int64_t sys_procinfo()
+{
+    int64_t n;
+    struct procinfo *info;
+    if (argint(1, (uint64_t *)&n) < 0 || n < 0)
+        return -1;
+    if (n > NPROCINFO)
+        n = NPROCINFO;
+    if (argptr(0, (char **)&info, (uint64_t)n * sizeof(*info)) < 0)
+        return -1;
+    return procinfo(info, n);
+}
+
+/*
+ * Fill in the time accounting of up to n CPUs, returns the number of entries
+ * int cpuinfo(struct cpuinfo *info, int n);
+ */
+int64_t sys_cpuinfo()
+{
+    int64_t n;
+    struct cpuinfo *info;
+    if (argint(1, (uint64_t *)&n) < 0 || n < 0)
+        return -1;
+    if (n > NCPU)
+        n = NCPU;
+    if (argptr(0, (char **)&info, (uint64_t)n * sizeof(*info)) < 0)
+        return -1;
+    return cpuinfo(info, n);
+}
+
+/*
+ * Fill in the contention statistics of up to n lock classes, returns the number of entries
+ * The statistics are cleared afterwards if flags has LOCKSTAT_RESET.
+ * int lockstat(struct lockinfo *info, int n, int flags);
+ */
+int64_t sys_lockstat()
+{
+    int64_t n, flags;
+    struct lockinfo *info;
+    if (argint(1, (uint64_t *)&n) < 0 || n < 0 || argint(2, (uint64_t *)&flags) < 0)
+        return -1;
+    if (n > NLOCKCLASS)
+        n = NLOCKCLASS;
+    if (argptr(0, (char **)&info, (uint64_t)n * sizeof(*info)) < 0)
+        return -1;
+    return lockstat_read(info, n, flags);
+}
+
+/*
+ * Run the spin lock contention benchmark, the test-and-set lock against the ticket lock, results go to the console
+ * int locktest(void);
+ */
+int64_t sys_locktest()
+{
+    return spin_lock_test();
+}
+
+/*
+ * Fill in the per-CPU counts and the affinity of up to n interrupts, returns the number of entries
+ * int irqinfo(struct irqinfo *info, int n);
+ */
+int64_t sys_irqinfo()
+{
+    int64_t n;
+    struct irqinfo *info;
+    if (argint(1, (uint64_t *)&n) < 0 || n < 0)
+        return -1;
+    if (n > NR_IRQS)
+        n = NR_IRQS;
+    if (argptr(0, (char **)&info, (uint64_t)n * sizeof(*info)) < 0)
+        return -1;
+    return irqinfo(info, n);
+}
+
+/*
+ * Deliver interrupt irq to core cpu, the GPU interrupts all move together
+ * int irq_setaffinity(int irq, int cpu);
+ */
+int64_t sys_irq_setaffinity()
+{
+    int64_t irq, cpu;
+    if (argint(0, (uint64_t *)&irq) < 0 || argint(1, (uint64_t *)&cpu) < 0)
+        return -1;
+    return irq_set_affinity(irq, cpu);
 }
\ No newline at end of file
@@ -36,5 +36,23 @@ extern int64_t sys_chdir();
 extern int64_t sys_fstat();
 extern int64_t sys_link();
 extern int64_t sys_unlink();
+extern int64_t sys_clone();
+extern int64_t sys_join();
+extern int64_t sys_futex();
+extern int64_t sys_sched_setaffinity();
+extern int64_t sys_sched_getaffinity();
+extern int64_t sys_getrusage();
+extern int64_t sys_procinfo();
+extern int64_t sys_cpuinfo();
+extern int64_t sys_lockstat();
+extern int64_t sys_irqinfo();
+extern int64_t sys_irq_setaffinity();
+extern int64_t sys_bcacheinfo();
+extern int64_t sys_sync();
+extern int64_t sys_readahead();
+extern int64_t sys_blkstat();
+extern int64_t sys_blksched();
+extern int64_t sys_blkbench();
+extern int64_t sys_locktest();
 
 #endif /* SYSPROC_H */
\ No newline at end of file
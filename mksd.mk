@@ -20,7 +20,11 @@ FS_SECTORS := $(shell echo $$(($(SECTORS) - $(FS_OFFSET))))
 BUILD_BIN_DIR := $(BUILD_DIR)/user/bin
 USER_BIN := $(BUILD_BIN_DIR)/sh $(BUILD_BIN_DIR)/echo $(BUILD_BIN_DIR)/forktest $(BUILD_BIN_DIR)/hello  \
 			$(BUILD_BIN_DIR)/cat $(BUILD_BIN_DIR)/ls $(BUILD_BIN_DIR)/mkdir $(BUILD_BIN_DIR)/stressfs	\
-			$(BUILD_BIN_DIR)/sleep $(BUILD_BIN_DIR)/xargs $(BUILD_BIN_DIR)/find
+			$(BUILD_BIN_DIR)/sleep $(BUILD_BIN_DIR)/xargs $(BUILD_BIN_DIR)/find $(BUILD_BIN_DIR)/threadtest \
+			$(BUILD_BIN_DIR)/taskset $(BUILD_BIN_DIR)/top $(BUILD_BIN_DIR)/lockstat \
+			$(BUILD_BIN_DIR)/interrupts $(BUILD_BIN_DIR)/bcstat \
+			$(BUILD_BIN_DIR)/sync $(BUILD_BIN_DIR)/iostat $(BUILD_BIN_DIR)/blkbench \
+			$(BUILD_BIN_DIR)/locktest
 
 # Delete if build fails
 .DELETE_ON_ERROR: $(BOOT_IMG) $(SD_IMG)
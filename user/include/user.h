@@ -51,11 +51,142 @@ typedef unsigned long 		uint64;
 
 #define CONSOLE   1
 
+#define THREAD_STACK_SIZE  4096
+
+#define FUTEX_WAIT        0
+#define FUTEX_WAKE        1
+#define FUTEX_EAGAIN      (-11)
+#define FUTEX_ETIMEDOUT   (-110)
+
+#define LOCKSTAT_RESET    1
+
 struct dirent {
     uint16_t inum;
     char name[DIRSIZ];
 };
 
+typedef struct {
+	volatile uint32_t state;
+} mutex_t;
+
+typedef struct {
+	volatile uint32_t seq;
+} cond_t;
+
+typedef struct {
+	volatile uint32_t count;
+	volatile uint32_t waiters;
+} sem_t;
+
+struct rusage {
+	uint64_t utime;         // Time spent in user space (us)
+	uint64_t stime;         // Time spent in the kernel (us)
+	uint64_t wait_time;     // Time spent runnable waiting for a CPU (us)
+	uint64_t nvcsw;         // Voluntary context switches
+	uint64_t nivcsw;        // Involuntary context switches
+	uint64_t nr_migrations; // Number of times the process was moved to another CPU
+};
+
+struct procinfo {
+	int pid;
+	int state;
+	int last_cpu;
+	int kthread;
+	char name[16];
+	struct rusage ru;
+};
+
+struct cpuinfo {
+	uint64_t clock;         // Time since boot when the entry was filled in (us)
+	uint64_t utime;
+	uint64_t stime;
+	uint64_t idle_time;
+	uint64_t nr_switches;
+};
+
+struct lockinfo {
+	char name[16];
+	uint64_t acquisitions;
+	uint64_t contended;     // Acquisitions that had to wait
+	uint64_t wait_cycles;   // Times in counter ticks
+	uint64_t max_wait_cycles;
+	uint64_t hold_cycles;
+	uint64_t max_hold_cycles;
+	uint64_t spins;         // Sleep lock waits that ended while spinning
+	uint64_t sleeps;
+	uint64_t wakeups;
+};
+
+#define IRQINFO_NCPU      4     // NCPU of the kernel
+
+struct irqinfo {
+	char name[16];
+	int affinity;           // Core the interrupt is delivered to
+	int gpu;                // GPU interrupts all share one affinity
+	uint64_t count[IRQINFO_NCPU];
+};
+
+struct bcacheinfo {
+	uint64_t nbuf;          // Number of buffers
+	uint64_t nbuf_max;      // The most it may grow to
+	uint64_t a1;            // Buffers on A1, read in once
+	uint64_t am;            // Buffers on Am, used again
+	uint64_t hits;          // Lookups that found the block cached
+	uint64_t misses;        // Lookups that had to read the block in
+	uint64_t dirty;         // Buffers waiting to be written back
+	uint64_t writebacks;    // Delayed writes that reached the disk
+	uint64_t ra_blocks;     // Blocks read in by read-ahead
+	uint64_t ra_hits;       // Of those, blocks asked for later
+};
+
+struct blkstat {
+	char sched[16];         // Name of the I/O scheduler
+	uint64_t reads;         // Read requests completed
+	uint64_t writes;        // Write requests completed
+	uint64_t read_cmds;     // Commands they took, the rest were merged
+	uint64_t write_cmds;
+	uint64_t read_blocks;   // Blocks the requests transferred
+	uint64_t write_blocks;
+	uint64_t read_us;       // Total submit to complete latency of the reads
+	uint64_t write_us;
+	uint64_t max_read_us;
+	uint64_t max_write_us;
+	uint64_t max_depth;     // Most requests queued or active at once
+	uint64_t depth_total;   // Requests queued or active that each request found, summed
+};
+
+#define BLKBENCH_MAX_DEPTH 16   // BLKBENCH_MAX_DEPTH of the kernel
+#define BLKBENCH_HIST     20    // Latency buckets, bucket i counts those of 2^(i-1) to 2^i us
+#define BLKBENCH_SEQ      0
+#define BLKBENCH_RAND     1
+#define BLKBENCH_XFER_DEFAULT 0
+#define BLKBENCH_XFER_CPU 1
+#define BLKBENCH_XFER_DMA 2
+
+struct blkbench_args {
+	char dev[16];           // Name of the block device, e.g. "ram0" or "sd2"
+	uint32_t pattern;       // BLKBENCH_SEQ or BLKBENCH_RAND
+	uint32_t blocks;        // Blocks per request, up to 64
+	uint32_t depth;         // Requests in flight
+	uint32_t read_pct;      // Percent of the requests that read, the rest write
+	uint32_t span;          // Blocks from the start of the device used, 0 for all of it
+	uint32_t ms;            // How long to run
+	uint32_t xfer;          // BLKBENCH_XFER_*, how the driver moves the data
+	uint32_t verify;        // Write a pattern and read it back with every request
+};
+
+struct blkbench_result {
+	uint64_t reads;         // Requests completed
+	uint64_t writes;
+	uint64_t blocks;        // Blocks they transferred
+	uint64_t elapsed_us;
+	uint64_t lat_total_us;  // Submit to complete latency
+	uint64_t lat_min_us;
+	uint64_t lat_max_us;
+	uint64_t hist[BLKBENCH_HIST];
+	uint64_t mismatches;    // Blocks that did not read back what was written
+};
+
 struct stat {
 	int dev;     		// File system's disk device
 	uint32_t ino;   	// Inode number
@@ -89,6 +220,24 @@ int write(int fd, const void *buf, int nbytes);
 int dup(int fd);
 int link(const char *, const char *);
 int unlink(const char *path);
+int clone(void (*entry)(void *), void *arg, void *stack, void *tls);
+int join(int tid, int *status);
+int futex(volatile uint32_t *uaddr, int op, uint32_t val, uint64_t timeout);
+int sched_setaffinity(int pid, uint64_t mask);
+int64_t sched_getaffinity(int pid);
+int getrusage(int pid, struct rusage *ru);
+int procinfo(struct procinfo *info, int n);
+int cpuinfo(struct cpuinfo *info, int n);
+int lockstat(struct lockinfo *info, int n, int flags);
+int irqinfo(struct irqinfo *info, int n);
+int irq_setaffinity(int irq, int cpu);
+int bcacheinfo(struct bcacheinfo *info);
+int sync(void);
+int readahead(int blocks);
+int blkstat(const char *dev, struct blkstat *st);
+int blksched(const char *dev, const char *name);
+int blkbench(const struct blkbench_args *args, struct blkbench_result *res);
+int locktest(void);
 
 /*
  * User library functions
@@ -108,5 +257,21 @@ void free(void *addr);
 int atoi(const char *s);
 int memcmp(const void *s1, const void *s2, uint n);
 void *memcpy(void *dst, const void *src, uint n);
+int thread_create(void (*fn)(void *), void *arg);
+int thread_join(int tid, int *status);
+void thread_exit(int status) __attribute__((noreturn));
+int thread_self(void);
+void mutex_init(mutex_t *m);
+void mutex_lock(mutex_t *m);
+int mutex_trylock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
+void cond_init(cond_t *c);
+void cond_wait(cond_t *c, mutex_t *m);
+void cond_signal(cond_t *c);
+void cond_broadcast(cond_t *c);
+void sem_init(sem_t *s, uint32_t value);
+void sem_wait(sem_t *s);
+int sem_trywait(sem_t *s);
+void sem_post(sem_t *s);
 
 #endif /* _USER_H_ */
\ No newline at end of file
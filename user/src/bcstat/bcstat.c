@@ -0,0 +1,44 @@
+/**
+ * @file bcstat.c
+ * @author ylp
+ * @brief Show the buffer cache size, its 2Q queues, dirty buffers, hit rate and read-ahead.
+ * bcstat [-r blocks]    -r sets the largest read-ahead window, 0 turns read-ahead off
+ * @version 0.1
+ * @date 2022-06-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+int main(int argc, char *argv[])
+{
+	struct bcacheinfo info;
+
+	if (argc == 3 && strcmp(argv[1], "-r") == 0) {
+		if (readahead(atoi(argv[2])) < 0) {
+			fprintf(2, "bcstat: bad read-ahead window %s\n", argv[2]);
+			exit(1);
+		}
+	} else if (argc != 1) {
+		fprintf(2, "usage: bcstat [-r blocks]\n");
+		exit(1);
+	}
+	if (bcacheinfo(&info) < 0) {
+		fprintf(2, "bcstat: bcacheinfo failed\n");
+		exit(1);
+	}
+	uint64_t lookups = info.hits + info.misses;
+	printf("buffers %l of %l\n", info.nbuf, info.nbuf_max);
+	printf("a1      %l\n", info.a1);
+	printf("am      %l\n", info.am);
+	printf("hits    %l\n", info.hits);
+	printf("misses  %l\n", info.misses);
+	printf("dirty   %l\n", info.dirty);
+	printf("written %l\n", info.writebacks);
+	if (lookups > 0)
+		printf("hit rate %d%%\n", (int)(info.hits * 100 / lookups));
+	printf("read-ahead window %d, read ahead %l, used %l\n", readahead(-1), info.ra_blocks, info.ra_hits);
+	exit(0);
+}
@@ -0,0 +1,146 @@
+/**
+ * @file blkbench.c
+ * @author ylp
+ * @brief Benchmark a block device through the block layer, print IOPS, MB/s and a latency histogram.
+ * blkbench [-d dev] [-p seq|rand] [-b blocks] [-q depth] [-r read%] [-s span] [-t ms] [-x cpu|dma] [-v]
+ * Defaults are ram0, seq, 8 blocks per request, depth 1, all reads, the whole device, 2000 ms
+ * and whatever transfer the driver uses. -x cpu against -x dma compares the FIFO and DMA paths of the SD card.
+ * -v writes a pattern and reads it back with every request and counts the blocks that come back wrong.
+ * Writes destroy the data on the device, the kernel refuses them on the root file system.
+ * @version 0.1
+ * @date 2022-06-28
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+#define BAR 40
+
+static void usage(void)
+{
+	fprintf(2, "usage: blkbench [-d dev] [-p seq|rand] [-b blocks] [-q depth] [-r read%%] [-s span] [-t ms] [-x cpu|dma] [-v]\n");
+	exit(1);
+}
+
+/*
+ * Upper bound of the latency below which pct percent of the requests completed, from the histogram
+ */
+static uint64_t percentile(struct blkbench_result *res, uint64_t total, int pct)
+{
+	uint64_t seen = 0;
+	for (int i = 0; i < BLKBENCH_HIST; i++) {
+		seen += res->hist[i];
+		if (seen * 100 >= total * pct)
+			return i < BLKBENCH_HIST - 1 ? (1UL << i) : res->lat_max_us;
+	}
+	return res->lat_max_us;
+}
+
+int main(int argc, char *argv[])
+{
+	struct blkbench_args args;
+	struct blkbench_result res;
+
+	memset(&args, 0, sizeof(args));
+	strcpy(args.dev, "ram0");
+	args.pattern = BLKBENCH_SEQ;
+	args.blocks = 8;
+	args.depth = 1;
+	args.read_pct = 100;
+	args.ms = 2000;
+	for (int i = 1; i < argc; i += 2) {
+		if (strcmp(argv[i], "-v") == 0) {
+			args.verify = 1;
+			i--;
+			continue;
+		}
+		if (argv[i][0] != '-' || i + 1 >= argc)
+			usage();
+		char *v = argv[i + 1];
+		switch (argv[i][1]) {
+		case 'd':
+			if (strlen(v) >= sizeof(args.dev))
+				usage();
+			strcpy(args.dev, v);
+			break;
+		case 'p':
+			if (strcmp(v, "seq") == 0)
+				args.pattern = BLKBENCH_SEQ;
+			else if (strcmp(v, "rand") == 0)
+				args.pattern = BLKBENCH_RAND;
+			else
+				usage();
+			break;
+		case 'b':
+			args.blocks = atoi(v);
+			break;
+		case 'q':
+			args.depth = atoi(v);
+			break;
+		case 'r':
+			args.read_pct = atoi(v);
+			break;
+		case 's':
+			args.span = atoi(v);
+			break;
+		case 't':
+			args.ms = atoi(v);
+			break;
+		case 'x':
+			if (strcmp(v, "cpu") == 0)
+				args.xfer = BLKBENCH_XFER_CPU;
+			else if (strcmp(v, "dma") == 0)
+				args.xfer = BLKBENCH_XFER_DMA;
+			else
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	static char *xfer[] = { "default", "cpu", "dma" };
+	printf("blkbench: %s %s, %d blocks per request, depth %d, %d%% reads, %d ms, %s transfer%s\n", args.dev,
+		args.pattern == BLKBENCH_SEQ ? "seq" : "rand", args.blocks, args.depth, args.read_pct, args.ms,
+		xfer[args.xfer], args.verify ? ", verify" : "");
+	if (blkbench(&args, &res) < 0) {
+		fprintf(2, "blkbench: bad arguments, no such device or transfer, or out of memory\n");
+		exit(1);
+	}
+	uint64_t total = res.reads + res.writes;
+	if (total == 0 || res.elapsed_us == 0) {
+		printf("no requests completed\n");
+		exit(0);
+	}
+	printf("requests  %l, %l reads %l writes, in %l us\n", total, res.reads, res.writes, res.elapsed_us);
+	printf("IOPS      %l\n", total * 1000000 / res.elapsed_us);
+	printf("MB/s      %l.%l\n", res.blocks * 512 / res.elapsed_us, res.blocks * 512 * 10 / res.elapsed_us % 10);
+	if (args.verify)
+		printf("verify    %l blocks read back wrong\n", res.mismatches);
+	printf("latency   min %l avg %l max %l us, p50 < %l p99 < %l us\n", res.lat_min_us,
+		res.lat_total_us / total, res.lat_max_us, percentile(&res, total, 50), percentile(&res, total, 99));
+
+	uint64_t most = 0;
+	int last = 0;
+	for (int i = 0; i < BLKBENCH_HIST; i++) {
+		if (res.hist[i] > most)
+			most = res.hist[i];
+		if (res.hist[i])
+			last = i;
+	}
+	for (int i = 0; i <= last; i++) {
+		if (i == 0)
+			printf("      < 1 us ");
+		else if (i == BLKBENCH_HIST - 1)
+			printf(" >= %l us ", 1UL << (i - 1));
+		else
+			printf(" < %l us ", 1UL << i);
+		printf("%l\t", res.hist[i]);
+		for (uint64_t j = 0; j < res.hist[i] * BAR / most; j++)
+			printf("#");
+		printf("\n");
+	}
+	exit(0);
+}
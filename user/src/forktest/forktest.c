@@ -1,7 +1,7 @@
 /**
  * @file forktest.c
  * @author ylp
- * @brief Test that fork fails gracefully. Tiny executable so that the limit can be filling the proc table.
+ * @brief Test that fork scales past the size of the old fixed proc table and that every child is reaped.
  * @version 0.1
  * @date 2022-05-02
  * 
@@ -11,7 +11,8 @@
 
 #include "user.h"
 
-#define N  50
+// Well past the 64 entries the proc table used to have
+#define N  200
 
 void forktest(void)
 {
@@ -24,13 +25,12 @@ void forktest(void)
 		if (pid < 0)
       		break;
     	if (pid == 0) {
-        	printf("child id: %d\n", getpid());
         	exit(0);
     	}
   	}
 
-	if (n == N) {
-		printf("fork claimed to work N times!\n");
+	if (n < N) {
+		printf("fork failed after %d children\n", n);
 		exit(1);
   	}
 
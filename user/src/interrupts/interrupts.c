@@ -0,0 +1,59 @@
+/**
+ * @file interrupts.c
+ * @author ylp
+ * @brief Show how many interrupts each CPU handled and where they are delivered, or steer one to another CPU.
+ * interrupts [name cpu]
+ * @version 0.1
+ * @date 2022-06-13
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+#define NIRQINFO  16
+
+static struct irqinfo info[NIRQINFO];
+
+int main(int argc, char *argv[])
+{
+	int n = irqinfo(info, NIRQINFO);
+	if (n < 0) {
+		fprintf(2, "interrupts: irqinfo failed\n");
+		exit(1);
+	}
+
+	if (argc == 3) {
+		int cpu = atoi(argv[2]);
+		for (int i = 0; i < n; i++) {
+			if (strcmp(info[i].name, argv[1]) == 0) {
+				if (irq_setaffinity(i, cpu) < 0) {
+					fprintf(2, "interrupts: can not route %s to cpu %d\n", argv[1], cpu);
+					exit(1);
+				}
+				if (info[i].gpu)
+					printf("all GPU interrupts now go to cpu %d\n", cpu);
+				exit(0);
+			}
+		}
+		fprintf(2, "interrupts: no interrupt named %s\n", argv[1]);
+		exit(1);
+	} else if (argc != 1) {
+		fprintf(2, "usage: interrupts [name cpu]\n");
+		exit(1);
+	}
+
+	printf("NAME\tCPU\t");
+	for (int c = 0; c < IRQINFO_NCPU; c++)
+		printf("CPU%d\t", c);
+	printf("\n");
+	for (int i = 0; i < n; i++) {
+		printf("%s\t%d%s\t", info[i].name, info[i].affinity, info[i].gpu ? "*" : "");
+		for (int c = 0; c < IRQINFO_NCPU; c++)
+			printf("%l\t", info[i].count[c]);
+		printf("\n");
+	}
+	printf("* GPU interrupts, routed together\n");
+	exit(0);
+}
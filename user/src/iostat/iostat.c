@@ -0,0 +1,53 @@
+/**
+ * @file iostat.c
+ * @author ylp
+ * @brief Show the requests a disk completed, how many were merged, the queue depth and their latency.
+ * iostat [-d dev] [-s noop|deadline]    -d picks the device, sd by default, -s switches its I/O scheduler.
+ * A partition reports and switches the disk it is on, they share one request queue.
+ * @version 0.1
+ * @date 2022-06-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+int main(int argc, char *argv[])
+{
+	struct blkstat st;
+	char *dev = "sd", *sched = 0;
+
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 < argc && strcmp(argv[i], "-d") == 0)
+			dev = argv[i + 1];
+		else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+			sched = argv[i + 1];
+		else {
+			fprintf(2, "usage: iostat [-d dev] [-s noop|deadline]\n");
+			exit(1);
+		}
+	}
+	if (sched && blksched(dev, sched) < 0) {
+		fprintf(2, "iostat: no device %s or I/O scheduler %s\n", dev, sched);
+		exit(1);
+	}
+	if (blkstat(dev, &st) < 0) {
+		fprintf(2, "iostat: no device %s or it keeps no statistics\n", dev);
+		exit(1);
+	}
+	uint64_t requests = st.reads + st.writes;
+	uint64_t cmds = st.read_cmds + st.write_cmds;
+	printf("%s, scheduler %s\n", dev, st.sched);
+	printf("        requests  commands  blocks  avg us  max us\n");
+	printf("read    %l  %l  %l  %l  %l\n", st.reads, st.read_cmds, st.read_blocks,
+		st.reads ? st.read_us / st.reads : 0, st.max_read_us);
+	printf("write   %l  %l  %l  %l  %l\n", st.writes, st.write_cmds, st.write_blocks,
+		st.writes ? st.write_us / st.writes : 0, st.max_write_us);
+	if (cmds > 0)
+		printf("merged  %d%% of the requests\n", (int)((requests - cmds) * 100 / requests));
+	if (requests > 0)
+		printf("queue depth avg %d.%d max %l\n", (int)(st.depth_total / requests),
+			(int)(st.depth_total * 10 / requests % 10), st.max_depth);
+	exit(0);
+}
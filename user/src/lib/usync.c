@@ -0,0 +1,125 @@
+/**
+ * @file usync.c
+ * @author ylp
+ * @brief Mutexes, condition variables and semaphores on top of the futex system call.
+ * The uncontended paths are a single atomic instruction sequence and never enter the kernel.
+ * The mutex follows Ulrich Drepper, "Futexes Are Tricky", mutex3.
+ * @version 0.1
+ * @date 2022-05-14
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+#define MUTEX_UNLOCKED   0
+#define MUTEX_LOCKED     1  // Locked, no waiters
+#define MUTEX_CONTENDED  2  // Locked, there may be waiters sleeping in the kernel
+
+/*
+ * Compare and swap, returns the value found at addr
+ */
+static uint32_t cmpxchg(volatile uint32_t *addr, uint32_t expected, uint32_t desired)
+{
+	__atomic_compare_exchange_n(addr, &expected, desired, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+	return expected;
+}
+
+void mutex_init(mutex_t *m)
+{
+	m->state = MUTEX_UNLOCKED;
+}
+
+void mutex_lock(mutex_t *m)
+{
+	uint32_t c = cmpxchg(&m->state, MUTEX_UNLOCKED, MUTEX_LOCKED);
+	if (c == MUTEX_UNLOCKED)
+		return;
+	// Announce that we are going to sleep, whoever unlocks then has to call futex_wake
+	if (c != MUTEX_CONTENDED)
+		c = __atomic_exchange_n(&m->state, MUTEX_CONTENDED, __ATOMIC_ACQUIRE);
+	while (c != MUTEX_UNLOCKED) {
+		futex(&m->state, FUTEX_WAIT, MUTEX_CONTENDED, 0);
+		c = __atomic_exchange_n(&m->state, MUTEX_CONTENDED, __ATOMIC_ACQUIRE);
+	}
+}
+
+int mutex_trylock(mutex_t *m)
+{
+	return cmpxchg(&m->state, MUTEX_UNLOCKED, MUTEX_LOCKED) == MUTEX_UNLOCKED ? 0 : -1;
+}
+
+void mutex_unlock(mutex_t *m)
+{
+	if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != MUTEX_LOCKED) {
+		__atomic_store_n(&m->state, MUTEX_UNLOCKED, __ATOMIC_RELEASE);
+		futex(&m->state, FUTEX_WAKE, 1, 0);
+	}
+}
+
+void cond_init(cond_t *c)
+{
+	c->seq = 0;
+}
+
+/*
+ * The sequence number changes on every signal, so a signal between the unlock and the futex wait
+ * makes the wait return at once instead of being lost
+ */
+void cond_wait(cond_t *c, mutex_t *m)
+{
+	uint32_t seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+	mutex_unlock(m);
+	futex(&c->seq, FUTEX_WAIT, seq, 0);
+	mutex_lock(m);
+}
+
+void cond_signal(cond_t *c)
+{
+	__atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+	futex(&c->seq, FUTEX_WAKE, 1, 0);
+}
+
+void cond_broadcast(cond_t *c)
+{
+	__atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+	futex(&c->seq, FUTEX_WAKE, 0x7FFFFFFF, 0);
+}
+
+void sem_init(sem_t *s, uint32_t value)
+{
+	s->count = value;
+	s->waiters = 0;
+}
+
+int sem_trywait(sem_t *s)
+{
+	uint32_t c = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+	while (c > 0) {
+		if (__atomic_compare_exchange_n(&s->count, &c, c - 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return 0;
+	}
+	return -1;
+}
+
+void sem_wait(sem_t *s)
+{
+	while (sem_trywait(s) < 0) {
+		// Store waiters, then load count, while sem_post stores count, then loads waiters:
+		// without a full barrier between each store and load both may see the old value and the wakeup is lost
+		__atomic_fetch_add(&s->waiters, 1, __ATOMIC_SEQ_CST);
+		__sync_synchronize();
+		// Returns at once if a post made the count non-zero in the meantime
+		futex(&s->count, FUTEX_WAIT, 0, 0);
+		__atomic_fetch_sub(&s->waiters, 1, __ATOMIC_RELEASE);
+	}
+}
+
+void sem_post(sem_t *s)
+{
+	__atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+	__sync_synchronize();
+	if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) > 0)
+		futex(&s->count, FUTEX_WAKE, 1, 0);
+}
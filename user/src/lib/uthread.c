@@ -0,0 +1,107 @@
+/**
+ * @file uthread.c
+ * @author ylp
+ * @brief Minimal user threading library on top of the clone and join system calls
+ * @version 0.1
+ * @date 2022-05-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+/*
+ * Per-thread record, TPIDR_EL0 of a thread created by thread_create() points to it
+ */
+struct uthread {
+	int tid;
+	void (*fn)(void *);
+	void *arg;
+	void *stack;
+	struct uthread *next;
+};
+
+// Threads created and not yet joined, the lock also serializes malloc() and free() done here
+static struct uthread *threads;
+static mutex_t threads_lock;
+
+/*
+ * First function run by a new thread, on its own stack
+ */
+static void thread_start(void *arg)
+{
+	struct uthread *t = (struct uthread *)arg;
+	t->fn(t->arg);
+	thread_exit(0);
+}
+
+/*
+ * Create a thread running fn(arg) on a new stack, returns its thread id or -1
+ */
+int thread_create(void (*fn)(void *), void *arg)
+{
+	mutex_lock(&threads_lock);
+	struct uthread *t = malloc(sizeof(struct uthread));
+	if (t == NULL) {
+		mutex_unlock(&threads_lock);
+		return -1;
+	}
+	if ((t->stack = malloc(THREAD_STACK_SIZE)) == NULL) {
+		free(t);
+		mutex_unlock(&threads_lock);
+		return -1;
+	}
+	t->fn = fn;
+	t->arg = arg;
+	// The stack grows down and must be 16-byte aligned
+	uint64_t top = ((uint64_t)t->stack + THREAD_STACK_SIZE) & ~0xFUL;
+	t->tid = clone(thread_start, t, (void *)top, t);
+	if (t->tid < 0) {
+		free(t->stack);
+		free(t);
+		mutex_unlock(&threads_lock);
+		return -1;
+	}
+	t->next = threads;
+	threads = t;
+	mutex_unlock(&threads_lock);
+	return t->tid;
+}
+
+/*
+ * Wait for the thread tid to exit and release its stack, returns 0 or -1
+ */
+int thread_join(int tid, int *status)
+{
+	if (join(tid, status) < 0)
+		return -1;
+	mutex_lock(&threads_lock);
+	for (struct uthread **pp = &threads; *pp != NULL; pp = &(*pp)->next) {
+		struct uthread *t = *pp;
+		if (t->tid == tid) {
+			*pp = t->next;
+			free(t->stack);
+			free(t);
+			break;
+		}
+	}
+	mutex_unlock(&threads_lock);
+	return 0;
+}
+
+/*
+ * Terminate the calling thread, exit() from the main thread terminates the whole process
+ */
+void thread_exit(int status)
+{
+	exit(status);
+}
+
+/*
+ * Return the thread id of the calling thread, every thread has its own pid in the kernel
+ */
+int thread_self(void)
+{
+	return getpid();
+}
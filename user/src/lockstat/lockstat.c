@@ -0,0 +1,56 @@
+/**
+ * @file lockstat.c
+ * @author ylp
+ * @brief Show the lock contention statistics per lock class, most contended first.
+ * lockstat [-r]    -r clears the statistics after showing them
+ * @version 0.1
+ * @date 2022-06-02
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+#define NLOCKINFO  64
+
+static struct lockinfo info[NLOCKINFO];
+static int order[NLOCKINFO];
+
+int main(int argc, char *argv[])
+{
+	int flags = 0;
+
+	if (argc == 2 && strcmp(argv[1], "-r") == 0) {
+		flags = LOCKSTAT_RESET;
+	} else if (argc != 1) {
+		fprintf(2, "usage: lockstat [-r]\n");
+		exit(1);
+	}
+
+	int n = lockstat(info, NLOCKINFO, flags);
+	if (n < 0) {
+		fprintf(2, "lockstat: lock statistics are not compiled in\n");
+		exit(1);
+	}
+	for (int i = 0; i < n; i++)
+		order[i] = i;
+	for (int i = 0; i < n; i++) {
+		for (int j = i + 1; j < n; j++) {
+			if (info[order[j]].contended > info[order[i]].contended) {
+				int t = order[i];
+				order[i] = order[j];
+				order[j] = t;
+			}
+		}
+	}
+
+	printf("NAME\t\tACQUIRED\tCONTENDED\tWAIT\tWAIT MAX\tHOLD\tHOLD MAX (counts)\tSPINS\tSLEEPS\tWAKEUPS\n");
+	for (int k = 0; k < n; k++) {
+		struct lockinfo *l = &info[order[k]];
+		printf("%s\t%s%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\t%l\n", l->name, strlen(l->name) < 8 ? "\t" : "",
+			l->acquisitions, l->contended, l->wait_cycles, l->max_wait_cycles, l->hold_cycles, l->max_hold_cycles,
+			l->spins, l->sleeps, l->wakeups);
+	}
+	exit(0);
+}
@@ -0,0 +1,22 @@
+/**
+ * @file locktest.c
+ * @author ylp
+ * @brief Run the spin lock contention benchmark, the test-and-set lock against the ticket lock.
+ * The kernel prints the acquisitions and longest wait of every CPU to the console.
+ * @version 0.1
+ * @date 2022-05-22
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+int main(int argc, char *argv[])
+{
+	if (locktest() < 0) {
+		fprintf(2, "locktest: already running or out of procs\n");
+		exit(1);
+	}
+	exit(0);
+}
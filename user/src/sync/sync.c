@@ -0,0 +1,21 @@
+/**
+ * @file sync.c
+ * @author ylp
+ * @brief Write all dirty buffers of the buffer cache to disk.
+ * @version 0.1
+ * @date 2022-06-18
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+int main(int argc, char *argv[])
+{
+	if (sync() < 0) {
+		fprintf(2, "sync: failed\n");
+		exit(1);
+	}
+	exit(0);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file taskset.c
+ * @author ylp
+ * @brief Show or change the CPU affinity of a process, or run a command with a given affinity.
+ * taskset -p pid | taskset -p mask pid | taskset mask command [args...], masks are hexadecimal
+ * @version 0.1
+ * @date 2022-05-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+uint64_t parse_mask(const char *s)
+{
+	uint64_t mask = 0;
+
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s += 2;
+	for (; *s; s++) {
+		if (*s >= '0' && *s <= '9')
+			mask = mask * 16 + (*s - '0');
+		else if (*s >= 'a' && *s <= 'f')
+			mask = mask * 16 + (*s - 'a' + 10);
+		else if (*s >= 'A' && *s <= 'F')
+			mask = mask * 16 + (*s - 'A' + 10);
+		else
+			return 0;
+	}
+	return mask;
+}
+
+void usage(void)
+{
+	fprintf(2, "usage: taskset -p [mask] pid | taskset mask command [args...]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+		usage();
+
+	if (strcmp(argv[1], "-p") == 0) {
+		int pid = atoi(argv[argc - 1]);
+		if (argc == 4 && sched_setaffinity(pid, parse_mask(argv[2])) < 0) {
+			fprintf(2, "taskset: failed to set affinity of %d\n", pid);
+			exit(1);
+		}
+		int64_t mask = sched_getaffinity(pid);
+		if (mask < 0) {
+			fprintf(2, "taskset: no process %d\n", pid);
+			exit(1);
+		}
+		printf("pid %d's affinity mask: %x\n", pid, (int)mask);
+		exit(0);
+	}
+
+	if (sched_setaffinity(0, parse_mask(argv[1])) < 0) {
+		fprintf(2, "taskset: invalid mask %s\n", argv[1]);
+		exit(1);
+	}
+	exec(argv[2], argv + 2);
+	fprintf(2, "taskset: exec %s failed\n", argv[2]);
+	exit(1);
+}
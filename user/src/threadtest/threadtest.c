@@ -0,0 +1,196 @@
+/**
+ * @file threadtest.c
+ * @author ylp
+ * @brief Test that threads share memory and open files and can be joined, and the futex based locks
+ * @version 0.1
+ * @date 2022-05-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+#define NTHREAD  4
+#define NLOOP    100000
+
+#define NITEM    1000
+#define NROUND   10000
+
+static int results[NTHREAD];
+static int counter;
+static mutex_t counter_lock;
+
+// Bounded buffer shared by producer and consumers
+static int buffer[4];
+static int head, tail;
+static mutex_t buffer_lock;
+static sem_t slots, items;
+static int consumed;
+
+// A ping and a pong semaphore per pair of threads
+static sem_t ping[NTHREAD / 2], pong[NTHREAD / 2];
+
+void worker(void *arg)
+{
+	int id = (int)(uint64)arg;
+	int sum = 0;
+
+	for (int i = 0; i < NLOOP; i++)
+		sum += 1;
+	// Shared memory, each thread only writes its own slot
+	results[id] = sum;
+	// Shared open files
+	printf("thread %d (tid %d) done\n", id, thread_self());
+	thread_exit(id);
+}
+
+void counter_worker(void *arg)
+{
+	for (int i = 0; i < NLOOP; i++) {
+		mutex_lock(&counter_lock);
+		counter++;
+		mutex_unlock(&counter_lock);
+	}
+	thread_exit(0);
+}
+
+void consumer(void *arg)
+{
+	for (int i = 0; i < NITEM / NTHREAD; i++) {
+		sem_wait(&items);
+		mutex_lock(&buffer_lock);
+		consumed += buffer[tail];
+		tail = (tail + 1) % ARRAY_SIZE(buffer);
+		mutex_unlock(&buffer_lock);
+		sem_post(&slots);
+	}
+	thread_exit(0);
+}
+
+void pinger(void *arg)
+{
+	int pair = (int)(uint64)arg;
+
+	for (int i = 0; i < NROUND; i++) {
+		sem_post(&ping[pair]);
+		sem_wait(&pong[pair]);
+	}
+	thread_exit(0);
+}
+
+void ponger(void *arg)
+{
+	int pair = (int)(uint64)arg;
+
+	for (int i = 0; i < NROUND; i++) {
+		sem_wait(&ping[pair]);
+		sem_post(&pong[pair]);
+	}
+	thread_exit(0);
+}
+
+/*
+ * Threads increment a shared counter under a mutex
+ */
+void mutextest(void)
+{
+	int tids[NTHREAD];
+
+	printf("mutex test\n");
+	mutex_init(&counter_lock);
+	for (int i = 0; i < NTHREAD; i++)
+		tids[i] = thread_create(counter_worker, NULL);
+	for (int i = 0; i < NTHREAD; i++)
+		thread_join(tids[i], NULL);
+	if (counter != NTHREAD * NLOOP) {
+		printf("counter %d, expected %d\n", counter, NTHREAD * NLOOP);
+		exit(1);
+	}
+	printf("mutex test OK\n");
+}
+
+/*
+ * The main thread produces into a bounded buffer drained by consumer threads
+ */
+void semtest(void)
+{
+	int tids[NTHREAD];
+	int expected = 0;
+
+	printf("semaphore test\n");
+	mutex_init(&buffer_lock);
+	sem_init(&slots, ARRAY_SIZE(buffer));
+	sem_init(&items, 0);
+	for (int i = 0; i < NTHREAD; i++)
+		tids[i] = thread_create(consumer, NULL);
+	for (int i = 0; i < NITEM; i++) {
+		sem_wait(&slots);
+		mutex_lock(&buffer_lock);
+		buffer[head] = i;
+		head = (head + 1) % ARRAY_SIZE(buffer);
+		mutex_unlock(&buffer_lock);
+		sem_post(&items);
+		expected += i;
+	}
+	for (int i = 0; i < NTHREAD; i++)
+		thread_join(tids[i], NULL);
+	if (consumed != expected) {
+		printf("consumed %d, expected %d\n", consumed, expected);
+		exit(1);
+	}
+	printf("semaphore test OK\n");
+}
+
+/*
+ * Pairs of threads hand a token back and forth, every hand-over sleeps and wakes up on the futex.
+ * A lost wakeup between sem_wait and sem_post hangs the test
+ */
+void pingpongtest(void)
+{
+	int tids[NTHREAD];
+
+	printf("semaphore ping-pong test\n");
+	for (int i = 0; i < NTHREAD / 2; i++) {
+		sem_init(&ping[i], 0);
+		sem_init(&pong[i], 0);
+		tids[2 * i] = thread_create(pinger, (void *)(uint64)i);
+		tids[2 * i + 1] = thread_create(ponger, (void *)(uint64)i);
+	}
+	for (int i = 0; i < NTHREAD; i++)
+		thread_join(tids[i], NULL);
+	printf("semaphore ping-pong test OK\n");
+}
+
+int main(void)
+{
+	int tids[NTHREAD];
+	int status;
+
+	printf("thread test\n");
+	for (int i = 0; i < NTHREAD; i++) {
+		if ((tids[i] = thread_create(worker, (void *)(uint64)i)) < 0) {
+			printf("thread_create failed\n");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < NTHREAD; i++) {
+		if (thread_join(tids[i], &status) < 0 || status != i) {
+			printf("thread_join %d failed\n", i);
+			exit(1);
+		}
+		if (results[i] != NLOOP) {
+			printf("thread %d result %d, expected %d\n", i, results[i], NLOOP);
+			exit(1);
+		}
+	}
+	if (thread_join(tids[0], &status) != -1) {
+		printf("joined a thread twice\n");
+		exit(1);
+	}
+	printf("thread test OK\n");
+	mutextest();
+	semtest();
+	pingpongtest();
+	exit(0);
+}
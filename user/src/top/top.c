@@ -0,0 +1,119 @@
+/**
+ * @file top.c
+ * @author ylp
+ * @brief Show per-CPU and per-process CPU usage, sampled every delay ticks.
+ * top [-n iterations] [-d ticks]
+ * @version 0.1
+ * @date 2022-05-18
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "user.h"
+
+#define NPROCINFO  128
+#define NCPUINFO   8
+
+static char *states[] = { "unused", "embryo", "sleep", "runble", "run", "zombie" };
+
+static struct procinfo before[NPROCINFO], after[NPROCINFO];
+static struct cpuinfo cpu_before[NCPUINFO], cpu_after[NCPUINFO];
+static uint64_t busy[NPROCINFO];
+static int order[NPROCINFO];
+
+/*
+ * Print part of whole as a percentage with one decimal
+ */
+void print_percent(uint64_t part, uint64_t whole)
+{
+	uint64_t permille = whole ? part * 1000 / whole : 0;
+	printf("%d.%d%%", (int)(permille / 10), (int)(permille % 10));
+}
+
+/*
+ * CPU time used by process i of after[] since the previous sample
+ */
+uint64_t busy_since(int i, int nbefore)
+{
+	uint64_t now = after[i].ru.utime + after[i].ru.stime;
+	for (int j = 0; j < nbefore; j++) {
+		if (before[j].pid == after[i].pid)
+			return now - (before[j].ru.utime + before[j].ru.stime);
+	}
+	return now;
+}
+
+void show(int nbefore, int nafter, int ncpu)
+{
+	uint64_t elapsed = cpu_after[0].clock - cpu_before[0].clock;
+
+	for (int c = 0; c < ncpu; c++) {
+		printf("cpu%d  user ", c);
+		print_percent(cpu_after[c].utime - cpu_before[c].utime, elapsed);
+		printf("  sys ");
+		print_percent(cpu_after[c].stime - cpu_before[c].stime, elapsed);
+		printf("  idle ");
+		print_percent(cpu_after[c].idle_time - cpu_before[c].idle_time, elapsed);
+		printf("  switches %l\n", cpu_after[c].nr_switches - cpu_before[c].nr_switches);
+	}
+
+	// Busiest processes first
+	for (int i = 0; i < nafter; i++) {
+		busy[i] = busy_since(i, nbefore);
+		order[i] = i;
+	}
+	for (int i = 0; i < nafter; i++) {
+		for (int j = i + 1; j < nafter; j++) {
+			if (busy[order[j]] > busy[order[i]]) {
+				int t = order[i];
+				order[i] = order[j];
+				order[j] = t;
+			}
+		}
+	}
+
+	printf("PID\tCPU\t%%CPU\tUSER ms\tSYS ms\tWAIT ms\tVCSW\tIVCSW\tMIGR\tSTATE\tNAME\n");
+	for (int k = 0; k < nafter; k++) {
+		struct procinfo *p = &after[order[k]];
+		printf("%d\t%d\t", p->pid, p->last_cpu);
+		print_percent(busy[order[k]], elapsed);
+		printf("\t%l\t%l\t%l\t%l\t%l\t%l\t%s\t", p->ru.utime / 1000, p->ru.stime / 1000, p->ru.wait_time / 1000,
+			p->ru.nvcsw, p->ru.nivcsw, p->ru.nr_migrations,
+			(p->state >= 0 && p->state < ARRAY_SIZE(states)) ? states[p->state] : "?");
+		if (p->kthread)
+			printf("[%s]\n", p->name);
+		else
+			printf("%s\n", p->name);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 5, delay = 10;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-n") == 0) {
+			iterations = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-d") == 0) {
+			delay = atoi(argv[i + 1]);
+		} else {
+			fprintf(2, "usage: top [-n iterations] [-d ticks]\n");
+			exit(1);
+		}
+	}
+
+	int nafter = procinfo(after, NPROCINFO);
+	int ncpu = cpuinfo(cpu_after, NCPUINFO);
+	for (int it = 0; it < iterations; it++) {
+		int nbefore = nafter;
+		memcpy(before, after, sizeof(after));
+		memcpy(cpu_before, cpu_after, sizeof(cpu_after));
+		sleep(delay);
+		nafter = procinfo(after, NPROCINFO);
+		ncpu = cpuinfo(cpu_after, NCPUINFO);
+		show(nbefore, nafter, ncpu);
+	}
+	exit(0);
+}